@@ -0,0 +1,87 @@
+#include "BufferedFile.h"
+
+void BufferedFile::resetCrc() {
+  _crc = CRC16_INIT;
+}
+
+bool BufferedFile::fill() {
+  if (_pos < _len)
+    return true;
+  _len = _file.read(_buf, BUFFER_SIZE);
+  _pos = 0;
+
+  return (_len > 0);
+}
+
+bool BufferedFile::read(void *data, uint16_t len) {
+  uint8_t *ptr = (uint8_t*)data;
+
+  while (len) {
+    if (! fill())
+      return false;
+
+    uint16_t part = _len - _pos;
+
+    if (part > len)
+      part = len;
+    memcpy(ptr, &_buf[_pos], part);
+    _crc = crc16(ptr, part, _crc);
+    _pos += part;
+    ptr += part;
+    len -= part;
+  }
+
+  return true;
+}
+
+bool BufferedFile::skip(uint32_t len) {
+  while (len) {
+    if (! fill())
+      return false;
+
+    uint16_t part = _len - _pos;
+
+    if (part > len)
+      part = len;
+    _crc = crc16(&_buf[_pos], part, _crc);
+    _pos += part;
+    len -= part;
+  }
+
+  return true;
+}
+
+size_t BufferedFile::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t BufferedFile::write(const uint8_t *data, size_t len) {
+  const uint8_t *ptr = data;
+  size_t result = len;
+
+  while (len) {
+    size_t part = BUFFER_SIZE - _pos;
+
+    if (part > len)
+      part = len;
+    memcpy(&_buf[_pos], ptr, part);
+    _pos += part;
+    ptr += part;
+    len -= part;
+    if ((_pos >= BUFFER_SIZE) && (! flush()))
+      return 0;
+  }
+
+  return result;
+}
+
+bool BufferedFile::flush() {
+  if (! _pos)
+    return true;
+
+  bool result = (_file.write(_buf, _pos) == _pos);
+
+  _pos = 0;
+
+  return result;
+}
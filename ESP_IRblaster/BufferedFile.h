@@ -0,0 +1,34 @@
+#ifndef __BUFFEREDFILE_H
+#define __BUFFEREDFILE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "Crc.h"
+
+class BufferedFile : public Print { // Последовательное чтение или запись файла SPIFFS блоками по странице (с подсчетом CRC-16 прочитанного)
+public:
+  static const uint16_t BUFFER_SIZE = 256; // Размер страницы SPIFFS
+
+  BufferedFile(File &file) : _file(file), _pos(0), _len(0), _crc(CRC16_INIT) {}
+  bool read(void *data, uint16_t len);
+  bool skip(uint32_t len); // Пропуск байт (с учетом в CRC-16)
+  using Print::write;
+  size_t write(uint8_t data) override;
+  size_t write(const uint8_t *data, size_t len) override;
+  bool flush(); // Запись остатка буфера в файл
+  uint16_t crc() const { // CRC-16 прочитанных байт
+    return _crc;
+  }
+  void resetCrc();
+
+protected:
+  bool fill(); // Чтение в буфер следующей страницы, если текущая исчерпана
+
+  File &_file;
+  uint8_t _buf[BUFFER_SIZE];
+  uint16_t _pos; // Позиция в буфере
+  uint16_t _len; // Количество прочитанных в буфер байт
+  uint16_t _crc;
+};
+
+#endif
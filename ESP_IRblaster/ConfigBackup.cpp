@@ -0,0 +1,130 @@
+#include "ConfigBackup.h"
+#include "Record.h"
+
+uint32_t ConfigBackup::configSectionSize() {
+  uint32_t result = 0;
+  const char *key;
+  const uint8_t *value;
+  uint16_t len;
+
+  for (uint16_t i = 0; _config->entry(i, key, value, len); ++i)
+    result += 1 + sizeof(uint16_t) + strlen(key) + len;
+
+  return result;
+}
+
+uint32_t ConfigBackup::backupSize() {
+  return BACKUP_SECTION_HEADER + configSectionSize();
+}
+
+bool ConfigBackup::writeBackupHeader(Print &out) {
+  uint8_t data[BACKUP_HEADER];
+  RecordWriter header(data, sizeof(data));
+
+  header.put32(BACKUP_SIGNATURE);
+  header.put8(BACKUP_VERSION);
+
+  return (out.write(data, header.length()) == header.length());
+}
+
+bool ConfigBackup::readBackupHeader(BufferedFile &in) {
+  uint8_t data[BACKUP_HEADER];
+  RecordReader header(data, sizeof(data));
+  uint32_t sign;
+  uint8_t version;
+
+  if ((! in.read(data, sizeof(data))) || (! header.get32(sign)) || (sign != BACKUP_SIGNATURE) || (! header.get8(version)))
+    return false;
+  (void)version; // Новые версии только добавляют секции, которые пропускаются старыми прошивками
+
+  return true;
+}
+
+bool ConfigBackup::writeBackupSection(Print &out, uint8_t section, uint32_t len) {
+  uint8_t data[BACKUP_SECTION_HEADER];
+  RecordWriter header(data, sizeof(data));
+
+  header.put8(section);
+  header.put32(len);
+
+  return (out.write(data, header.length()) == header.length());
+}
+
+bool ConfigBackup::writeBackup(Print &out) {
+  const char *key;
+  const uint8_t *value;
+  uint16_t len;
+
+  if (! writeBackupSection(out, BACKUP_CONFIG, configSectionSize())) // Не backupSize(): наследники добавляют к нему свои секции
+    return false;
+  for (uint16_t i = 0; _config->entry(i, key, value, len); ++i) { // [длина ключа][длина значения LE16][ключ][значение]
+    uint8_t data[1 + sizeof(uint16_t)];
+    RecordWriter header(data, sizeof(data));
+    uint8_t keyLen = strlen(key);
+
+    header.put8(keyLen);
+    header.put16(len);
+    if ((out.write(data, header.length()) != header.length()) || (out.write((const uint8_t*)key, keyLen) != keyLen) ||
+      (out.write(value, len) != len))
+      return false;
+  }
+
+  return true;
+}
+
+bool ConfigBackup::restoreSection(uint8_t section, uint32_t len, BufferedFile &in) {
+  if (section != BACKUP_CONFIG)
+    return in.skip(len); // Секция более новой версии или другого скетча
+
+  _config->reset();
+  while (len) {
+    uint8_t data[1 + sizeof(uint16_t)];
+    RecordReader header(data, sizeof(data));
+    uint8_t keyLen;
+    uint16_t valueLen;
+
+    if ((len < sizeof(data)) || (! in.read(data, sizeof(data))))
+      return false;
+    header.get8(keyLen);
+    header.get16(valueLen);
+    len -= sizeof(data);
+    if ((! keyLen) || (keyLen > JOURNAL_MAX_KEY) || (valueLen > JOURNAL_MAX_VALUE) || (len < (uint32_t)keyLen + valueLen))
+      return false;
+
+    char key[JOURNAL_MAX_KEY + 1];
+
+    if (! in.read(key, keyLen))
+      return false;
+    key[keyLen] = '\0';
+
+    uint8_t *value = (uint8_t*)malloc(valueLen ? valueLen : 1);
+
+    if (! value)
+      return false;
+
+    bool result = in.read(value, valueLen) && _config->put(key, value, valueLen);
+
+    free(value);
+    if (! result)
+      return false;
+    len -= keyLen + valueLen;
+  }
+
+  return true;
+}
+
+bool ConfigBackup::readBackupSections(BufferedFile &in) {
+  uint8_t section;
+
+  while (in.read(&section, sizeof(section))) {
+    uint8_t data[sizeof(uint32_t)];
+    uint32_t len;
+
+    if (section == BACKUP_END)
+      return true;
+    if ((! in.read(data, sizeof(data))) || (! RecordReader(data, sizeof(data)).get32(len)) || (! restoreSection(section, len, in)))
+      return false;
+  }
+
+  return false; // Архив оборван до BACKUP_END
+}
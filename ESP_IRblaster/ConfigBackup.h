@@ -0,0 +1,39 @@
+#ifndef __CONFIGBACKUP_H
+#define __CONFIGBACKUP_H
+
+#include <Arduino.h>
+#include "ConfigJournal.h"
+#include "BufferedFile.h"
+
+const uint32_t BACKUP_SIGNATURE = 0x4B414223; // "#BAK"
+const uint8_t BACKUP_VERSION = 1;
+const uint8_t BACKUP_HEADER = sizeof(uint32_t) + 1; // Сигнатура и версия архива
+const uint8_t BACKUP_SECTION_HEADER = 1 + sizeof(uint32_t); // Номер и длина секции архива
+const uint8_t BACKUP_END = 0; // Завершающая секция (без длины)
+const uint8_t BACKUP_CONFIG = 1; // Секция журнала конфигурационных параметров
+const uint8_t BACKUP_EXTRA = 16; // Начальный номер секций, определяемых наследниками
+
+/*
+ * Архив конфигурации: [сигнатура][версия], секции [номер][длина LE32][данные], [BACKUP_END]. CRC-16 всего архива
+ * дописывает и проверяет вызывающий код. Наследники добавляют свои секции, переопределяя backupSize(), writeBackup() и restoreSection().
+ */
+class ConfigBackup {
+public:
+  ConfigBackup() : _config(NULL) {}
+  virtual ~ConfigBackup() {}
+
+  virtual uint32_t backupSize(); // Размер секций архива конфигурации
+  virtual bool writeBackup(Print &out); // Запись секций архива конфигурации
+  virtual bool restoreSection(uint8_t section, uint32_t len, BufferedFile &in); // Разбор секции архива в RAM (неизвестные секции пропускаются)
+  static bool writeBackupHeader(Print &out); // Запись сигнатуры и версии архива
+  static bool readBackupHeader(BufferedFile &in); // Проверка сигнатуры архива
+  static bool writeBackupSection(Print &out, uint8_t section, uint32_t len); // Запись заголовка секции архива
+  bool readBackupSections(BufferedFile &in); // Разбор секций архива до BACKUP_END
+
+protected:
+  uint32_t configSectionSize(); // Размер секции журнала без заголовка (не зависит от секций наследников)
+
+  ConfigJournal *_config; // Журнал конфигурационных параметров
+};
+
+#endif
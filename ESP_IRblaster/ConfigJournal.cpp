@@ -0,0 +1,247 @@
+#include "ConfigJournal.h"
+#include "Crc.h"
+
+static const uint8_t RECORD_MAGIC = 0xA5;
+
+ConfigJournal::ConfigJournal(PGM_P fileName, PGM_P tempName, uint16_t maxSize) : _fileName(fileName), _tempName(tempName), _maxSize(maxSize),
+  _entries(NULL), _count(0), _capacity(0), _size(0), _appends(0), _skips(0), _compactions(0) {}
+
+ConfigJournal::~ConfigJournal() {
+  reset();
+  if (_entries)
+    free(_entries);
+}
+
+int16_t ConfigJournal::find(const char *key) const {
+  for (uint16_t i = 0; i < _count; ++i) {
+    if (! strcmp(_entries[i].key, key))
+      return i;
+  }
+
+  return -1;
+}
+
+bool ConfigJournal::set(const char *key, const uint8_t *value, uint16_t len, bool dirty) {
+  int16_t i = find(key);
+
+  if (i < 0) {
+    if (_count >= _capacity) {
+      entry_t *entries = (entry_t*)realloc(_entries, sizeof(entry_t) * (_capacity + 8));
+
+      if (! entries)
+        return false;
+      _entries = entries;
+      _capacity += 8;
+    }
+    _entries[_count].key = strdup(key);
+    if (! _entries[_count].key)
+      return false;
+    _entries[_count].value = NULL;
+    _entries[_count].len = 0;
+    i = _count++;
+  } else if ((_entries[i].len == len) && (! memcmp(_entries[i].value, value, len))) {
+    return true;
+  }
+
+  uint8_t *newValue = (uint8_t*)realloc(_entries[i].value, len ? len : 1);
+
+  if (! newValue)
+    return false;
+  memcpy(newValue, value, len);
+  _entries[i].value = newValue;
+  _entries[i].len = len;
+  _entries[i].dirty = dirty;
+
+  return true;
+}
+
+bool ConfigJournal::begin() {
+  String fileName = FPSTR(_fileName);
+  String tempName = FPSTR(_tempName);
+
+  if (SPIFFS.exists(tempName)) {
+    if (SPIFFS.exists(fileName)) // Сжатие прервано до удаления старого журнала
+      SPIFFS.remove(tempName);
+    else // Сжатие прервано между удалением старого журнала и переименованием нового
+      SPIFFS.rename(tempName, fileName);
+  }
+
+  File file = SPIFFS.open(fileName, "r");
+
+  _size = 0;
+  if (! file)
+    return true; // Журнал еще не создан
+
+  uint32_t fileSize = file.size();
+  uint8_t *record = (uint8_t*)malloc(4 + JOURNAL_MAX_KEY + 1 + JOURNAL_MAX_VALUE + 1);
+
+  if (! record) {
+    file.close();
+    return false;
+  }
+  while (_size < fileSize) {
+    uint8_t *header = record;
+
+    if ((file.read(header, 4) != 4) || (header[0] != RECORD_MAGIC) || (! header[1]) || (header[1] > JOURNAL_MAX_KEY))
+      break;
+
+    uint16_t len = header[2] | (header[3] << 8);
+
+    if ((len > JOURNAL_MAX_VALUE) || (file.read(&record[4], header[1] + len + 1) != (size_t)(header[1] + len + 1)) ||
+      (crc8(record, 4 + header[1] + len) != record[4 + header[1] + len]))
+      break; // Запись повреждена или не дописана
+
+    char key[JOURNAL_MAX_KEY + 1];
+
+    memcpy(key, &record[4], header[1]);
+    key[header[1]] = '\0';
+    if (! set(key, &record[4 + header[1]], len, false))
+      break;
+    _size += 4 + header[1] + len + 1;
+  }
+  free(record);
+  file.close();
+
+  if (_size < fileSize) // Отбрасываем поврежденный хвост, иначе новые записи окажутся после него
+    return compact();
+
+  return true;
+}
+
+uint16_t ConfigJournal::length(const String &key) const {
+  int16_t i = find(key.c_str());
+
+  return i < 0 ? 0 : _entries[i].len;
+}
+
+bool ConfigJournal::get(const String &key, void *value, uint16_t len) const {
+  int16_t i = find(key.c_str());
+
+  if (i < 0)
+    return false;
+  memcpy(value, _entries[i].value, _entries[i].len < len ? _entries[i].len : len);
+
+  return true;
+}
+
+bool ConfigJournal::put(const String &key, const void *value, uint16_t len) {
+  if ((! key.length()) || (key.length() > JOURNAL_MAX_KEY) || (len > JOURNAL_MAX_VALUE))
+    return false;
+
+  return set(key.c_str(), (const uint8_t*)value, len, true);
+}
+
+bool ConfigJournal::writeRecords(File &file, bool dirtyOnly) {
+  for (uint16_t i = 0; i < _count; ++i) {
+    if (dirtyOnly && (! _entries[i].dirty))
+      continue;
+
+    uint8_t keyLen = strlen(_entries[i].key);
+    uint8_t header[4] = { RECORD_MAGIC, keyLen, (uint8_t)_entries[i].len, (uint8_t)(_entries[i].len >> 8) };
+    uint8_t crc = crc8(header, sizeof(header));
+
+    crc = crc8((const uint8_t*)_entries[i].key, keyLen, crc);
+    crc = crc8(_entries[i].value, _entries[i].len, crc);
+    if ((file.write(header, sizeof(header)) != sizeof(header)) || (file.write((const uint8_t*)_entries[i].key, keyLen) != keyLen) ||
+      (file.write(_entries[i].value, _entries[i].len) != _entries[i].len) || (file.write(&crc, sizeof(crc)) != sizeof(crc)))
+      return false;
+  }
+
+  return true;
+}
+
+bool ConfigJournal::commit() {
+  uint32_t pending = 0;
+
+  for (uint16_t i = 0; i < _count; ++i) {
+    if (_entries[i].dirty)
+      pending += recordSize(_entries[i]);
+  }
+  if (! pending) {
+    ++_skips;
+    return true;
+  }
+  if (_size + pending > _maxSize)
+    return compact();
+
+  File file = SPIFFS.open(String(FPSTR(_fileName)), "a");
+
+  if (! file)
+    return false;
+  bool result = writeRecords(file, true);
+  file.close();
+  if (! result) { // Недописанная запись будет отброшена при следующей загрузке
+    _size = _maxSize;
+    return false;
+  }
+  for (uint16_t i = 0; i < _count; ++i)
+    _entries[i].dirty = false;
+  _size += pending;
+  ++_appends;
+
+  return true;
+}
+
+bool ConfigJournal::compact() {
+  return prepareCompact() && finishCompact();
+}
+
+bool ConfigJournal::prepareCompact() {
+  String tempName = FPSTR(_tempName);
+  File file = SPIFFS.open(tempName, "w");
+
+  if (! file)
+    return false;
+  bool result = writeRecords(file, false);
+  file.close();
+  if (! result) {
+    SPIFFS.remove(tempName);
+    return false;
+  }
+
+  return true;
+}
+
+bool ConfigJournal::finishCompact() {
+  String fileName = FPSTR(_fileName);
+  String tempName = FPSTR(_tempName);
+
+  if ((! SPIFFS.remove(fileName) && SPIFFS.exists(fileName)) || (! SPIFFS.rename(tempName, fileName))) {
+    SPIFFS.remove(tempName);
+    return false;
+  }
+
+  _size = 0;
+  for (uint16_t i = 0; i < _count; ++i) {
+    _entries[i].dirty = false;
+    _size += recordSize(_entries[i]);
+  }
+  ++_compactions;
+
+  return true;
+}
+
+void ConfigJournal::reset() {
+  for (uint16_t i = 0; i < _count; ++i) {
+    free(_entries[i].key);
+    free(_entries[i].value);
+  }
+  _count = 0;
+}
+
+void ConfigJournal::clear() {
+  reset();
+  _size = 0;
+  SPIFFS.remove(String(FPSTR(_fileName)));
+  SPIFFS.remove(String(FPSTR(_tempName)));
+}
+
+bool ConfigJournal::entry(uint16_t index, const char *&key, const uint8_t *&value, uint16_t &len) const {
+  if (index >= _count)
+    return false;
+  key = _entries[index].key;
+  value = _entries[index].value;
+  len = _entries[index].len;
+
+  return true;
+}
@@ -0,0 +1,74 @@
+#ifndef __CONFIGJOURNAL_H
+#define __CONFIGJOURNAL_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+const uint8_t JOURNAL_MAX_KEY = 32; // Максимальная длина ключа
+const uint16_t JOURNAL_MAX_VALUE = 1024; // Максимальный размер значения
+
+/*
+ * Журнал параметров "ключ -> значение" в файле SPIFFS. Изменения дописываются в конец файла записями
+ * [0xA5][длина ключа][длина значения LE16][ключ][значение][CRC-8], актуальна последняя запись с данным ключом.
+ * При превышении размера журнал сжимается во временный файл, который затем переименовывается.
+ */
+class ConfigJournal {
+public:
+  ConfigJournal(PGM_P fileName, PGM_P tempName, uint16_t maxSize);
+  ~ConfigJournal();
+  bool begin(); // Загрузка журнала (вызывается после SPIFFS.begin())
+  uint16_t count() const { // Количество ключей
+    return _count;
+  }
+  uint16_t length(const String &key) const; // Размер сохраненного значения (0, если ключ отсутствует)
+  bool get(const String &key, void *value, uint16_t len) const; // Чтение значения (если сохранено меньше len байт, остаток не меняется)
+  bool put(const String &key, const void *value, uint16_t len); // Изменение значения в RAM (в файл попадет при commit())
+  bool commit(); // Дописывание измененных значений в журнал
+  bool compact(); // Перезапись журнала только актуальными значениями
+  bool prepareCompact(); // Первый шаг compact(): запись актуальных значений во временный файл
+  bool finishCompact(); // Второй шаг compact(): замена журнала временным файлом
+  void reset(); // Удаление всех значений из RAM без изменения файла журнала
+  void clear(); // Удаление всех значений и файла журнала
+  bool entry(uint16_t index, const char *&key, const uint8_t *&value, uint16_t &len) const; // Перебор значений по индексу (0..count()-1)
+
+  uint32_t size() const { // Текущий размер файла журнала
+    return _size;
+  }
+  uint32_t appends() const { // Количество дописываний в журнал
+    return _appends;
+  }
+  uint32_t skips() const { // Количество пропущенных записей (без изменений)
+    return _skips;
+  }
+  uint32_t compactions() const { // Количество сжатий журнала
+    return _compactions;
+  }
+
+protected:
+  struct entry_t {
+    char *key;
+    uint8_t *value;
+    uint16_t len;
+    bool dirty; // Значение еще не записано в журнал
+  };
+
+  static uint16_t recordSize(const entry_t &entry) {
+    return 4 + strlen(entry.key) + entry.len + 1;
+  }
+  int16_t find(const char *key) const;
+  bool set(const char *key, const uint8_t *value, uint16_t len, bool dirty);
+  bool writeRecords(File &file, bool dirtyOnly); // Запись элементов в файл
+
+  PGM_P _fileName;
+  PGM_P _tempName;
+  uint16_t _maxSize;
+  entry_t *_entries;
+  uint16_t _count;
+  uint16_t _capacity;
+  uint32_t _size;
+  uint32_t _appends;
+  uint32_t _skips;
+  uint32_t _compactions;
+};
+
+#endif
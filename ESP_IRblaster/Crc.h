@@ -0,0 +1,13 @@
+#ifndef __CRC_H
+#define __CRC_H
+
+#include <Arduino.h>
+
+const uint8_t CRC8_INIT = 0x00; // Начальное значение CRC-8 (полином 0x31)
+const uint16_t CRC16_INIT = 0xFFFF; // Начальное значение CRC-16/CCITT (полином 0x1021)
+
+// Табличное вычисление контрольных сумм. Для вычисления по частям результат предыдущего вызова передается как crc.
+uint8_t crc8(const uint8_t *data, size_t len, uint8_t crc = CRC8_INIT);
+uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = CRC16_INIT);
+
+#endif
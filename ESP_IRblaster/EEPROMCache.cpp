@@ -0,0 +1,113 @@
+#include <EEPROM.h>
+#include "EEPROMCache.h"
+#include "Crc.h"
+
+uint8_t EEPROMCache::read(uint16_t &offset) {
+  return EEPROM.read(offset++);
+}
+
+bool EEPROMCache::read(uint16_t &offset, uint8_t *buf, uint16_t len) {
+  if (offset + len > _size)
+    return false;
+
+  memcpy(buf, EEPROM.getConstDataPtr() + offset, len);
+  offset += len;
+
+  return true;
+}
+
+bool EEPROMCache::write(uint16_t &offset, uint8_t data) {
+  if (offset >= _size)
+    return false;
+
+  if (EEPROM.read(offset) != data) {
+    EEPROM.write(offset, data);
+    _dirty = true;
+  }
+  ++offset;
+
+  return true;
+}
+
+bool EEPROMCache::write(uint16_t &offset, const uint8_t *buf, uint16_t len) {
+  if (offset + len > _size)
+    return false;
+
+  if (memcmp(EEPROM.getConstDataPtr() + offset, buf, len)) { // getDataPtr() помечает буфер измененным, поэтому вызывается только при реальных отличиях
+    memcpy(EEPROM.getDataPtr() + offset, buf, len);
+    _dirty = true;
+  }
+  offset += len;
+
+  return true;
+}
+
+bool EEPROMCache::readString(uint16_t &offset, String &str, uint16_t maxlen) {
+  if (offset + maxlen > _size)
+    return false;
+
+  const char *data = (const char*)EEPROM.getConstDataPtr() + offset;
+  size_t len = strnlen(data, maxlen);
+
+  if (len < maxlen)
+    str = data;
+  else { // Строка занимает все поле без завершающего нуля
+    str = "";
+    if (! str.reserve(len))
+      return false;
+    for (size_t i = 0; i < len; ++i)
+      str += data[i];
+  }
+  offset += maxlen;
+
+  return true;
+}
+
+bool EEPROMCache::writeString(uint16_t &offset, const String &str, uint16_t maxlen) {
+  if (offset + maxlen > _size)
+    return false;
+
+  const uint8_t *data = EEPROM.getConstDataPtr() + offset;
+  size_t slen = str.length();
+  bool changed;
+
+  if (slen > maxlen)
+    slen = maxlen;
+  changed = memcmp(data, str.c_str(), slen);
+  for (uint16_t i = slen; (! changed) && (i < maxlen); ++i)
+    changed = data[i];
+  if (changed) {
+    uint8_t *ptr = EEPROM.getDataPtr() + offset;
+
+    memcpy(ptr, str.c_str(), slen);
+    memset(ptr + slen, 0, maxlen - slen);
+    _dirty = true;
+  }
+  offset += maxlen;
+
+  return true;
+}
+
+bool EEPROMCache::commit() {
+  if (! _dirty) // Содержимое не изменилось, стирать и перезаписывать сектор flash не нужно
+    return true;
+  if (! EEPROM.commit())
+    return false;
+  _dirty = false;
+
+  return true;
+}
+
+void EEPROMCache::clear() {
+  memset(EEPROM.getDataPtr(), 0xFF, _size);
+  _dirty = true;
+}
+
+uint8_t EEPROMCache::crc8(uint16_t start, uint16_t end) const {
+  if (end > _size)
+    end = _size;
+  if (start >= end)
+    return CRC8_INIT;
+
+  return ::crc8(EEPROM.getConstDataPtr() + start, end - start);
+}
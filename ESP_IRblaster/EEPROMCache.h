@@ -0,0 +1,48 @@
+#ifndef __EEPROMCACHE_H
+#define __EEPROMCACHE_H
+
+#include <Arduino.h>
+
+/*
+ * Параметры в буфере EEPROM ядра (EEPROM.begin() вызывается заранее). Значения копируются блоками с проверкой границ,
+ * буфер помечается измененным только при реальных отличиях, поэтому commit() пропускает сохранения без изменений.
+ */
+class EEPROMCache {
+public:
+  EEPROMCache(uint16_t size) : _size(size), _dirty(false) {}
+  uint16_t size() const {
+    return _size;
+  }
+  bool dirty() const { // Буфер изменен после последней записи во flash
+    return _dirty;
+  }
+  uint8_t read(uint16_t &offset); // Чтение одного байта
+  bool read(uint16_t &offset, uint8_t *buf, uint16_t len); // Чтение буфера
+  bool write(uint16_t &offset, uint8_t data); // Запись одного байта
+  bool write(uint16_t &offset, const uint8_t *buf, uint16_t len); // Запись буфера
+  bool readString(uint16_t &offset, String &str, uint16_t maxlen); // Чтение строки из поля длиной maxlen
+  bool writeString(uint16_t &offset, const String &str, uint16_t maxlen); // Запись строки в поле длиной maxlen (остаток заполняется нулями)
+  bool get(uint16_t &offset) { // Окончание списка переменных для чтения
+    (void)offset;
+    return true;
+  }
+  template<typename T, typename... Args> bool get(uint16_t &offset, T &t, Args&... args) { // Последовательное чтение переменных (в том числе массивов)
+    return read(offset, (uint8_t*)&t, sizeof(T)) && get(offset, args...);
+  }
+  bool put(uint16_t &offset) { // Окончание списка переменных для записи
+    (void)offset;
+    return true;
+  }
+  template<typename T, typename... Args> bool put(uint16_t &offset, const T &t, const Args&... args) { // Последовательная запись переменных (в том числе массивов)
+    return write(offset, (const uint8_t*)&t, sizeof(T)) && put(offset, args...);
+  }
+  bool commit(); // Запись буфера во flash (только если он изменен)
+  void clear(); // Стирание буфера (0xFF)
+  uint8_t crc8(uint16_t start, uint16_t end) const; // 8-ми битная контрольная сумма участка
+
+protected:
+  uint16_t _size;
+  bool _dirty;
+};
+
+#endif
@@ -10,9 +10,72 @@ extern "C" {
 #include <EEPROM.h>
 #include "Date.h"
 #include "RTCmem.h"
+#include "Crc.h"
+#include "Record.h"
 
 const uint16_t EEPROM_SIZE = 4096;
 
+struct contenttype_t {
+  char ext[6];
+  char type[25];
+};
+
+static const contenttype_t contentTypes[] PROGMEM = { // Первый элемент - тип по умолчанию
+  { "", "text/plain" }, { ".htm", "text/html" }, { ".html", "text/html" }, { ".css", "text/css" }, { ".js", "application/javascript" },
+  { ".png", "image/png" }, { ".gif", "image/gif" }, { ".jpg", "image/jpeg" }, { ".jpeg", "image/jpeg" }, { ".ico", "image/x-icon" },
+  { ".xml", "text/xml" }, { ".pdf", "application/x-pdf" }, { ".zip", "application/x-zip" }, { ".gz", "application/x-gzip" }
+};
+
+class BackupWriter : public Print { // Отправка архива конфигурации блоками с подсчетом CRC-16
+public:
+  BackupWriter(Print &out) : _out(out), _pos(0), _crc(CRC16_INIT) {}
+  using Print::write;
+  size_t write(uint8_t data) override {
+    return write(&data, 1);
+  }
+  size_t write(const uint8_t *data, size_t len) override {
+    size_t result = len;
+
+    _crc = crc16(data, len, _crc);
+    while (len) {
+      size_t part = sizeof(_buf) - _pos;
+
+      if (part > len)
+        part = len;
+      memcpy(&_buf[_pos], data, part);
+      _pos += part;
+      data += part;
+      len -= part;
+      if ((_pos >= sizeof(_buf)) && (! send()))
+        return 0;
+    }
+
+    return result;
+  }
+  bool end() { // Дописывание CRC-16 и отправка остатка буфера
+    uint8_t data[sizeof(uint16_t)];
+    RecordWriter trailer(data, sizeof(data));
+
+    trailer.put16(_crc);
+
+    return (write(data, trailer.length()) == trailer.length()) && send();
+  }
+
+protected:
+  bool send() {
+    bool result = (_out.write(_buf, _pos) == _pos);
+
+    _pos = 0;
+
+    return result;
+  }
+
+  Print &_out;
+  uint8_t _buf[256];
+  uint16_t _pos;
+  uint16_t _crc;
+};
+
 static void halt() {
 #ifdef LED_PIN
   digitalWrite(LED_PIN, HIGH); // Гасим светодиод
@@ -30,7 +93,7 @@ static void halt() {
  *   ESPWebBase class implementation
  */
 
-ESPWebBase::ESPWebBase() {
+ESPWebBase::ESPWebBase() : _eeprom(EEPROM_SIZE) {
   httpServer = new ESP8266WebServer(80);
 #ifdef LED_PIN
   _ticker = new Ticker();
@@ -40,6 +103,22 @@ ESPWebBase::ESPWebBase() {
 #else
   _log = new StringLog();
 #endif
+  _files = new FileIndex(&ESPWebBase::contentTypeIndex);
+  _router = new HttpRouter(this);
+  _config = new ConfigJournal(configJournalFile, configJournalTemp, CONFIG_JOURNAL_SIZE);
+  _pageCache = new PageCache(PAGE_CACHE_SLOTS, PAGE_CACHE_SIZE);
+  _configGeneration = 0;
+  memset(&_rtcState, 0, sizeof(_rtcState));
+  _timeValidTime = 0;
+  _connectedTime = 0;
+  _lastNtpTime = 0;
+  _lastNtpUpdate = 0;
+  _timeRestored = false;
+  _wifiState = WIFI_IDLE;
+  _mdnsStarted = false;
+  _wifiTime = 0;
+  _wifiStart = 0;
+  _wifiBackoff = WIFI_RETRY_MIN;
 }
 
 void ESPWebBase::setup() {
@@ -48,22 +127,44 @@ void ESPWebBase::setup() {
   pinMode(LED_PIN, OUTPUT);
 #endif
 
-  EEPROM.begin(EEPROM_SIZE);
-
   if (! SPIFFS.begin()) {
     _log->println(F("Unable to mount SPIFFS!"));
   }
+  _files->build();
+  if (! _config->begin()) {
+    _log->println(F("Unable to load config journal!"));
+  }
 
   uint16_t offset = 0;
 
-  if (! readConfig(offset)) {
-    _log->println(F("EEPROM is empty or corrupt!"));
+  if (! readConfig()) {
+    EEPROM.begin(EEPROM_SIZE); // Буфер EEPROM нужен только на время миграции
+    if (readEEPROMConfig(offset)) {
+      _log->println(F("Migrating config from EEPROM"));
+      writeConfig();
+    } else {
+      _log->println(F("Config is empty or corrupt!"));
+    }
+    EEPROM.end();
   }
 
   offset = 0;
   if (! readRTCmemory(offset)) {
     _log->println(F("RTC memory is empty!"));
   }
+  if (_rtcState.time) {
+    rst_info *info = ESP.getResetInfoPtr();
+
+    if ((info->reason == REASON_SOFT_RESTART) || (info->reason == REASON_SOFT_WDT_RST) || (info->reason == REASON_WDT_RST) ||
+      (info->reason == REASON_EXCEPTION_RST)) { // После включения питания или сна длительность простоя неизвестна
+      _lastNtpTime = _rtcState.time;
+      _lastNtpUpdate = 0; // Время с момента старта учитывается через millis()
+      _timeRestored = true;
+      _timeValidTime = millis();
+      logDateTime();
+      _log->println(F(" time restored from RTC memory"));
+    }
+  }
 
   if (! WiFi.hostname(getHostName())) {
     _log->println(F("Unable to change host name!"));
@@ -79,8 +180,7 @@ void ESPWebBase::setup() {
       sntp_setservername(2, _ntpServer3);
     sntp_init();
   }
-  _lastNtpTime = 0;
-  _lastNtpUpdate = 0;
+  _configGeneration = ESP.getCycleCount(); // ETag-и не должны совпадать между перезагрузками
 
   setupExtra();
 
@@ -89,17 +189,20 @@ void ESPWebBase::setup() {
 }
 
 void ESPWebBase::loop() {
-  const uint32_t timeout = 300000; // 5 min.
-  static uint32_t nextTime = timeout;
-
-  if ((!_apMode) && (WiFi.status() != WL_CONNECTED) && ((WiFi.getMode() == WIFI_STA) || ((int32_t)(millis() - nextTime) >= 0))) {
-    setupWiFi();
-    nextTime = millis() + timeout;
-  }
-
+  loopWiFi();
   httpServer->handleClient();
   loopExtra();
 
+  static uint32_t rtcFlushTime = 0;
+
+  if ((int32_t)(millis() - rtcFlushTime) >= 0) { // Мелкие изменения RTC-памяти объединяются в одну запись
+    uint16_t offset = 0;
+
+    writeRTCmemory(offset);
+    RTCmem.flush();
+    rtcFlushTime = millis() + RTC_FLUSH_INTERVAL;
+  }
+
   delay(1); // For WiFi maintenance
 }
 
@@ -113,6 +216,10 @@ void ESPWebBase::reboot() {
 }
 
 void ESPWebBase::cleanup() {
+  uint16_t offset = 0;
+
+  writeRTCmemory(offset); // Актуальное время для восстановления после перезагрузки
+  RTCmem.flush();
 #ifdef LED_PIN
   disablePulse();
   digitalWrite(LED_PIN, HIGH);
@@ -155,6 +262,11 @@ bool ESPWebBase::readRTCmemory(uint16_t &offset) {
     _log->println(F("No signature found in RTC!"));
     return false;
   }
+  if (! RTCmem.getSlot(offset, _rtcState)) {
+    memset(&_rtcState, 0, sizeof(_rtcState));
+    _log->println(F("RTC state is corrupt!"));
+  }
+  offset += sizeof(_rtcState) + 1;
 
   return true;
 }
@@ -165,103 +277,53 @@ bool ESPWebBase::writeRTCmemory(uint16_t &offset) {
 //  _log->println(F("Writing config to RTC"));
   RTCmem.put(offset, sign);
   offset += sizeof(sign);
+  _rtcState.time = _lastNtpTime ? getTime() : 0;
+  RTCmem.putSlot(offset, _rtcState);
+  offset += sizeof(_rtcState) + 1;
 
   return true;
 }
 
 uint8_t ESPWebBase::readEEPROM(uint16_t &offset) {
-  return EEPROM.read(offset++);
+  return _eeprom.read(offset);
 }
 
 bool ESPWebBase::readEEPROM(uint16_t &offset, uint8_t *buf, uint16_t len) {
-  if (offset + len > EEPROM_SIZE)
-    return false;
-
-  while (len--)
-    *buf++ = EEPROM.read(offset++);
-
-  return true;
+  return _eeprom.read(offset, buf, len);
 }
 
 bool ESPWebBase::writeEEPROM(uint16_t &offset, uint8_t data) {
-  if (offset >= EEPROM_SIZE)
-    return false;
-
-  EEPROM.write(offset++, data);
-
-  return true;
+  return _eeprom.write(offset, data);
 }
 
 bool ESPWebBase::writeEEPROM(uint16_t &offset, const uint8_t *buf, uint16_t len) {
-  if (offset + len > EEPROM_SIZE)
-    return false;
-
-  while (len--)
-    EEPROM.write(offset++, *buf++);
-
-  return true;
+  return _eeprom.write(offset, buf, len);
 }
 
 bool ESPWebBase::readEEPROMString(uint16_t &offset, String &str, uint16_t maxlen) {
-  if (offset + maxlen > EEPROM_SIZE)
-    return false;
-
-  str = strEmpty;
-  while (maxlen--) {
-    char c = readEEPROM(offset);
-    if (! c)
-      break;
-    else
-      str += c;
-  }
-
-  return true;
+  return _eeprom.readString(offset, str, maxlen);
 }
 
 bool ESPWebBase::writeEEPROMString(uint16_t &offset, const String &str, uint16_t maxlen) {
-  if (offset + maxlen > EEPROM_SIZE)
-    return false;
-
-  size_t slen = str.length();
-
-  for (uint16_t i = 0; i < maxlen; ++i) {
-    if (i < slen)
-      writeEEPROM(offset, str[i]);
-    else
-      writeEEPROM(offset, 0);
-  }
-
-  return true;
+  return _eeprom.writeString(offset, str, maxlen);
 }
 
 void ESPWebBase::commitEEPROM() {
-  EEPROM.commit();
+  if (! _eeprom.commit())
+    _log->println(F("Error writing EEPROM!"));
 }
 
 void ESPWebBase::clearEEPROM() {
-  uint16_t offset = 0;
-  uint16_t size = EEPROM_SIZE;
-
-  while (size--)
-    writeEEPROM(offset, 0xFF);
+  _eeprom.clear();
   commitEEPROM();
   _log->println(F("EEPROM erased succefully!"));
 }
 
 uint8_t ESPWebBase::crc8EEPROM(uint16_t start, uint16_t end) {
-  uint8_t crc = 0;
-
-  while (start < end) {
-    crc ^= readEEPROM(start);
-
-    for (uint8_t i = 0; i < 8; ++i)
-      crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
-  }
-
-  return crc;
+  return _eeprom.crc8(start, end);
 }
 
-bool ESPWebBase::readConfig(uint16_t &offset) {
+bool ESPWebBase::readEEPROMConfig(uint16_t &offset) {
   uint32_t sign;
 
   _log->println(F("Reading config from EEPROM"));
@@ -270,13 +332,8 @@ bool ESPWebBase::readConfig(uint16_t &offset) {
     defaultConfig();
     return false;
   }
-  if ((! readEEPROM(offset, (uint8_t*)&_apMode, sizeof(_apMode))) || (! readEEPROM(offset, (uint8_t*)_ssid, sizeof(_ssid))) ||
-    (! readEEPROM(offset, (uint8_t*)_password, sizeof(_password))) || (! readEEPROM(offset, (uint8_t*)_domain, sizeof(_domain))) ||
-    (! readEEPROM(offset, (uint8_t*)_userName, sizeof(_userName))) || (! readEEPROM(offset, (uint8_t*)_userPassword, sizeof(_userPassword))) ||
-    (! readEEPROM(offset, (uint8_t*)_adminName, sizeof(_adminName))) || (! readEEPROM(offset, (uint8_t*)_adminPassword, sizeof(_adminPassword))) ||
-    (! readEEPROM(offset, (uint8_t*)_ntpServer1, sizeof(_ntpServer1))) || (! readEEPROM(offset, (uint8_t*)_ntpServer2, sizeof(_ntpServer2))) ||
-    (! readEEPROM(offset, (uint8_t*)_ntpServer3, sizeof(_ntpServer3))) || (! readEEPROM(offset, (uint8_t*)&_ntpTimeZone, sizeof(_ntpTimeZone))) ||
-    (! readEEPROM(offset, (uint8_t*)&_ntpUpdateInterval, sizeof(_ntpUpdateInterval)))) {
+  if (! getEEPROM(offset, _apMode, _ssid, _password, _domain, _userName, _userPassword, _adminName, _adminPassword,
+    _ntpServer1, _ntpServer2, _ntpServer3, _ntpTimeZone, _ntpUpdateInterval)) {
     _log->println(F("Error reading from EEPROM!"));
     defaultConfig();
     return false;
@@ -292,34 +349,149 @@ bool ESPWebBase::readConfig(uint16_t &offset) {
   return true;
 }
 
-bool ESPWebBase::writeConfig(uint16_t &offset, bool commit) {
-  uint32_t sign = SIGNATURE;
-
-  _log->println(F("Writing config to EEPROM"));
-  if ((! writeEEPROM(offset, (uint8_t*)&sign, sizeof(sign))) || (! writeEEPROM(offset, (uint8_t*)&_apMode, sizeof(_apMode))) ||
-    (! writeEEPROM(offset, (uint8_t*)_ssid, sizeof(_ssid))) || (! writeEEPROM(offset, (uint8_t*)_password, sizeof(_password))) ||
-    (! writeEEPROM(offset, (uint8_t*)_domain, sizeof(_domain))) || (! writeEEPROM(offset, (uint8_t*)_userName, sizeof(_userName))) ||
-    (! writeEEPROM(offset, (uint8_t*)_userPassword, sizeof(_userPassword))) || (! writeEEPROM(offset, (uint8_t*)_adminName, sizeof(_adminName))) ||
-    (! writeEEPROM(offset, (uint8_t*)_adminPassword, sizeof(_adminPassword))) || (! writeEEPROM(offset, (uint8_t*)_ntpServer1, sizeof(_ntpServer1))) ||
-    (! writeEEPROM(offset, (uint8_t*)_ntpServer2, sizeof(_ntpServer2))) || (! writeEEPROM(offset, (uint8_t*)_ntpServer3, sizeof(_ntpServer3))) ||
-    (! writeEEPROM(offset, (uint8_t*)&_ntpTimeZone, sizeof(_ntpTimeZone))) || (! writeEEPROM(offset, (uint8_t*)&_ntpUpdateInterval, sizeof(_ntpUpdateInterval)))) {
-    _log->println(F("Error writing to EEPROM!"));
+bool ESPWebBase::readConfig() {
+  _log->println(F("Reading config"));
+  defaultConfig(); // Параметры, отсутствующие в журнале, остаются со значениями по умолчанию
+  if (! _config->count()) {
+    _log->println(F("Config journal is empty!"));
     return false;
   }
+  getConfig(FPSTR(paramApMode), _apMode);
+  getConfigStr(FPSTR(paramSSID), _ssid, sizeof(_ssid));
+  getConfigStr(FPSTR(paramPassword), _password, sizeof(_password));
+  getConfigStr(FPSTR(paramDomain), _domain, sizeof(_domain));
+  getConfigStr(FPSTR(paramUserName), _userName, sizeof(_userName));
+  getConfigStr(FPSTR(paramUserPassword), _userPassword, sizeof(_userPassword));
+  getConfigStr(FPSTR(paramAdminName), _adminName, sizeof(_adminName));
+  getConfigStr(FPSTR(paramAdminPassword), _adminPassword, sizeof(_adminPassword));
+  getConfigStr(FPSTR(paramNtpServer1), _ntpServer1, sizeof(_ntpServer1));
+  getConfigStr(FPSTR(paramNtpServer2), _ntpServer2, sizeof(_ntpServer2));
+  getConfigStr(FPSTR(paramNtpServer3), _ntpServer3, sizeof(_ntpServer3));
+  getConfig(FPSTR(paramNtpTimeZone), _ntpTimeZone);
+  getConfig(FPSTR(paramNtpUpdateInterval), _ntpUpdateInterval);
 
-  uint8_t crc = crc8EEPROM(0, offset);
-  if (! writeEEPROM(offset, crc)) {
-    _log->println(F("Error writing CRC!"));
+  return true;
+}
+
+bool ESPWebBase::writeConfig(bool commit) {
+  _log->println(F("Writing config"));
+  if ((! putConfig(FPSTR(paramApMode), _apMode)) || (! putConfigStr(FPSTR(paramSSID), _ssid)) ||
+    (! putConfigStr(FPSTR(paramPassword), _password)) || (! putConfigStr(FPSTR(paramDomain), _domain)) ||
+    (! putConfigStr(FPSTR(paramUserName), _userName)) || (! putConfigStr(FPSTR(paramUserPassword), _userPassword)) ||
+    (! putConfigStr(FPSTR(paramAdminName), _adminName)) || (! putConfigStr(FPSTR(paramAdminPassword), _adminPassword)) ||
+    (! putConfigStr(FPSTR(paramNtpServer1), _ntpServer1)) || (! putConfigStr(FPSTR(paramNtpServer2), _ntpServer2)) ||
+    (! putConfigStr(FPSTR(paramNtpServer3), _ntpServer3)) || (! putConfig(FPSTR(paramNtpTimeZone), _ntpTimeZone)) ||
+    (! putConfig(FPSTR(paramNtpUpdateInterval), _ntpUpdateInterval))) {
+    _log->println(F("Error writing config!"));
     return false;
   }
   if (commit)
-    commitConfig();
+    return commitConfig();
 
   return true;
 }
 
-inline void ESPWebBase::commitConfig() {
-  commitEEPROM();
+bool ESPWebBase::commitConfig() {
+  if (! _config->commit()) {
+    _log->println(F("Error writing config journal!"));
+    return false;
+  }
+
+  return true;
+}
+
+bool ESPWebBase::prepareRestore() {
+  return true;
+}
+
+bool ESPWebBase::commitRestore() {
+  return _config->compact(); // Журнал целиком заменяется через временный файл
+}
+
+void ESPWebBase::abortRestore() {
+  _config->reset();
+  _config->begin();
+}
+
+bool ESPWebBase::restoreBackup() {
+  String fileName = FPSTR(restoreFileName);
+  File file = SPIFFS.open(fileName, "r");
+  uint8_t data[sizeof(uint32_t) + 1];
+  uint16_t crc;
+
+  if (! file)
+    return false;
+
+  uint32_t size = file.size();
+
+  if (size < sizeof(data) + 1 + sizeof(uint16_t)) {
+    file.close();
+    _log->println(F("Backup archive is too short!"));
+    return false;
+  }
+  { // Первый проход: архив применяется только при совпадении CRC
+    BufferedFile in(file);
+
+    if (! in.skip(size - sizeof(uint16_t))) {
+      file.close();
+      return false;
+    }
+    crc = in.crc();
+    if ((! in.read(data, sizeof(uint16_t))) || (crc != (data[0] | (data[1] << 8)))) {
+      file.close();
+      _log->println(F("Backup archive CRC mismatch!"));
+      return false;
+    }
+  }
+  file.close();
+
+  file = SPIFFS.open(fileName, "r");
+  if (! file)
+    return false;
+
+  BufferedFile in(file);
+  bool result;
+
+  if (! readBackupHeader(in)) {
+    file.close();
+    _log->println(F("Illegal backup archive signature!"));
+    return false;
+  }
+  result = readBackupSections(in);
+  file.close();
+  if (! result) {
+    _log->println(F("Error parsing backup archive!"));
+    abortRestore();
+    return false;
+  }
+  configChanged();
+  if ((! prepareRestore()) || (! commitRestore())) {
+    _log->println(F("Error storing restored config!"));
+    abortRestore();
+    return false;
+  }
+
+  return true;
+}
+
+bool ESPWebBase::getConfigStr(const String &key, char *str, uint16_t size) {
+  char *buf = (char*)malloc(size);
+
+  if (! buf)
+    return false;
+  memset(buf, 0, size);
+
+  bool result = _config->get(key, buf, size - 1);
+
+  if (result)
+    memcpy(str, buf, size);
+  free(buf);
+
+  return result;
+}
+
+bool ESPWebBase::putConfigStr(const String &key, const char *str) {
+  return _config->put(key, str, strlen(str));
 }
 
 void ESPWebBase::defaultConfig(uint8_t level) {
@@ -392,10 +564,6 @@ bool ESPWebBase::setConfigParam(const String &name, const String &value) {
 }
 
 bool ESPWebBase::setupWiFiAsStation() {
-  const uint32_t timeout = 60000; // 1 min.
-
-  uint32_t maxTime = millis() + timeout;
-
   if (! *_ssid) {
     _log->println(F("Empty SSID!"));
     return false;
@@ -403,32 +571,125 @@ bool ESPWebBase::setupWiFiAsStation() {
 
   _log->print(F("Connecting to \""));
   _log->print(_ssid);
-  _log->print(charQuote);
+  _log->println(charQuote);
 
 #ifdef LED_PIN
   enablePulse(PULSE);
 #endif
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(_ssid, _password);
+  _wifiStart = millis();
+  if (_wifiState == WIFI_SOFTAP) { // Точка доступа продолжает работать во время попытки подключения
+    WiFi.mode(WIFI_AP_STA);
+    WiFi.begin(_ssid, _password);
+    _wifiState = WIFI_SOFTAPRETRY;
+    _wifiTime = _wifiStart + WIFI_RETRY_TIMEOUT;
+    return true;
+  }
 
-  while (WiFi.status() != WL_CONNECTED) {
-    _log->print(charDot);
-    delay(500);
-    if ((int32_t)(millis() - maxTime) >= 0) {
-      _log->println(F("FAIL!"));
-#ifdef LED_PIN
-      disablePulse();
-#endif
-      return false;
-    }
+  WiFi.mode(WIFI_STA);
+  if (_rtcState.channel && (_rtcState.ssidCrc == crc16((const uint8_t*)_ssid, strlen(_ssid)))) { // Подключение без сканирования каналов (адрес по-прежнему выдает DHCP)
+    WiFi.begin(_ssid, _password, _rtcState.channel, _rtcState.bssid);
+    _wifiState = WIFI_FASTCONNECT;
+    _wifiTime = _wifiStart + FAST_CONNECT_TIMEOUT;
+  } else {
+    WiFi.begin(_ssid, _password);
+    _wifiState = WIFI_CONNECT;
+    _wifiTime = _wifiStart + WIFI_CONNECT_TIMEOUT;
   }
-  _log->println(WiFi.localIP());
+
+  return true;
+}
+
+void ESPWebBase::onStationConnected() {
+  if (_wifiState == WIFI_SOFTAPRETRY)
+    WiFi.mode(WIFI_STA);
+  _wifiState = WIFI_ONLINE;
+  _wifiBackoff = WIFI_RETRY_MIN;
+  if (! _connectedTime)
+    _connectedTime = millis();
+  _log->print(F("Connected to \""));
+  _log->print(_ssid);
+  _log->print(F("\" with IP address "));
+  _log->print(WiFi.localIP());
+  _log->print(F(" in "));
+  _log->print(millis() - _wifiStart);
+  _log->println(F(" ms"));
+
+  _rtcState.ssidCrc = crc16((const uint8_t*)_ssid, strlen(_ssid));
+  memcpy(_rtcState.bssid, WiFi.BSSID(), sizeof(_rtcState.bssid));
+  _rtcState.channel = WiFi.channel();
+  startMDNS();
 #ifdef LED_PIN
   enablePulse(BREATH);
 #endif
+}
 
-  return true;
+void ESPWebBase::loopWiFi() {
+  bool connected = (WiFi.status() == WL_CONNECTED);
+  bool timeout = ((int32_t)(millis() - _wifiTime) >= 0);
+
+  switch (_wifiState) {
+    case WIFI_FASTCONNECT:
+      if (connected) {
+        onStationConnected();
+      } else if (timeout) {
+        _log->println(F("Fast connect failed!"));
+        _rtcState.channel = 0;
+        WiFi.disconnect();
+        WiFi.begin(_ssid, _password);
+        _wifiState = WIFI_CONNECT;
+        _wifiTime = millis() + WIFI_CONNECT_TIMEOUT;
+      }
+      break;
+    case WIFI_CONNECT:
+      if (connected) {
+        onStationConnected();
+      } else if (timeout) {
+        _log->println(F("Unable to connect to WiFi network!"));
+#ifdef LED_PIN
+        disablePulse();
+#endif
+        setupWiFiAsAP();
+      }
+      break;
+    case WIFI_ONLINE:
+      if (! connected) { // Переподключение выполняет SDK, по таймауту переходим в режим точки доступа
+        _log->println(F("WiFi connection lost!"));
+#ifdef LED_PIN
+        enablePulse(PULSE);
+#endif
+        _wifiState = WIFI_CONNECT;
+        _wifiStart = millis();
+        _wifiTime = _wifiStart + WIFI_CONNECT_TIMEOUT;
+      }
+      break;
+    case WIFI_SOFTAP:
+      if ((! _apMode) && *_ssid && timeout)
+        setupWiFiAsStation();
+      break;
+    case WIFI_SOFTAPRETRY:
+      if (connected) {
+        onStationConnected();
+      } else if (timeout) {
+        WiFi.disconnect();
+        WiFi.mode(WIFI_AP);
+        _wifiState = WIFI_SOFTAP;
+        _wifiTime = millis() + _wifiBackoff;
+        _log->print(F("Next connection attempt in "));
+        _log->print(_wifiBackoff / 1000);
+        _log->println(F(" sec."));
+        if (_wifiBackoff < WIFI_RETRY_MAX / 2)
+          _wifiBackoff *= 2;
+        else
+          _wifiBackoff = WIFI_RETRY_MAX;
+#ifdef LED_PIN
+        enablePulse(FADEIN);
+#endif
+      }
+      break;
+    default:
+      break;
+  }
 }
 
 void ESPWebBase::setupWiFiAsAP() {
@@ -445,6 +706,8 @@ void ESPWebBase::setupWiFiAsAP() {
   WiFi.mode(WIFI_AP);
 //  WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
   WiFi.softAP(ssid.c_str(), password.c_str());
+  _wifiState = WIFI_SOFTAP;
+  _wifiTime = millis() + _wifiBackoff; // Повторная попытка подключения к сети (если не задан режим точки доступа)
 
   _log->print(F("Configuring access point \""));
   _log->print(ssid);
@@ -452,6 +715,7 @@ void ESPWebBase::setupWiFiAsAP() {
   _log->print(password);
   _log->print(F("\" on IP address "));
   _log->println(WiFi.softAPIP());
+  startMDNS();
 
 #ifdef LED_PIN
   enablePulse(FADEIN);
@@ -462,18 +726,24 @@ void ESPWebBase::setupWiFi() {
   if (_apMode || (! setupWiFiAsStation()))
     setupWiFiAsAP();
 
-  if (*_domain) {
-    if (MDNS.begin(_domain)) {
-      MDNS.addService("http", "tcp", 80);
-      _log->println(F("mDNS responder started"));
-    } else {
-      _log->println(F("Error setting up mDNS responder!"));
-    }
-  }
-
   onWiFiConnected();
 }
 
+void ESPWebBase::startMDNS() {
+  if (! *_domain)
+    return;
+
+  if (_mdnsStarted) {
+    MDNS.notifyAPChange();
+  } else if (MDNS.begin(_domain)) {
+    MDNS.addService("http", "tcp", 80);
+    _mdnsStarted = true;
+    _log->println(F("mDNS responder started"));
+  } else {
+    _log->println(F("Error setting up mDNS responder!"));
+  }
+}
+
 void ESPWebBase::onWiFiConnected() {
   httpServer->begin();
   _log->println(F("HTTP server started"));
@@ -490,21 +760,30 @@ bool ESPWebBase::userAuthenticate() {
 }
 
 bool ESPWebBase::adminAuthenticate() {
-  if (*_adminName && *_adminPassword) {
-    if (! httpServer->authenticate(_adminName, _adminPassword)) {
-      httpServer->requestAuthentication();
-      return false;
-    }
+  if (! adminAuthorized()) {
+    httpServer->requestAuthentication();
+    return false;
   }
   return true;
 }
 
+bool ESPWebBase::adminAuthorized() {
+  return (! *_adminName) || (! *_adminPassword) || httpServer->authenticate(_adminName, _adminPassword);
+}
+
+bool ESPWebBase::protectedFile(const String &fileName) {
+  return fileName.equals(FPSTR(configJournalFile)) || fileName.equals(FPSTR(configJournalTemp)) || fileName.equals(FPSTR(restoreFileName)); // Журнал и архив содержат пароли
+}
+
 uint32_t ESPWebBase::getTime() {
-  if ((WiFi.getMode() == WIFI_STA) && (*_ntpServer1 || *_ntpServer2 || *_ntpServer3) && ((! _lastNtpTime) || (_ntpUpdateInterval && (millis() - _lastNtpUpdate >= _ntpUpdateInterval)))) {
+  if ((WiFi.getMode() == WIFI_STA) && (*_ntpServer1 || *_ntpServer2 || *_ntpServer3) && ((! _lastNtpTime) || _timeRestored || (_ntpUpdateInterval && (millis() - _lastNtpUpdate >= _ntpUpdateInterval)))) {
     uint32_t now = sntp_get_current_timestamp();
     if (now > 1483228800UL) { // 01.01.2017 0:00:00
       _lastNtpTime = now;
       _lastNtpUpdate = millis();
+      _timeRestored = false;
+      if (! _timeValidTime)
+        _timeValidTime = _lastNtpUpdate;
       logDateTime(now);
       _log->println(F(" time updated successfully"));
     } else {
@@ -526,6 +805,9 @@ uint32_t ESPWebBase::getTime() {
 void ESPWebBase::setTime(uint32_t now) {
   _lastNtpTime = now;
   _lastNtpUpdate = millis();
+  _timeRestored = false;
+  if (! _timeValidTime)
+    _timeValidTime = _lastNtpUpdate;
   logDateTime(now);
   _log->println(F(" time updated manualy"));
 }
@@ -558,27 +840,39 @@ void ESPWebBase::logTimeDate(uint32_t now) {
     _log->print(timeDateToStr(now));
 }
 
+const httproute_t ESPWebBase::httpRoutes[] PROGMEM = {
+  { pathStdCss, HTTP_GET, &ESPWebBase::handleStdCss, NULL },
+  { pathStdJs, HTTP_GET, &ESPWebBase::handleStdJs, NULL },
+  { pathRoot, HTTP_GET, &ESPWebBase::handleRootPage, NULL },
+  { pathIndex, HTTP_GET, &ESPWebBase::handleRootPage, NULL },
+  { pathSPIFFS, HTTP_GET, &ESPWebBase::handleSPIFFS, NULL },
+  { pathSPIFFS, HTTP_POST, &ESPWebBase::handleFileUploaded, &ESPWebBase::handleFileUpload },
+  { pathSPIFFS, HTTP_DELETE, &ESPWebBase::handleFileDelete, NULL },
+  { pathUpdate, HTTP_GET, &ESPWebBase::handleUpdate, NULL },
+  { pathUpdate, HTTP_POST, &ESPWebBase::handleSketchUpdated, &ESPWebBase::handleSketchUpdate },
+  { pathWiFi, HTTP_GET, &ESPWebBase::handleWiFiConfig, NULL },
+  { pathTime, HTTP_GET, &ESPWebBase::handleTimeConfig, NULL },
+  { pathStore, HTTP_GET, &ESPWebBase::handleStoreConfig, NULL },
+  { pathStore, HTTP_POST, &ESPWebBase::handleStoreConfig, NULL },
+  { pathLog, HTTP_GET, &ESPWebBase::handleLog, NULL },
+  { pathClearLog, HTTP_GET, &ESPWebBase::handleClearLog, NULL },
+  { pathGetTime, HTTP_GET, &ESPWebBase::handleGetTime, NULL },
+  { pathSetTime, HTTP_GET, &ESPWebBase::handleSetTime, NULL },
+  { pathReboot, HTTP_GET, &ESPWebBase::handleReboot, NULL },
+  { pathData, HTTP_GET, &ESPWebBase::handleData, NULL },
+  { pathRoutes, HTTP_GET, &ESPWebBase::handleRoutes, NULL },
+  { pathBackup, HTTP_GET, &ESPWebBase::handleBackup, NULL },
+  { pathRestore, HTTP_GET, &ESPWebBase::handleRestore, NULL },
+  { pathRestore, HTTP_POST, &ESPWebBase::handleRestored, &ESPWebBase::handleRestoreUpload }
+};
+
 void ESPWebBase::setupHttpServer() {
+  static const char *headerKeys[] = { "If-None-Match" }; // Нельзя передавать PROGMEM-строку как const char*
+
+  httpServer->collectHeaders(headerKeys, sizeof(headerKeys) / sizeof(headerKeys[0]));
   httpServer->onNotFound(std::bind(&ESPWebBase::handleNotFound, this));
-  httpServer->on(String(FPSTR(pathStdCss)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleStdCss, this));
-  httpServer->on(String(FPSTR(pathStdJs)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleStdJs, this));
-  httpServer->on(strSlash, HTTP_GET, std::bind(&ESPWebBase::handleRootPage, this));
-  httpServer->on(String(String(charSlash) + FPSTR(indexHtml)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleRootPage, this));
-  httpServer->on(String(FPSTR(pathSPIFFS)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleSPIFFS, this));
-  httpServer->on(String(FPSTR(pathSPIFFS)).c_str(), HTTP_POST, std::bind(&ESPWebBase::handleFileUploaded, this), std::bind(&ESPWebBase::handleFileUpload, this));
-  httpServer->on(String(FPSTR(pathSPIFFS)).c_str(), HTTP_DELETE, std::bind(&ESPWebBase::handleFileDelete, this));
-  httpServer->on(String(FPSTR(pathUpdate)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleUpdate, this));
-  httpServer->on(String(FPSTR(pathUpdate)).c_str(), HTTP_POST, std::bind(&ESPWebBase::handleSketchUpdated, this), std::bind(&ESPWebBase::handleSketchUpdate, this));
-  httpServer->on(String(FPSTR(pathWiFi)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleWiFiConfig, this));
-  httpServer->on(String(FPSTR(pathTime)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleTimeConfig, this));
-  httpServer->on(String(FPSTR(pathStore)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleStoreConfig, this));
-  httpServer->on(String(FPSTR(pathStore)).c_str(), HTTP_POST, std::bind(&ESPWebBase::handleStoreConfig, this));
-  httpServer->on(String(FPSTR(pathLog)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleLog, this));
-  httpServer->on(String(FPSTR(pathClearLog)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleClearLog, this));
-  httpServer->on(String(FPSTR(pathGetTime)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleGetTime, this));
-  httpServer->on(String(FPSTR(pathSetTime)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleSetTime, this));
-  httpServer->on(String(FPSTR(pathReboot)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleReboot, this));
-  httpServer->on(String(FPSTR(pathData)).c_str(), HTTP_GET, std::bind(&ESPWebBase::handleData, this));
+  httpServer->addHandler(_router);
+  _router->add(httpRoutes, sizeof(httpRoutes) / sizeof(httpRoutes[0]));
 }
 
 void ESPWebBase::handleStdCss() {
@@ -681,6 +975,9 @@ Uptime: <span id=\"");
 }
 
 void ESPWebBase::handleFileUploaded() {
+  if (! adminAuthenticate())
+    return;
+
   httpServer->send(200, FPSTR(textHtml), F("<META http-equiv=\"refresh\" content=\"2;URL=\">Upload successful."));
 }
 
@@ -694,6 +991,12 @@ void ESPWebBase::handleFileUpload() {
     String filename = upload.filename;
     if (! filename.startsWith(strSlash))
       filename = charSlash + filename;
+    if ((! adminAuthorized()) || protectedFile(filename)) { // Ответ отправит handleFileUploaded()
+      _log->print(F("Upload of \""));
+      _log->print(filename);
+      _log->println(F("\" denied!"));
+      return;
+    }
     uploadFile = SPIFFS.open(filename, "w");
     filename = String();
   } else if (upload.status == UPLOAD_FILE_WRITE) {
@@ -702,18 +1005,25 @@ void ESPWebBase::handleFileUpload() {
   } else if (upload.status == UPLOAD_FILE_END) {
     if (uploadFile)
       uploadFile.close();
+    _files->invalidate();
   }
 }
 
 void ESPWebBase::handleFileDelete() {
+  if (! adminAuthenticate())
+    return;
+
   if (httpServer->args() == 0)
     return httpServer->send(500, FPSTR(textPlain), F("BAD ARGS"));
   String path = httpServer->arg(0);
   if (path == strSlash)
     return httpServer->send(500, FPSTR(textPlain), F("BAD PATH"));
+  if (protectedFile(path))
+    return httpServer->send(403, FPSTR(textPlain), F("ACCESS DENIED"));
   if (! SPIFFS.exists(path))
     return httpServer->send(404, FPSTR(textPlain), FPSTR(fileNotFound));
   SPIFFS.remove(path);
+  _files->invalidate();
   httpServer->send(200, FPSTR(textPlain), strEmpty);
   path = String();
 }
@@ -768,9 +1078,11 @@ location.reload(true);\n\
   Dir dir = SPIFFS.openDir("/");
   int cnt = 0;
   while (dir.next()) {
-    cnt++;
     String fileName = dir.fileName();
     size_t fileSize = dir.fileSize();
+    if (protectedFile(fileName))
+      continue;
+    cnt++;
     if (fileName.startsWith(strSlash))
       fileName = fileName.substring(1);
     page += F("<input type=\"checkbox\" name=\"file");
@@ -878,6 +1190,96 @@ void ESPWebBase::handleSketchUpdate() {
   yield();
 }
 
+void ESPWebBase::handleBackup() {
+  if (! adminAuthenticate())
+    return;
+
+  WiFiClient client = httpServer->client();
+  BackupWriter out(client);
+
+  httpServer->sendHeader(F("Content-Disposition"), F("attachment; filename=\"backup.bin\""));
+  httpServer->setContentLength(BACKUP_HEADER + backupSize() + 1 + sizeof(uint16_t)); // Заголовок, секции, BACKUP_END и CRC
+  httpServer->send(200, FPSTR(applicationOctetStream), strEmpty);
+  if ((! writeBackupHeader(out)) || (! writeBackup(out)) || (out.write(BACKUP_END) != 1) || (! out.end()))
+    _log->println(F("Error sending backup archive!"));
+}
+
+void ESPWebBase::handleRestore() {
+  if (! adminAuthenticate())
+    return;
+
+  String page = ESPWebBase::webPageStart(F("Backup & Restore"));
+  page += ESPWebBase::webPageStdStyle();
+  page += ESPWebBase::webPageBody();
+  page += F("<form method=\"POST\" action=\"\" enctype=\"multipart/form-data\" onsubmit=\"if (document.getElementsByName('restore')[0].files.length == 0) { alert('No file to restore!'); return false; }\">\n\
+<h3>Backup & Restore</h3>\n\
+<p>\n\
+<a href=\"");
+  page += FPSTR(pathBackup);
+  page += F("\">Download backup</a>\n\
+<p>\n\
+Select backup file to restore:<br/>\n");
+  page += ESPWebBase::tagInput(FPSTR(typeFile), F("restore"), strEmpty);
+  page += charLF;
+  page += ESPWebBase::tagInput(FPSTR(typeSubmit), strEmpty, F("Restore"));
+  page += charLF;
+  page += btnBack();
+  page += F("\n\
+</form>\n");
+  page += ESPWebBase::webPageEnd();
+
+  httpServer->send(200, FPSTR(textHtml), page);
+}
+
+void ESPWebBase::handleRestored() {
+  static const char restoreFailed[] PROGMEM = "<META http-equiv=\"refresh\" content=\"5;URL=\">Restore failed!";
+  static const char restoreSuccess[] PROGMEM = "<META http-equiv=\"refresh\" content=\"15;URL=/\">Restore successful! Rebooting...";
+
+  if (! adminAuthenticate()) {
+    SPIFFS.remove(FPSTR(restoreFileName));
+    return;
+  }
+
+  bool success = restoreBackup();
+
+  SPIFFS.remove(FPSTR(restoreFileName));
+  _files->invalidate();
+  httpServer->send(200, FPSTR(textHtml), success ? FPSTR(restoreSuccess) : FPSTR(restoreFailed));
+  if (success) {
+    _log->println(F("Config restored from backup. Rebooting..."));
+    delay(500);
+    reboot();
+  }
+}
+
+void ESPWebBase::handleRestoreUpload() {
+  static File uploadFile;
+
+  HTTPUpload& upload = httpServer->upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    if (! adminAuthorized()) { // Ответ с запросом авторизации отправит handleRestored()
+      _log->println(F("Backup archive upload denied!"));
+      return;
+    }
+    uploadFile = SPIFFS.open(FPSTR(restoreFileName), "w");
+    if (! uploadFile)
+      _log->println(F("Error creating backup archive file!"));
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (uploadFile && (uploadFile.write(upload.buf, upload.currentSize) != upload.currentSize)) { // Недописанный архив не пройдет проверку CRC
+      uploadFile.close();
+      _log->println(F("Error writing backup archive file!"));
+    }
+  } else if (upload.status == UPLOAD_FILE_END) {
+    if (uploadFile)
+      uploadFile.close();
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    if (uploadFile)
+      uploadFile.close();
+    SPIFFS.remove(FPSTR(restoreFileName));
+  }
+  yield();
+}
+
 void ESPWebBase::handleWiFiConfig() {
   if (! adminAuthenticate())
     return;
@@ -1120,11 +1522,11 @@ void ESPWebBase::handleStoreConfig() {
     argValue = httpServer->arg(i);
     setConfigParam(argName, argValue);
   }
+  configChanged();
 
-  uint16_t offset = 0;
   bool success;
 
-  success = writeConfig(offset);
+  success = writeConfig();
 
   String page = ESPWebBase::webPageStart(F("Store Setup"));
   page += F("<meta http-equiv=\"refresh\" content=\"5;URL=/\">\n");
@@ -1243,6 +1645,45 @@ void ESPWebBase::handleData() {
   httpServer->send(200, FPSTR(textJson), page);
 }
 
+void ESPWebBase::handleRoutes() {
+  static const char methods[][8] PROGMEM = { "ANY", "GET", "POST", "PUT", "PATCH", "DELETE", "OPTIONS" };
+
+  String page;
+
+  page += '[';
+  for (uint8_t i = 0; i < _router->count(); ++i) {
+    httproute_t route;
+
+    _router->route(i, route);
+    if (i)
+      page += ',';
+    page += F("{\"path\":\"");
+    page += FPSTR(route.path);
+    page += F("\",\"method\":\"");
+    if (route.method < sizeof(methods) / sizeof(methods[0]))
+      page += FPSTR(methods[route.method]);
+    page += F("\",\"hits\":");
+    page += String(_router->hits(i));
+    page += F(",\"time\":");
+    page += String(_router->time(i));
+    page += '}';
+  }
+  page += ']';
+
+  httpServer->send(200, FPSTR(textJson), page);
+}
+
+bool ESPWebBase::checkETag(const String &etag) {
+  httpServer->sendHeader(F("Cache-Control"), F("no-cache"));
+  httpServer->sendHeader(FPSTR(headerETag), etag);
+  if (httpServer->header(FPSTR(headerIfNoneMatch)) == etag) {
+    httpServer->send(304);
+    return true;
+  }
+
+  return false;
+}
+
 String ESPWebBase::jsonData() {
   String result;
 
@@ -1254,6 +1695,30 @@ String ESPWebBase::jsonData() {
   result += FPSTR(jsonUptime);
   result += F("\":");
   result += String(millis() / 1000);
+  result += F(",\"");
+  result += FPSTR(jsonConfigAppends);
+  result += F("\":");
+  result += String(_config->appends());
+  result += F(",\"");
+  result += FPSTR(jsonConfigSkips);
+  result += F("\":");
+  result += String(_config->skips());
+  result += F(",\"");
+  result += FPSTR(jsonConfigCompactions);
+  result += F("\":");
+  result += String(_config->compactions());
+  result += F(",\"");
+  result += FPSTR(jsonRTCFlushes);
+  result += F("\":");
+  result += String(RTCmem.flushes());
+  result += F(",\"");
+  result += FPSTR(jsonTimeValid);
+  result += F("\":");
+  result += String(_timeValidTime);
+  result += F(",\"");
+  result += FPSTR(jsonConnected);
+  result += F("\":");
+  result += String(_connectedTime);
   if (WiFi.getMode() == WIFI_STA) {
     result += F(",\"");
     result += FPSTR(jsonRSSI);
@@ -1311,50 +1776,63 @@ String ESPWebBase::navigator() {
 
 String ESPWebBase::getContentType(const String &fileName) {
   if (httpServer->hasArg(F("download")))
-    return String(F("application/octet-stream"));
-  else if (fileName.endsWith(F(".htm")) || fileName.endsWith(F(".html")))
-    return String(FPSTR(textHtml));
-  else if (fileName.endsWith(F(".css")))
-    return String(FPSTR(textCss));
-  else if (fileName.endsWith(F(".js")))
-    return String(FPSTR(applicationJavascript));
-  else if (fileName.endsWith(F(".png")))
-    return String(F("image/png"));
-  else if (fileName.endsWith(F(".gif")))
-    return String(F("image/gif"));
-  else if (fileName.endsWith(F(".jpg")) || fileName.endsWith(F(".jpeg")))
-    return String(F("image/jpeg"));
-  else if (fileName.endsWith(F(".ico")))
-    return String(F("image/x-icon"));
-  else if (fileName.endsWith(F(".xml")))
-    return String(F("text/xml"));
-  else if (fileName.endsWith(F(".pdf")))
-    return String(F("application/x-pdf"));
-  else if (fileName.endsWith(F(".zip")))
-    return String(F("application/x-zip"));
-  else if (fileName.endsWith(F(".gz")))
-    return String(F("application/x-gzip"));
-
-  return String(FPSTR(textPlain));
+    return String(FPSTR(applicationOctetStream));
+
+  return contentTypeStr(contentTypeIndex(fileName));
+}
+
+uint8_t ESPWebBase::contentTypeIndex(const String &fileName) {
+  for (uint8_t i = 1; i < sizeof(contentTypes) / sizeof(contentTypes[0]); ++i) {
+    if (fileName.endsWith(FPSTR(contentTypes[i].ext)))
+      return i;
+  }
+
+  return 0;
+}
+
+String ESPWebBase::contentTypeStr(uint8_t index) {
+  if (index >= sizeof(contentTypes) / sizeof(contentTypes[0]))
+    index = 0;
+
+  return String(FPSTR(contentTypes[index].type));
 }
 
 bool ESPWebBase::handleFileRead(const String &path) {
   String fileName = path;
   if (fileName.endsWith(strSlash))
     fileName += FPSTR(indexHtml);
-  String contentType = getContentType(fileName);
-  String pathWithGz = fileName + F(".gz");
-  if (SPIFFS.exists(pathWithGz) || SPIFFS.exists(fileName)) {
-    if (SPIFFS.exists(pathWithGz))
-      fileName = pathWithGz;
-    File file = SPIFFS.open(fileName, "r");
-    size_t sent = httpServer->streamFile(file, contentType);
-    file.close();
 
+  if (protectedFile(fileName))
+    return false;
+
+  const FileIndex::entry_t *entry = _files->find(fileName);
+  if (! entry)
+    return false;
+
+  String etag = String(charQuote) + String(entry->etag, HEX) + String(charQuote);
+  if (httpServer->header(FPSTR(headerIfNoneMatch)) == etag) {
+    httpServer->sendHeader(FPSTR(headerETag), etag);
+    httpServer->send(304);
     return true;
   }
 
-  return false;
+  String contentType;
+  if (httpServer->hasArg(F("download")))
+    contentType = FPSTR(applicationOctetStream);
+  else
+    contentType = contentTypeStr(entry->type);
+  if (entry->gzip)
+    fileName += F(".gz");
+  File file = SPIFFS.open(fileName, "r");
+  if (! file) { // Файл изменился в обход индекса
+    _files->invalidate();
+    return false;
+  }
+  httpServer->sendHeader(FPSTR(headerETag), etag);
+  httpServer->streamFile(file, contentType);
+  file.close();
+
+  return true;
 }
 
 String ESPWebBase::webPageStart(const String &title) {
@@ -1439,6 +1917,27 @@ String ESPWebBase::escapeQuote(const String &str) {
   return result;
 }
 
+String ESPWebBase::escapeJson(const char *str) {
+  String result;
+
+  result.reserve(strlen(str));
+  for (; *str; ++str) {
+    if ((*str == charQuote) || (*str == charBackslash)) {
+      result += charBackslash;
+      result += *str;
+    } else if ((uint8_t)*str < 0x20) { // \u00XX
+      static const char hexDigits[] PROGMEM = "0123456789ABCDEF";
+
+      result += F("\\u00");
+      result += (char)pgm_read_byte(&hexDigits[*str >> 4]);
+      result += (char)pgm_read_byte(&hexDigits[*str & 0x0F]);
+    } else
+      result += *str;
+  }
+
+  return result;
+}
+
 String ESPWebBase::tagInput(const String &type, const String &name, const String &value, int16_t size, int16_t maxlength) {
   String result = FPSTR(inputTypeOpen);
 
@@ -1538,4 +2037,4 @@ void ESPWebBase::pulseLed() {
     }
   }
 }
-#endif
+#endif
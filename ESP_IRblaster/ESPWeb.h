@@ -5,6 +5,13 @@
 #include <ESP8266WebServer.h>
 #include <Ticker.h>
 #include "StringLog.h"
+#include "FileIndex.h"
+#include "PageCache.h"
+#include "HttpRouter.h"
+#include "ConfigJournal.h"
+#include "BufferedFile.h"
+#include "ConfigBackup.h"
+#include "EEPROMCache.h"
 
 // Односимвольные константы
 const char charCR = '\r';
@@ -17,6 +24,7 @@ const char charComma = ',';
 const char charColon = ':';
 const char charSemicolon = ';';
 const char charQuote = '"';
+const char charBackslash = '\\';
 const char charApostroph = '\'';
 const char charOpenBrace = '{';
 const char charCloseBrace = '}';
@@ -35,6 +43,12 @@ const char defAdminPassword[] PROGMEM = "12345678"; // Пароль для ад
 const char defNtpServer[] PROGMEM = "pool.ntp.org"; // NTP-сервер по умолчанию
 const int8_t defNtpTimeZone = 3; // Временная зона по умолчанию (-11..13, +3 - Москва)
 const uint32_t defNtpUpdateInterval = 3600000; // Интервал в миллисекундах для обновления времени с NTP-серверов (по умолчанию 1 час)
+const uint32_t RTC_FLUSH_INTERVAL = 1000; // Интервал в миллисекундах для записи накопленных изменений RTC-памяти
+const uint32_t FAST_CONNECT_TIMEOUT = 5000; // Время в миллисекундах на подключение к сохраненной в RTC-памяти точке доступа
+const uint32_t WIFI_CONNECT_TIMEOUT = 60000; // Время в миллисекундах на подключение к сети до перехода в режим точки доступа
+const uint32_t WIFI_RETRY_TIMEOUT = 20000; // Время в миллисекундах на повторную попытку подключения из режима точки доступа
+const uint32_t WIFI_RETRY_MIN = 30000; // Начальный интервал в миллисекундах между повторными попытками (удваивается после каждой неудачи)
+const uint32_t WIFI_RETRY_MAX = 300000; // Максимальный интервал между повторными попытками (5 мин.)
 
 const char pathStdCss[] PROGMEM = "/std.css";
 const char pathStdJs[] PROGMEM = "/std.js";
@@ -49,6 +63,11 @@ const char pathClearLog[] PROGMEM = "/clearlog"; // Путь до страниц
 const char pathStore[] PROGMEM = "/store"; // Путь до страницы сохранения параметров
 const char pathReboot[] PROGMEM = "/reboot"; // Путь до страницы перезагрузки
 const char pathData[] PROGMEM = "/data"; // Путь до страницы получения JSON-пакета данных
+const char pathRoot[] PROGMEM = "/";
+const char pathIndex[] PROGMEM = "/index.html";
+const char pathRoutes[] PROGMEM = "/routes"; // Путь до страницы получения JSON-пакета статистики обработчиков страниц
+const char pathBackup[] PROGMEM = "/backup"; // Путь до страницы получения архива конфигурации
+const char pathRestore[] PROGMEM = "/restore"; // Путь до страницы восстановления конфигурации из архива
 
 const char textPlain[] PROGMEM = "text/plain";
 const char textHtml[] PROGMEM = "text/html";
@@ -56,6 +75,11 @@ const char textJson[] PROGMEM = "text/json";
 const char textCss[] PROGMEM = "text/css";
 const char applicationJavascript[] PROGMEM = "application/javascript";
 
+const char applicationOctetStream[] PROGMEM = "application/octet-stream";
+
+const char headerETag[] PROGMEM = "ETag";
+const char headerIfNoneMatch[] PROGMEM = "If-None-Match";
+
 const char fileNotFound[] PROGMEM = "FileNotFound";
 const char indexHtml[] PROGMEM = "index.html";
 
@@ -118,6 +142,12 @@ const char jsonUnixTime[] PROGMEM = "unixtime";
 const char jsonDate[] PROGMEM = "date";
 const char jsonTime[] PROGMEM = "time";
 const char jsonLog[] PROGMEM = "log";
+const char jsonConfigAppends[] PROGMEM = "cfgappends";
+const char jsonConfigSkips[] PROGMEM = "cfgskips";
+const char jsonConfigCompactions[] PROGMEM = "cfgcompacts";
+const char jsonRTCFlushes[] PROGMEM = "rtcflushes";
+const char jsonTimeValid[] PROGMEM = "timevalidms";
+const char jsonConnected[] PROGMEM = "connectms";
 
 const char bools[][6] PROGMEM = { "false", "true" };
 
@@ -142,7 +172,16 @@ const uint8_t MAX_STRING_LEN = 32; // Максимальная длина стр
 
 const uint32_t SIGNATURE = 0x50534523; // "#ESP"
 
-class ESPWebBase { // Базовый класс
+const char configJournalFile[] PROGMEM = "/config.jnl"; // Журнал конфигурационных параметров в SPIFFS
+const char configJournalTemp[] PROGMEM = "/config.tmp";
+const uint16_t CONFIG_JOURNAL_SIZE = 4096; // Размер журнала, при превышении которого он сжимается
+
+const char restoreFileName[] PROGMEM = "/restore.tmp"; // Загруженный архив конфигурации до его проверки и применения
+
+const uint8_t PAGE_CACHE_SLOTS = 4; // Количество кэшируемых фрагментов Web-страниц
+const uint16_t PAGE_CACHE_SIZE = 4096; // Максимальный суммарный размер кэшируемых фрагментов
+
+class ESPWebBase : public ConfigBackup { // Базовый класс
 public:
   ESPWebBase();
   virtual void setup(); // Метод должен быть вызван из функции setup() скетча
@@ -164,37 +203,66 @@ protected:
   virtual bool readRTCmemory(uint16_t &offset); // Чтение параметров из RTC-памяти ESP8266
   virtual bool writeRTCmemory(uint16_t &offset); // Запись параметров в RTC-память ESP8266
 
+  struct __attribute__((__packed__)) rtcstate_t { // Состояние, переживающее программную перезагрузку
+    uint32_t time; // Время в формате UNIX-time на момент записи (0, если неизвестно)
+    uint16_t ssidCrc; // CRC-16 имени сети, к которой относятся параметры подключения
+    uint8_t bssid[6]; // MAC-адрес точки доступа
+    uint8_t channel; // Канал точки доступа (0, если быстрое подключение невозможно)
+  };
+
   virtual uint8_t readEEPROM(uint16_t &offset); // Чтение одного байта из EEPROM
   virtual bool readEEPROM(uint16_t &offset, uint8_t *buf, uint16_t len); // Чтение буфера из EEPROM
   virtual bool writeEEPROM(uint16_t &offset, uint8_t data); // Запись одного байта в EEPROM
   virtual bool writeEEPROM(uint16_t &offset, const uint8_t *buf, uint16_t len); // Запись буфера в EEPROM
   virtual bool readEEPROMString(uint16_t &offset, String &str, uint16_t maxlen); // Чтение строкового параметра из EEPROM
   virtual bool writeEEPROMString(uint16_t &offset, const String &str, uint16_t maxlen); // Запись строкового параметра в EEPROM
-  template<typename T> T &getEEPROM(uint16_t &offset, T &t) { // Шаблон чтения переменной из EEPROM
-    readEEPROM(offset, (uint8_t*)&t, sizeof(T));
-    return t;
+  template<typename... Args> bool getEEPROM(uint16_t &offset, Args&... args) { // Шаблон последовательного чтения переменных (в том числе массивов) из EEPROM
+    return _eeprom.get(offset, args...);
   }
-  template<typename T> const T &putEEPROM(uint16_t &offset, const T &t) { // Шаблон записи переменной в EEPROM
-    writeEEPROM(offset, (const uint8_t*)&t, sizeof(T));
-    return t;
+  template<typename... Args> bool putEEPROM(uint16_t &offset, const Args&... args) { // Шаблон последовательной записи переменных (в том числе массивов) в EEPROM
+    return _eeprom.put(offset, args...);
   }
   virtual void commitEEPROM(); // Завершает запись в EEPROM
   virtual void clearEEPROM(); // Стирает конфигурацию в EEPROM
   virtual uint8_t crc8EEPROM(uint16_t start, uint16_t end); // Вычисление 8-ми битной контрольной суммы участка EEPROM
 
-  virtual bool readConfig(uint16_t &offset); // Чтение конфигурационных параметров из EEPROM
-  virtual bool writeConfig(uint16_t &offset, bool commit = true); // Запись конфигурационных параметров в EEPROM
-  virtual void commitConfig(); // Подтверждение сохранения EEPROM
+  virtual bool readEEPROMConfig(uint16_t &offset); // Чтение конфигурационных параметров из EEPROM в старом формате (для миграции)
+  virtual bool readConfig(); // Чтение конфигурационных параметров из журнала
+  virtual bool writeConfig(bool commit = true); // Запись конфигурационных параметров в журнал
+  virtual bool commitConfig(); // Подтверждение сохранения журнала
+  template<typename T> bool getConfig(const String &key, T &t) { // Шаблон чтения переменной из журнала (отсутствующий ключ оставляет значение по умолчанию)
+    return _config->get(key, &t, sizeof(T));
+  }
+  template<typename T> bool putConfig(const String &key, const T &t) { // Шаблон записи переменной в журнал
+    return _config->put(key, &t, sizeof(T));
+  }
+  bool getConfigStr(const String &key, char *str, uint16_t size); // Чтение строки в буфер размером size
+  bool putConfigStr(const String &key, const char *str); // Запись строки без завершающего нуля
   virtual void defaultConfig(uint8_t level = 0); // Установление параметров в значения по умолчанию
   virtual bool setConfigParam(const String &name, const String &value); // Присвоение значений параметрам по их имени
+  void configChanged() { // Отметка об изменении конфигурации (кэшированные фрагменты страниц становятся неактуальными)
+    ++_configGeneration;
+  }
+
+  virtual bool prepareRestore(); // Запись восстановленных данных во временные файлы (до замены журнала)
+  virtual bool commitRestore(); // Сохранение восстановленной из архива конфигурации
+  virtual void abortRestore(); // Возврат к сохраненной конфигурации после ошибки разбора архива
+  bool restoreBackup(); // Проверка CRC и применение загруженного архива
+
+  enum wifistate_t : uint8_t { WIFI_IDLE, WIFI_FASTCONNECT, WIFI_CONNECT, WIFI_ONLINE, WIFI_SOFTAP, WIFI_SOFTAPRETRY };
 
-  virtual bool setupWiFiAsStation(); // Настройка модуля в режиме инфраструктуры
+  virtual bool setupWiFiAsStation(); // Начало подключения в режиме инфраструктуры (завершается в loopWiFi())
+  virtual void onStationConnected(); // Вызывается после подключения к сети в режиме инфраструктуры
+  virtual void loopWiFi(); // Отслеживание состояния подключения без блокировки главного цикла
   virtual void setupWiFiAsAP(); // Настройка модуля в режиме точки доступа
   virtual void setupWiFi(); // Попытка настройки модуля в заданный параметрами режим, при неудаче принудительный переход в режим точки доступа
   virtual void onWiFiConnected(); // Вызывается после активации беспроводной сети
+  virtual void startMDNS(); // Запуск mDNS или его оповещение о смене адреса (после подключения к сети или включения точки доступа)
 
   virtual bool userAuthenticate();
   virtual bool adminAuthenticate();
+  bool adminAuthorized(); // Проверка прав администратора без отправки запроса авторизации (для обработчиков загрузки)
+  static bool protectedFile(const String &fileName); // Файл содержит пароли и недоступен через SPIFFS
 
   virtual uint32_t getTime(); // Возвращает время в формате UNIX-time с учетом часового пояса или 0, если ни разу не удалось получить точное время
   virtual void setTime(uint32_t now); // Ручная установка времени в формате UNIX-time
@@ -203,7 +271,7 @@ protected:
   virtual void logDateTime(uint32_t now = 0); // Записать в лог переданные или текущие дату и время
   virtual void logTimeDate(uint32_t now = 0); // Записать в лог переданные или текущие время и дату
 
-  virtual void setupHttpServer(); // Настройка Web-сервера (переопределяется для добавления обработчиков новых страниц)
+  virtual void setupHttpServer(); // Настройка Web-сервера (переопределяется для добавления таблицы маршрутов новых страниц)
   virtual void handleStdCss();
   virtual void handleStdJs();
   virtual void handleNotFound(); // Обработчик несуществующей страницы
@@ -224,7 +292,13 @@ protected:
   virtual void handleGetTime(); // Обработчик страницы, возвращающей JSON-пакет времени
   virtual void handleSetTime(); // Обработчик страницы ручной установки времени
   virtual void handleData(); // Обработчик страницы, возвращающей JSON-пакет данных
+  virtual void handleRoutes(); // Обработчик страницы, возвращающей JSON-пакет статистики обработчиков страниц
+  virtual void handleBackup(); // Обработчик страницы, возвращающей архив конфигурации
+  virtual void handleRestore(); // Обработчик страницы выбора архива для восстановления конфигурации
+  virtual void handleRestored(); // Обработчик страницы окончания загрузки архива конфигурации
+  virtual void handleRestoreUpload(); // Обработчик страницы загрузки архива конфигурации
   virtual String jsonData(); // Формирование JSON-пакета данных
+  bool checkETag(const String &etag); // Отправка ETag и ответа 304, если клиент уже имеет актуальную версию страницы
 
   virtual String btnBack(); // HTML-код кнопки "назад" для интерфейса
   virtual String btnWiFiConfig(); // HTML-код кнопки настройки параметров беспроводной сети
@@ -235,6 +309,8 @@ protected:
 
   virtual String getContentType(const String &fileName); // MIME-тип фала по его расширению
   virtual bool handleFileRead(const String &path); // Чтение файла из SPIFFS
+  static uint8_t contentTypeIndex(const String &fileName); // Индекс MIME-типа файла по его расширению
+  static String contentTypeStr(uint8_t index); // MIME-тип по его индексу
 
   static String webPageStart(const String &title); // HTML-код заголовка Web-страницы
   static String webPageStyle(const String &style, bool file = false); // HTML-код стилевого блока или файла
@@ -249,6 +325,7 @@ protected:
   static String webPageBody(const String& extra); // HTML-код заголовка тела страницы с дополнительными параметрами
   static String webPageEnd(); // HTML-код завершения Web-страницы
   static String escapeQuote(const String &str); // Экранирование двойных кавычек для строковых значений в Web-формах
+  static String escapeJson(const char *str); // Экранирование кавычек, обратной косой черты и управляющих символов для строковых значений JSON
   static String tagInput(const String &type, const String &name, const String &value, int16_t size = -1, int16_t maxlength = -1); // HTML-код для тэга INPUT
   static String tagInput(const String &type, const String &name, const String &value, const String &extra, int16_t size = -1, int16_t maxlength = -1); // HTML-код для тэга INPUT с дополнительными параметрами
 
@@ -274,7 +351,14 @@ protected:
   pulse_t _pulse;
 #endif
 
+  static const httproute_t httpRoutes[]; // Таблица маршрутов Web-сервера
+
   StringLog *_log; // Логи скетча
+  FileIndex *_files; // Индекс файлов SPIFFS, отдаваемых Web-сервером
+  HttpRouter *_router; // Диспетчер запросов Web-сервера
+  EEPROMCache _eeprom; // Доступ к буферу EEPROM (используется только для миграции старой конфигурации)
+  PageCache *_pageCache; // Кэш готовых фрагментов Web-страниц
+  uint32_t _configGeneration; // Счетчик изменений конфигурации
   bool _apMode; // Режим точки доступа (true) или инфраструктуры (false)
   char _ssid[MAX_STRING_LEN]; // Имя сети или точки доступа
   char _password[MAX_STRING_LEN]; // Пароль сети
@@ -289,9 +373,19 @@ protected:
   int8_t _ntpTimeZone; // Временная зона (в часах от UTC)
   uint32_t _ntpUpdateInterval; // Период в миллисекундах для обновления времени с NTP-серверов
 
+  rtcstate_t _rtcState; // Последнее время и параметры подключения к сети для быстрого старта
+  uint32_t _timeValidTime; // Значение millis() в момент получения первого достоверного времени (0, если еще не получено)
+  uint32_t _connectedTime; // Значение millis() в момент подключения к сети (0, если еще не подключено)
+  wifistate_t _wifiState; // Состояние подключения к сети
+  bool _mdnsStarted;
+  uint32_t _wifiTime; // Значение millis() для таймаута текущего состояния
+  uint32_t _wifiStart; // Значение millis() в момент начала подключения
+  uint32_t _wifiBackoff; // Текущий интервал между повторными попытками подключения из режима точки доступа
+
 private:
   uint32_t _lastNtpTime; // Последнее полученное от NTP-серверов время в формате UNIX-time
   uint32_t _lastNtpUpdate; // Значение millis() в момент последней синхронизации времени
+  bool _timeRestored; // Время восстановлено из RTC-памяти и требует синхронизации с NTP-серверами
 };
 
-#endif
+#endif
@@ -1,6 +1,19 @@
 #include <pgmspace.h>
+extern "C" {
+#include <lwip/init.h>
+#include <lwip/dns.h>
+}
 #include "ESPWebMQTT.h"
 
+#if LWIP_VERSION_MAJOR == 1
+static void mqttDnsFound(const char *name, ip_addr_t *ipaddr, void *arg) {
+#else
+static void mqttDnsFound(const char *name, const ip_addr_t *ipaddr, void *arg) {
+#endif
+  (void)name;
+  ((ESPWebMQTTBase*)arg)->mqttResolved(ipaddr ? ipaddr->addr : 0);
+}
+
 /*
  * ESPWebMQTTBase class implementation
  */
@@ -8,6 +21,19 @@
 ESPWebMQTTBase::ESPWebMQTTBase() : ESPWebBase() {
   _espClient = new WiFiClient();
   pubSubClient = new PubSubClient(*_espClient);
+  pubSubClient->setBufferSize(MQTT_BUFFER_SIZE);
+  _mqttRouter = new MQTTRouter(MQTT_ROUTER_NODES, MQTT_ROUTER_POOL, MQTT_ROUTER_HANDLERS);
+  _mqttQueue = new MQTTQueue(MQTT_QUEUE_SIZE, MQTT_QUEUE_EVENTS);
+  _mqttDrainTime = 0;
+  _mqttState = MQTT_STATE_IDLE;
+  _mqttTime = 0;
+  _mqttStart = 0;
+  _mqttBackoff = MQTT_RETRY_MIN;
+  _mqttDnsDone = false;
+  _mqttConnects = 0;
+  _mqttFailures = 0;
+  _mqttConnectTime = 0;
+  _mqttMaxConnectTime = 0;
 }
 
 void ESPWebMQTTBase::setupExtra() {
@@ -21,20 +47,20 @@ void ESPWebMQTTBase::loopExtra() {
   if (*_mqttServer && ((WiFi.getMode() == WIFI_STA) && (WiFi.status() == WL_CONNECTED))) {
     if (! pubSubClient->connected())
       mqttReconnect();
-    if (pubSubClient->connected())
+    if (pubSubClient->connected()) {
       pubSubClient->loop();
+      mqttDrain();
+    }
   }
 }
 
-bool ESPWebMQTTBase::readConfig(uint16_t &offset) {
-  if (! ESPWebBase::readConfig(offset))
+bool ESPWebMQTTBase::readEEPROMConfig(uint16_t &offset) {
+  if (! ESPWebBase::readEEPROMConfig(offset))
     return false;
 
   uint16_t start = offset;
 
-  if ((! readEEPROM(offset, (uint8_t*)_mqttServer, sizeof(_mqttServer))) || (! readEEPROM(offset, (uint8_t*)&_mqttPort, sizeof(_mqttPort))) ||
-    (! readEEPROM(offset, (uint8_t*)_mqttUser, sizeof(_mqttUser))) || (! readEEPROM(offset, (uint8_t*)_mqttPassword, sizeof(_mqttPassword))) ||
-    (! readEEPROM(offset, (uint8_t*)_mqttClient, sizeof(_mqttClient)))) {
+  if (! getEEPROM(offset, _mqttServer, _mqttPort, _mqttUser, _mqttPassword, _mqttClient)) {
     _log->println(F("Error reading from EEPROM!"));
     defaultConfig(1);
     return false;
@@ -50,26 +76,31 @@ bool ESPWebMQTTBase::readConfig(uint16_t &offset) {
   return true;
 }
 
-bool ESPWebMQTTBase::writeConfig(uint16_t &offset, bool commit) {
-  if (! ESPWebBase::writeConfig(offset, false))
+bool ESPWebMQTTBase::readConfig() {
+  if (! ESPWebBase::readConfig())
     return false;
 
-  uint16_t start = offset;
+  getConfigStr(FPSTR(paramMQTTServer), _mqttServer, sizeof(_mqttServer));
+  getConfig(FPSTR(paramMQTTPort), _mqttPort);
+  getConfigStr(FPSTR(paramMQTTUser), _mqttUser, sizeof(_mqttUser));
+  getConfigStr(FPSTR(paramMQTTPassword), _mqttPassword, sizeof(_mqttPassword));
+  getConfigStr(FPSTR(paramMQTTClient), _mqttClient, sizeof(_mqttClient));
+
+  return true;
+}
 
-  if ((! writeEEPROM(offset, (uint8_t*)_mqttServer, sizeof(_mqttServer))) || (! writeEEPROM(offset, (uint8_t*)&_mqttPort, sizeof(_mqttPort))) ||
-    (! writeEEPROM(offset, (uint8_t*)_mqttUser, sizeof(_mqttUser))) || (! writeEEPROM(offset, (uint8_t*)_mqttPassword, sizeof(_mqttPassword))) ||
-    (! writeEEPROM(offset, (uint8_t*)_mqttClient, sizeof(_mqttClient)))) {
-    _log->println(F("Error writing to EEPROM!"));
+bool ESPWebMQTTBase::writeConfig(bool commit) {
+  if (! ESPWebBase::writeConfig(false))
     return false;
-  }
 
-  uint8_t crc = crc8EEPROM(start, offset);
-  if (! writeEEPROM(offset, crc)) {
-    _log->println(F("Error writing CRC!"));
+  if ((! putConfigStr(FPSTR(paramMQTTServer), _mqttServer)) || (! putConfig(FPSTR(paramMQTTPort), _mqttPort)) ||
+    (! putConfigStr(FPSTR(paramMQTTUser), _mqttUser)) || (! putConfigStr(FPSTR(paramMQTTPassword), _mqttPassword)) ||
+    (! putConfigStr(FPSTR(paramMQTTClient), _mqttClient))) {
+    _log->println(F("Error writing config!"));
     return false;
   }
   if (commit)
-    commitConfig();
+    return commitConfig();
 
   return true;
 }
@@ -113,9 +144,13 @@ bool ESPWebMQTTBase::setConfigParam(const String &name, const String &value) {
   return true;
 }
 
+const httproute_t ESPWebMQTTBase::httpRoutes[] PROGMEM = {
+  { pathMQTT, HTTP_ANY, HTTP_HANDLER(ESPWebMQTTBase::handleMQTTConfig), NULL }
+};
+
 void ESPWebMQTTBase::setupHttpServer() {
   ESPWebBase::setupHttpServer();
-  httpServer->on(String(FPSTR(pathMQTT)).c_str(), std::bind(&ESPWebMQTTBase::handleMQTTConfig, this));
+  _router->add(httpRoutes, sizeof(httpRoutes) / sizeof(httpRoutes[0]));
 }
 
 void ESPWebMQTTBase::handleRootPage() {
@@ -246,6 +281,34 @@ String ESPWebMQTTBase::jsonData() {
     result += FPSTR(bools[1]);
   else
     result += FPSTR(bools[0]);
+  result += F(",\"");
+  result += FPSTR(jsonMQTTReconnects);
+  result += F("\":");
+  result += String(_mqttConnects ? _mqttConnects - 1 : 0);
+  result += F(",\"");
+  result += FPSTR(jsonMQTTFailures);
+  result += F("\":");
+  result += String(_mqttFailures);
+  result += F(",\"");
+  result += FPSTR(jsonMQTTConnectTime);
+  result += F("\":");
+  result += String(_mqttConnectTime);
+  result += F(",\"");
+  result += FPSTR(jsonMQTTMaxConnectTime);
+  result += F("\":");
+  result += String(_mqttMaxConnectTime);
+  result += F(",\"");
+  result += FPSTR(jsonMQTTQueue);
+  result += F("\":");
+  result += String(_mqttQueue->count());
+  result += F(",\"");
+  result += FPSTR(jsonMQTTDrops);
+  result += F("\":");
+  result += String(_mqttQueue->drops());
+  result += F(",\"");
+  result += FPSTR(jsonMQTTCoalesced);
+  result += F("\":");
+  result += String(_mqttQueue->coalesced());
 
   return result;
 }
@@ -268,56 +331,153 @@ String ESPWebMQTTBase::navigator() {
 }
 
 bool ESPWebMQTTBase::mqttReconnect() {
-  const uint32_t timeout = 30000;
-
-  static uint32_t nextTime;
-  bool result = false;
-
-  if ((int32_t)(millis() - nextTime) >= 0) {
-    _log->print(F("Attempting MQTT connection..."));
+  switch (_mqttState) {
+    case MQTT_STATE_ONLINE: // Соединение разорвано, первая попытка восстановления выполняется сразу
+      _log->println(F("MQTT connection lost!"));
+      _espClient->stop();
+      _mqttState = MQTT_STATE_IDLE;
+      _mqttBackoff = MQTT_RETRY_MIN;
+      _mqttTime = millis();
+      break;
+    case MQTT_STATE_IDLE:
+      if ((int32_t)(millis() - _mqttTime) < 0)
+        break;
+      _log->print(F("Attempting MQTT connection to \""));
+      _log->print(_mqttServer);
+      _log->println(charQuote);
 #ifdef LED_PIN
-    enablePulse(PULSE);
+      enablePulse(PULSE);
 #endif
-    if (*_mqttUser)
-      result = pubSubClient->connect(_mqttClient, _mqttUser, _mqttPassword);
-    else
-      result = pubSubClient->connect(_mqttClient);
+      _mqttStart = millis();
+      if (_mqttIP.fromString(_mqttServer)) { // Адрес задан числом
+        _mqttState = MQTT_STATE_TCP;
+      } else {
+        ip_addr_t addr;
+
+        _mqttDnsDone = false;
+        err_t err = dns_gethostbyname(_mqttServer, &addr, &mqttDnsFound, this); // Ответ придет в mqttDnsFound(), если адреса нет в кэше
+
+        if (err == ERR_OK) {
+          _mqttIP = addr.addr;
+          _mqttState = MQTT_STATE_TCP;
+        } else if (err == ERR_INPROGRESS) {
+          _mqttState = MQTT_STATE_RESOLVE;
+          _mqttTime = _mqttStart + MQTT_DNS_TIMEOUT;
+        } else {
+          mqttFailed(F("DNS request error"));
+        }
+      }
+      break;
+    case MQTT_STATE_RESOLVE:
+      if (_mqttDnsDone) {
+        if ((uint32_t)_mqttIP)
+          _mqttState = MQTT_STATE_TCP;
+        else
+          mqttFailed(F("unable to resolve broker address"));
+      } else if ((int32_t)(millis() - _mqttTime) >= 0) {
+        mqttFailed(F("DNS timeout"));
+      }
+      break;
+    case MQTT_STATE_TCP:
+      _espClient->setTimeout(MQTT_TCP_TIMEOUT);
+      if (_espClient->connect(_mqttIP, _mqttPort))
+        _mqttState = MQTT_STATE_CONNECT; // Запрос подключения отправляется на следующем проходе главного цикла
+      else
+        mqttFailed(F("TCP connection failed"));
+      break;
+    case MQTT_STATE_CONNECT: {
+      bool result;
+
+      pubSubClient->setSocketTimeout(MQTT_CONNACK_TIMEOUT);
+      if (*_mqttUser) // PubSubClient использует уже открытое TCP-соединение
+        result = pubSubClient->connect(_mqttClient, _mqttUser, _mqttPassword);
+      else
+        result = pubSubClient->connect(_mqttClient);
+      if (! result) {
+        mqttFailed(F("broker refused connection"));
+        break;
+      }
+      _mqttState = MQTT_STATE_ONLINE;
+      _mqttBackoff = MQTT_RETRY_MIN;
+      _mqttConnectTime = millis() - _mqttStart;
+      if (_mqttConnectTime > _mqttMaxConnectTime)
+        _mqttMaxConnectTime = _mqttConnectTime;
+      ++_mqttConnects;
 #ifdef LED_PIN
-//    enablePulse(WiFi.getMode() == WIFI_STA ? BREATH : FADEIN);
-    enablePulse(BREATH);
+      enablePulse(BREATH);
 #endif
-    if (result) {
-      _log->println(F(" connected"));
+      _log->print(F("MQTT connected in "));
+      _log->print(_mqttConnectTime);
+      _log->println(F(" ms"));
       mqttResubscribe();
-    } else {
-      _log->print(F(" failed, rc="));
-      _log->println(pubSubClient->state());
+      return true;
     }
-    nextTime = millis() + timeout;
   }
 
-  return result;
+  return false;
+}
+
+void ESPWebMQTTBase::mqttFailed(const __FlashStringHelper *reason) {
+  uint32_t wait = _mqttBackoff / 2 + random(_mqttBackoff / 2 + 1); // Случайный разброс, чтобы клиенты не переподключались одновременно
+
+  _espClient->stop();
+  ++_mqttFailures;
+  _mqttState = MQTT_STATE_IDLE;
+  _mqttTime = millis() + wait;
+  if (_mqttBackoff < MQTT_RETRY_MAX / 2)
+    _mqttBackoff *= 2;
+  else
+    _mqttBackoff = MQTT_RETRY_MAX;
+#ifdef LED_PIN
+  enablePulse(BREATH);
+#endif
+  _log->print(F("MQTT connection failed ("));
+  _log->print(reason);
+  _log->print(F(", rc="));
+  _log->print(pubSubClient->state());
+  _log->print(F("), next attempt in "));
+  _log->print(wait);
+  _log->println(F(" ms"));
+}
+
+void ESPWebMQTTBase::mqttResolved(uint32_t ip) {
+  _mqttIP = ip;
+  _mqttDnsDone = true;
 }
 
 void ESPWebMQTTBase::mqttCallback(char *topic, byte *payload, unsigned int length) {
-  _log->print(F("MQTT message arrived ["));
-  _log->print(topic);
-  _log->print(F("] "));
-  for (uint16_t i = 0; i < length; ++i) {
-    _log->print((char)payload[i]);
+  const char *topicBody = topic;
+
+  if (*_mqttClient) { // Отбрасывание префикса "/ClientName"
+    size_t len = strlen(_mqttClient);
+
+    if ((*topicBody == charSlash) && (! strncmp(topicBody + 1, _mqttClient, len)) && ((topicBody[len + 1] == charSlash) || (! topicBody[len + 1])))
+      topicBody += len + 1;
+    else
+      topicBody = NULL;
+  }
+  if ((! topicBody) || (! _mqttRouter->dispatch(topicBody, payload, length))) {
+    _log->print(F("Unexpected MQTT topic \""));
+    _log->print(topic);
+    _log->println('\"');
   }
-  _log->println();
 }
 
 void ESPWebMQTTBase::mqttResubscribe() {
-  String topic;
+  for (uint8_t i = 0; i < _mqttRouter->count(); ++i)
+    mqttSubscribe(mqttTopic(_mqttRouter->filter(i)));
+}
+
+String ESPWebMQTTBase::mqttTopic(const String &topic) {
+  String result;
 
   if (*_mqttClient) {
-    topic += charSlash;
-    topic += _mqttClient;
-    topic += F("/#");
-    mqttSubscribe(topic);
+    result += charSlash;
+    result += _mqttClient;
   }
+  result += topic;
+
+  return result;
 }
 
 bool ESPWebMQTTBase::mqttSubscribe(const String &topic) {
@@ -328,12 +488,45 @@ bool ESPWebMQTTBase::mqttSubscribe(const String &topic) {
   return pubSubClient->subscribe(topic.c_str());
 }
 
+bool ESPWebMQTTBase::mqttRoute(const String &filter, mqtthandler_t handler) {
+  if (! _mqttRouter->add(filter, handler)) {
+    _log->print(F("MQTT route \""));
+    _log->print(filter);
+    _log->println(F("\" registration error!"));
+    return false;
+  }
+  if (pubSubClient->connected())
+    return mqttSubscribe(mqttTopic(filter));
+
+  return true;
+}
+
 bool ESPWebMQTTBase::mqttPublish(const String &topic, const String &value, bool retained) {
-  _log->print(F("MQTT publish topic \""));
-  _log->print(topic);
-  _log->print(F("\" with value \""));
-  _log->print(value);
-  _log->println('\"');
+  uint32_t drops = _mqttQueue->drops();
+  bool result = _mqttQueue->push(topic.c_str(), (const uint8_t*)value.c_str(), value.length(), retained);
+
+  if (_mqttQueue->drops() != drops) {
+    _log->print(F("MQTT queue overflow, "));
+    _log->print(_mqttQueue->drops() - drops);
+    _log->println(F(" topic(s) dropped!"));
+  }
 
-  return pubSubClient->publish(topic.c_str(), value.c_str(), retained);
-}
+  return result;
+}
+
+void ESPWebMQTTBase::mqttDrain() {
+  if ((! _mqttQueue->count()) || ((int32_t)(millis() - _mqttDrainTime) < 0))
+    return;
+
+  const char *topic;
+  const uint8_t *value;
+  uint16_t len;
+  bool retained;
+
+  for (uint8_t i = 0; (i < MQTT_QUEUE_BATCH) && _mqttQueue->peek(topic, value, len, retained); ++i) {
+    if (! pubSubClient->publish(topic, value, len, retained))
+      break; // Топик остается в очереди до следующей попытки
+    _mqttQueue->pop();
+  }
+  _mqttDrainTime = millis() + MQTT_QUEUE_INTERVAL;
+}
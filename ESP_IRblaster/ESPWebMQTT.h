@@ -2,16 +2,41 @@
 #define __ESPWEBMQTT_H
 
 #include "ESPWeb.h"
+#include "MQTTQueue.h"
+#include "MQTTRouter.h"
 #include <PubSubClient.h>
 #include <ESP8266WiFi.h>
 
 const char defMQTTClient[] PROGMEM = "ESP8266_"; // Префикс имени клиента для MQTT-брокера по умолчанию
 const uint16_t defMQTTPort = 1883; // Порт MQTT-брокера по умолчанию
 
+const uint32_t MQTT_RETRY_MIN = 1000; // Начальный интервал в миллисекундах между попытками подключения к MQTT-брокеру (удваивается после каждой неудачи)
+const uint32_t MQTT_RETRY_MAX = 300000; // Максимальный интервал между попытками (5 мин.)
+const uint32_t MQTT_DNS_TIMEOUT = 5000; // Время в миллисекундах на получение адреса MQTT-брокера
+const uint32_t MQTT_TCP_TIMEOUT = 3000; // Таймаут TCP-подключения в миллисекундах (ядро ESP8266 учитывает его начиная с версии 2.5)
+const uint16_t MQTT_CONNACK_TIMEOUT = 3; // Время в секундах на ответ MQTT-брокера на запрос подключения
+const uint16_t MQTT_BUFFER_SIZE = 512; // Размер буфера пакета MQTT (вмещает raw-код из 128 значений в кодировке Base64)
+
+const uint16_t MQTT_QUEUE_SIZE = 1024; // Размер буфера очереди публикуемых топиков
+const uint16_t MQTT_QUEUE_EVENTS = 32; // Максимальное количество топиков в очереди (при переполнении вытесняются самые старые)
+const uint8_t MQTT_QUEUE_BATCH = 4; // Количество топиков, публикуемых за один проход главного цикла
+const uint32_t MQTT_QUEUE_INTERVAL = 20; // Минимальный интервал в миллисекундах между порциями публикаций
+
+const uint8_t MQTT_ROUTER_NODES = 32; // Максимальное количество узлов дерева топиков
+const uint16_t MQTT_ROUTER_POOL = 256; // Размер буфера имен уровней топиков
+const uint8_t MQTT_ROUTER_HANDLERS = 16; // Максимальное количество обработчиков топиков
+
 const char pathMQTT[] PROGMEM = "/mqtt"; // Путь до страницы конфигурации параметров MQTT
 
 // Имена JSON-переменных
 const char jsonMQTTConnected[] PROGMEM = "mqttconnected";
+const char jsonMQTTReconnects[] PROGMEM = "mqttreconnects";
+const char jsonMQTTFailures[] PROGMEM = "mqttfailures";
+const char jsonMQTTConnectTime[] PROGMEM = "mqttconnectms";
+const char jsonMQTTMaxConnectTime[] PROGMEM = "mqttmaxconnectms";
+const char jsonMQTTQueue[] PROGMEM = "mqttqueue";
+const char jsonMQTTDrops[] PROGMEM = "mqttdrops";
+const char jsonMQTTCoalesced[] PROGMEM = "mqttcoalesced";
 
 // Имена параметров для Web-форм
 const char paramMQTTServer[] PROGMEM = "mqttserver";
@@ -26,14 +51,18 @@ public:
 
   PubSubClient* pubSubClient; // Клиент MQTT-брокера
 
+  void mqttResolved(uint32_t ip); // Вызывается из callback-функции lwIP по завершении DNS-запроса (0, если адрес не найден)
+
 protected:
   void setupExtra();
   void loopExtra();
-  bool readConfig(uint16_t &offset);
-  bool writeConfig(uint16_t &offset, bool commit = true);
+  bool readEEPROMConfig(uint16_t &offset);
+  bool readConfig();
+  bool writeConfig(bool commit = true);
   void defaultConfig(uint8_t level = 0);
   bool setConfigParam(const String &name, const String &value);
   void setupHttpServer();
+  static const httproute_t httpRoutes[];
   void handleRootPage();
   virtual void handleMQTTConfig(); // Обработчик страницы настройки параметров MQTT
   String jsonData(); // Формирование JSON-пакета данных
@@ -41,18 +70,38 @@ protected:
   virtual String btnMQTTConfig(); // HTML-код кнопки параметров MQTT
   String navigator();
 
-  virtual bool mqttReconnect(); // Восстановление соединения с MQTT-брокером
+  enum mqttstate_t : uint8_t { MQTT_STATE_IDLE, MQTT_STATE_RESOLVE, MQTT_STATE_TCP, MQTT_STATE_CONNECT, MQTT_STATE_ONLINE };
+
+  virtual bool mqttReconnect(); // Очередной шаг восстановления соединения с MQTT-брокером (возвращает true после подключения)
+  void mqttFailed(const __FlashStringHelper *reason); // Завершение неудачной попытки подключения и расчет времени следующей
   virtual void mqttCallback(char *topic, byte *payload, unsigned int length); // Callback-функция, вызываемая MQTT-брокером при получении топика, на которое оформлена подписка
   virtual void mqttResubscribe(); // Осуществление подписки на топики
+  String mqttTopic(const String &topic); // Полное имя топика с префиксом "/ClientName"
   bool mqttSubscribe(const String &topic); // Хэлпер для подписки на топик
-  bool mqttPublish(const String &topic, const String &value, bool retained = true); // Хэлпер для публикации топика
+  bool mqttRoute(const String &filter, mqtthandler_t handler); // Регистрация обработчика топиков (фильтр без префикса "/ClientName", подписка при каждом подключении)
+  bool mqttPublish(const String &topic, const String &value, bool retained = true); // Хэлпер для публикации топика (через очередь)
+  void mqttDrain(); // Публикация очередной порции топиков из очереди
 
   WiFiClient* _espClient;
+  MQTTRouter* _mqttRouter; // Обработчики входящих топиков
+  MQTTQueue* _mqttQueue; // Очередь публикуемых топиков (сохраняет последние события, пока нет подключения)
+  uint32_t _mqttDrainTime; // Значение millis() для публикации следующей порции топиков
   char _mqttServer[MAX_STRING_LEN]; // MQTT-брокер
   uint16_t _mqttPort; // Порт MQTT-брокера
   char _mqttUser[MAX_STRING_LEN]; // Имя пользователя для авторизации
   char _mqttPassword[MAX_STRING_LEN]; // Пароль для авторизации
   char _mqttClient[MAX_STRING_LEN]; // Имя клиента для MQTT-брокера (используется при формировании имени топика для публикации в целях различия между несколькими клиентами с идентичным скетчем)
+
+  mqttstate_t _mqttState; // Этап подключения к MQTT-брокеру
+  uint32_t _mqttTime; // Значение millis() для следующей попытки или таймаута текущего этапа
+  uint32_t _mqttStart; // Значение millis() в момент начала попытки подключения
+  uint32_t _mqttBackoff; // Текущий интервал между попытками подключения
+  IPAddress _mqttIP; // Адрес MQTT-брокера
+  volatile bool _mqttDnsDone; // DNS-запрос завершен
+  uint32_t _mqttConnects; // Количество успешных подключений
+  uint32_t _mqttFailures; // Количество неудачных попыток подключения
+  uint32_t _mqttConnectTime; // Длительность последнего подключения в миллисекундах
+  uint32_t _mqttMaxConnectTime; // Максимальная длительность подключения в миллисекундах
 };
 
-#endif
+#endif
@@ -7,6 +7,13 @@
 #include "Date.h"
 #include "Schedule.h"
 #include "RTCmem.h"
+#include "RawCode.h"
+#include "Crc.h"
+#include "BufferedFile.h"
+#include "Record.h"
+#include "IRButton.h"
+#include "IRMatcher.h"
+#include "IRTimeout.h"
 #include <IRremoteESP8266.h>
 #ifdef IRRX_PIN
 #include <IRrecv.h>
@@ -14,6 +21,7 @@
 #include <IRsend.h>
 
 const int8_t MAX_SCHEDULES = 10; // Количество элементов расписания
+const int8_t MAX_MACROS = 8; // Количество макросов (последовательностей нажатий кнопок ДУ)
 
 const char overSSID[] PROGMEM = "IRblaster_"; // Префикс имени точки доступа по умолчанию
 const char overMQTTClient[] PROGMEM = "IRblaster_"; // Префикс имени MQTT-клиента по умолчанию
@@ -27,10 +35,14 @@ const char pathSchedulesJs[] PROGMEM = "/schedules.js";
 const char pathSchedules[] PROGMEM = "/schedules"; // Путь до страницы настройки параметров расписания
 const char pathGetSchedule[] PROGMEM = "/getschedule"; // Путь до страницы, возвращающей JSON-пакет элемента расписания
 const char pathSetSchedule[] PROGMEM = "/setschedule"; // Путь до страницы изменения элемента расписания
+const char pathGetMacro[] PROGMEM = "/getmacro"; // Путь до страницы, возвращающей JSON-пакет макроса
+const char pathSetMacro[] PROGMEM = "/setmacro"; // Путь до страницы изменения макроса
 
 // Имена параметров для Web-форм
 const char paramRemoteBtnName[] PROGMEM = "rembtnname";
 const char paramRemoteBtnCode[] PROGMEM = "rembtncode";
+const char paramRemoteBtnRaw[] PROGMEM = "rembtnraw"; // Raw-код в кодировке Base64 (little-endian uint16)
+const char paramPlain[] PROGMEM = "plain"; // Тело POST-запроса
 const char paramRemoteBtnRepeat[] PROGMEM = "rembtnrepeat";
 const char paramRemoteBtnGap[] PROGMEM = "rembtngap";
 const char paramSchedulePeriod[] PROGMEM = "period";
@@ -42,20 +54,61 @@ const char paramScheduleDay[] PROGMEM = "day";
 const char paramScheduleMonth[] PROGMEM = "month";
 const char paramScheduleYear[] PROGMEM = "year";
 const char paramScheduleIRButton[] PROGMEM = "irbutton";
+const char paramMacroName[] PROGMEM = "macroname";
+const char paramMacroSteps[] PROGMEM = "macrosteps"; // Шаги макроса "кнопка[:задержка мс],..." (кнопка - номер от 0 или имя)
+const char paramAll[] PROGMEM = "all"; // Групповой запрос ко всем элементам
+const char paramBinary[] PROGMEM = "bin"; // Выгрузка кнопок ДУ в двоичном формате файла
+const char paramIRButton[] PROGMEM = "btn"; // Номер кнопки ДУ для отправки (от 0)
+const char paramIRButtonName[] PROGMEM = "name"; // Имя кнопки ДУ для отправки
+const char paramIRCode[] PROGMEM = "code"; // Код для разовой отправки (Base64 raw-код или "ПРОТОКОЛ:hex[:бит[:повторов]]")
+const char paramLearn[] PROGMEM = "learn"; // Вход (1) или выход (0) из режима обучения
+
+// Ключи журнала конфигурации
+const char configSchedule[] PROGMEM = "schedule"; // Префикс ключа элемента расписания (дополняется номером)
+const uint8_t SCHEDULE_RECORD_SIZE = 10; // period, hour, minute, second, weekdays, day, month, year (LE16), button
+const char configMacro[] PROGMEM = "macro"; // Префикс ключа макроса (дополняется номером)
 
 // Имена JSON-переменных
 const char jsonRemoteCode[] PROGMEM = "remotecode";
+const char jsonButtonsWrites[] PROGMEM = "btnwrites";
+const char jsonButtonsSkips[] PROGMEM = "btnskips";
+const char jsonIRHashHits[] PROGMEM = "irhashhits";
+const char jsonIRScans[] PROGMEM = "irscans";
+const char jsonIREchoes[] PROGMEM = "irechoes";
+const char jsonIRTimeout[] PROGMEM = "irtimeoutms";
+const char jsonIRLatencyEstimate[] PROGMEM = "irlatencyestms"; // Оценка, а не измерение: библиотека приемника не сообщает время последнего фронта
+const char jsonIRLearning[] PROGMEM = "irlearning";
 
 // Названия топиков для MQTT
 const char mqttRemoteBtnTopic[] PROGMEM = "/IRButton";
+const char mqttIRSendTopic[] PROGMEM = "/IRSend";
+const char mqttIRReceivedTopic[] PROGMEM = "/IRReceived"; // Имя опознанной кнопки ДУ (или ее номер) либо "ПРОТОКОЛ:hex:бит"
+
+struct irprotocol_t { // Протокол, код которого может быть отправлен без записи в кнопку ДУ
+  char name[10];
+  decode_type_t type;
+  uint8_t nbits; // Количество бит по умолчанию
+};
+
+const irprotocol_t irProtocols[] PROGMEM = {
+  { "NEC", NEC, 32 },
+  { "SONY", SONY, 12 },
+  { "SAMSUNG", SAMSUNG, 32 },
+  { "LG", LG, 28 },
+  { "JVC", JVC, 16 },
+  { "RC5", RC5, 12 },
+  { "RC6", RC6, 20 },
+  { "PANASONIC", PANASONIC, 48 }
+};
 
 const char remoteFileName[] PROGMEM = "/IRblaster.dat";
+const char remoteTempFileName[] PROGMEM = "/IRblaster.tmp";
 
 const char strNone[] PROGMEM = "(None)";
 
 class ESPIRBlaster : public ESPWebMQTTBase {
 public:
-  ESPIRBlaster() : ESPWebMQTTBase() {}
+  ESPIRBlaster() : ESPWebMQTTBase(), _uploadParser(NULL), _uploadBuf(NULL), _buttonsDirty(false), _buttonsWrites(0), _buttonsSkips(0), _irSendPending(false), _txCode(NULL), _txLeft(0), _txTime(0), _echoStart(0), _echoEnd(0), _echoes(0), _macro(-1), _macroStep(0), _macroTime(0), _macroWait(false), _buttonsIndexed(false) {}
 
 protected:
 #ifdef IRRX_PIN
@@ -67,15 +120,27 @@ protected:
 
   String getHostName();
 
-  bool readConfig(uint16_t &offset);
-  bool writeConfig(uint16_t &offset, bool commit = true);
+  bool readEEPROMConfig(uint16_t &offset);
+  bool readConfig();
+  bool writeConfig(bool commit = true);
   void defaultConfig(uint8_t level = 0);
 
+  uint32_t backupSize();
+  bool writeBackup(Print &out);
+  bool restoreSection(uint8_t section, uint32_t len, BufferedFile &in);
+  bool prepareRestore();
+  bool commitRestore();
+  void abortRestore();
+
+  String jsonData();
+
   void setupHttpServer();
+  static const httproute_t httpRoutes[];
   void handleRootPage();
   void handleRemoteConfig(); // Обработчик страницы настройки параметров кнопок ДУ
   void handleGetRemote(); // Обработчик страницы, возвращающей JSON-пакет кнопки ДУ
   void handleSetRemote(); // Обработчик страницы изменения кнопки ДУ
+  void handleRemoteUpload(); // Обработчик загрузки двоичного raw-кода кнопки ДУ
 #ifdef IRRX_PIN
   void handleRemoteData(); // Обработчик страницы, возвращающей JSON-пакет данных о последней нажатой кнопке пульта ДУ
 #endif
@@ -84,54 +149,171 @@ protected:
   void handleSchedulesConfig(); // Обработчик страницы настройки параметров расписания
   void handleGetSchedule(); // Обработчик страницы, возвращающей JSON-пакет элемента расписания
   void handleSetSchedule(); // Обработчик страницы изменения элемента расписания
+  void handleGetMacro(); // Обработчик страницы, возвращающей JSON-пакет макроса
+  void handleSetMacro(); // Обработчик страницы изменения макроса
 
   String navigator();
   String btnRemoteConfig(); // HTML-код кнопки вызова настройки кнопок ДУ
   String btnSchedulesConfig(); // HTML-код кнопки вызова настройки расписания
 
-  void mqttCallback(char *topic, byte *payload, unsigned int length);
-  void mqttResubscribe();
+  enum cacheslot_t : uint8_t { CACHE_BUTTONS, CACHE_REMOTES, CACHE_SCHEDULES, CACHE_BUTTONOPTIONS }; // Кэшируемые фрагменты страниц
+  uint32_t schedulesKey(); // Ключ кэша для таблицы расписания (зависит и от времени следующих событий)
 
-private:
-  bool readSchedulesConfig(uint16_t &offset); // Чтение из EEPROM порции параметров расписания
-  bool writeSchedulesConfig(uint16_t &offset); // Запись в EEPROM порции параметров расписания
+  String remoteJson(uint8_t id); // JSON-пакет кнопки ДУ
+  String scheduleJson(int8_t id); // JSON-пакет элемента расписания
+  String macroJson(int8_t id); // JSON-пакет макроса
+
+  void mqttButtonHandler(const char *topic, const uint8_t *payload, uint16_t length); // Обработчик топика "/IRButton"
+  void mqttSendHandler(const char *topic, const uint8_t *payload, uint16_t length); // Обработчик топика "/IRSend"
 
+private:
+  bool readEEPROMSchedules(uint16_t &offset); // Чтение из EEPROM порции параметров расписания в старом формате
+  bool readSchedulesConfig(); // Чтение параметров расписания из журнала
+  bool writeSchedulesConfig(); // Запись параметров расписания в журнал
+  uint16_t encodeSchedule(int8_t id, uint8_t *data, uint16_t size); // Сериализация элемента расписания (возвращает длину записи или 0)
+  bool decodeSchedule(int8_t id, const uint8_t *data, uint16_t len); // Десериализация элемента расписания
+
+  bool storeConfig(); // Сохранение конфигурации после группового изменения
+
+  uint32_t buttonsStreamSize(); // Размер файла (потока) кнопок ДУ
+  bool writeButtonsStream(Print &out); // Запись всех кнопок ДУ в формате файла
+  bool readButtonsStream(BufferedFile &in); // Чтение кнопок ДУ (после сигнатуры)
+  bool readLegacyButtons(BufferedFile &in); // Чтение кнопок ДУ в старом формате (после сигнатуры)
   bool readIRButtons();
+  void loadIRButtons(); // Чтение кнопок ДУ из файла с очисткой при ошибке
   bool writeIRButtons();
+  bool prepareIRButtons(); // Запись кнопок ДУ во временный файл
+  bool replaceIRButtons(); // Замена файла кнопок ДУ временным файлом
   void clearIRButtons();
 
   static const uint8_t BUTTON_COLS = 3;
   static const uint8_t BUTTON_ROWS = 7;
 
-  static const uint8_t BUTTON_NAME_SIZE = 16;
+  static const uint8_t BUTTON_NAME_SIZE = IRBUTTON_NAME_SIZE;
   static const uint16_t IR_CAPTURE_BUFFER_SIZE = 128;
-  static const uint8_t IR_TIMEOUT = 45; // 15
-
-  struct irbutton_t {
-    char buttonName[BUTTON_NAME_SIZE];
-    union {
-      struct {
-        uint8_t repeat : 4; // 0..15 = 1..16
-        uint16_t gap : 12; // 0..4095 ms
-      };
-      uint16_t repeatgap;
-    };
-    uint16_t rawBufLen;
-    uint16_t rawBuf[IR_CAPTURE_BUFFER_SIZE];
-  } irbuttons[BUTTON_COLS * BUTTON_ROWS];
+  static const uint16_t IR_LEARN_BUFFER_SIZE = IRBUTTON_MAX_RAW; // Буфер приема в режиме обучения (длинные коды кондиционеров)
+  static const uint16_t IR_BUTTONS_RAW_MAX = 4096; // Суммарная длина raw-кодов всех кнопок ДУ (ограничение расхода кучи)
+  static const uint32_t IR_LEARN_TIMEOUT = 10000; // Выход из режима обучения, если страница перестала запрашивать данные (мс)
+  static const uint8_t IR_TIMEOUT = 45; // Таймаут окончания кадра для неизвестных протоколов и кондиционеров
+  static const uint8_t IR_TIMEOUT_MIN = 15; // Минимальный таймаут для известных протоколов
+  static const uint8_t IR_ECHO_GUARD = 20; // Запас в миллисекундах вокруг собственной передачи, в пределах которого принятые коды считаются эхом
+
+  irbutton_t irbuttons[BUTTON_COLS * BUTTON_ROWS];
+
+  static const uint8_t BUTTON_NAME_INDEX_SIZE = 64; // Размер хэш-таблицы имен кнопок ДУ и макросов (степень 2, не менее удвоенного их количества)
+
+  static const uint8_t MACRO_STEPS = 8; // Максимальное количество шагов макроса
+  static const int8_t MACRO_BASE = BUTTON_COLS * BUTTON_ROWS; // Номер первого макроса в общей нумерации с кнопками ДУ
+
+  struct macro_t {
+    char name[BUTTON_NAME_SIZE];
+    uint8_t count; // Количество шагов
+    int8_t buttons[MACRO_STEPS]; // Номера кнопок ДУ
+    uint16_t delays[MACRO_STEPS]; // Пауза в мс после отправки кода кнопки
+  } macros[MAX_MACROS];
+
+  static const uint8_t MACRO_RECORD_SIZE = 1 + BUTTON_NAME_SIZE - 1 + 1 + 3 * MACRO_STEPS; // name, count, (button, delay LE16) * count
+  uint16_t encodeMacro(int8_t id, uint8_t *data, uint16_t size); // Сериализация макроса (возвращает длину записи или 0)
+  bool decodeMacro(int8_t id, const uint8_t *data, uint16_t len); // Десериализация макроса
+
+  struct scheduleparams_t {
+    Schedule::period_t period;
+    int8_t hour;
+    int8_t minute;
+    int8_t second;
+    uint8_t weekdays;
+    int8_t day;
+    int8_t month;
+    int16_t year;
+    int8_t button;
+  };
+
+  bool setButtonParam(irbutton_t &irbutton, const String &name, const String &value, rawcode_error_t &error); // Присвоение значения параметру кнопки ДУ по его имени
+  rawcode_error_t finishRemoteUpload(irbutton_t &irbutton); // Перенос загруженного двоичного raw-кода в кнопку ДУ
+  void freeRemoteUpload();
+  bool storeButton(int8_t id, irbutton_t &irbutton); // Перенос кнопки ДУ в массив (irbutton получает прежнее содержимое кнопки)
+  uint32_t buttonsRawLength() const; // Суммарная длина raw-кодов кнопок ДУ
+  static uint8_t buttonNameHash(const char *name, uint16_t len); // Хэш имени кнопки ДУ без учета регистра
+  void indexButtons(); // Перестроение индексов имен и кодов кнопок ДУ
+  int8_t findButton(const char *name, uint16_t len); // Поиск кнопки ДУ или макроса по имени без учета регистра (-1, если не найдены)
+  const char *buttonName(int8_t btn) const { // Имя кнопки ДУ или макроса
+    return btn < MACRO_BASE ? irbuttons[btn].buttonName : macros[btn - MACRO_BASE].name;
+  }
+  bool buttonDefined(int8_t btn) const { // Кнопка ДУ с кодом или непустой макрос
+    return (btn >= 0) && ((btn < MACRO_BASE) ? (irbuttons[btn].rawBufLen != 0) : ((btn < MACRO_BASE + MAX_MACROS) && macros[btn - MACRO_BASE].count));
+  }
+  bool storeMacro(int8_t id, const String &name, const String &steps); // Разбор шагов и сохранение макроса в массив
+  bool readMacrosConfig(); // Чтение макросов из журнала
+  bool writeMacrosConfig(); // Запись макросов в журнал
+  void clearScheduleParams(scheduleparams_t &params);
+  bool setScheduleParam(scheduleparams_t &params, const String &name, const String &value); // Присвоение значения параметру элемента расписания по его имени
+  bool storeSchedule(int8_t id, const scheduleparams_t &params); // Сохранение элемента расписания в массив
 
   void sendButtonCode(uint8_t btn);
+  void triggerButton(int8_t btn); // Отправка кода кнопки ДУ или запуск макроса
+  void loopMacro(); // Очередной шаг выполняющегося макроса
+  void sendIRCode(const irbutton_t &irbutton); // Передача raw-кода (повторы передаются из главного цикла, прерывая предыдущую передачу)
+  void loopTransmit(); // Передача очередного повтора raw-кода
+  bool transmitting() const {
+    return _txCode != NULL;
+  }
+  bool irSendBusy() const { // Буфер кода для разовой отправки занят
+    return _irSendPending || (_txCode == &_irSend.code);
+  }
+  rawcode_error_t parseIRSend(const uint8_t *data, uint16_t len); // Разбор кода для разовой отправки (двоичная запись кнопки ДУ, Base64 raw-код или "ПРОТОКОЛ:hex[:бит[:повторов]]")
+  void sendIRSend(); // Передача кода, ожидающего разовой отправки
 
 #ifdef IRRX_PIN
-  bool cloneRemoteCode(decode_results *results);
+  bool cloneRemoteCode(decode_results *results, uint16_t *buf, uint16_t size, uint16_t &len);
+  bool isEcho(decode_results *results); // Принятый код пересекается по времени с собственной передачей
+  void retuneReceiver(); // Пересоздание приемника с текущими таймаутом окончания кадра и размером буфера
+  uint8_t receiverTimeout() const { // Таймаут окончания кадра приемника в миллисекундах
+    return _learnBuf ? IR_TIMEOUT : _irTimeout->timeout();
+  }
+  bool startLearning(); // Вход в режим обучения (выделение большого буфера приема)
+  void stopLearning(); // Выход из режима обучения (освобождение буфера)
+  void bridgeRemoteCode(decode_results *results, const uint16_t *raw, uint16_t len); // Публикация в MQTT опознанной кнопки ДУ или протокола принятого кода
 
-  uint16_t rawBufLen;
-  uint16_t rawBuf[IR_CAPTURE_BUFFER_SIZE];
+  IRMatcher *_irMatcher; // Индекс raw-кодов кнопок ДУ для опознания принятых кодов
+
+  uint16_t *_learnBuf; // Последний принятый код в режиме обучения (NULL вне режима обучения)
+  uint16_t _learnLen;
+  uint32_t _learnTime; // Значение millis() при последнем запросе страницы в режиме обучения
 
   IRrecv *irRX;
+  IRTimeout *_irTimeout; // Подбор таймаута окончания кадра
+  uint32_t _irPollTime; // Значение millis() при предыдущей проверке приемника
+  uint32_t _irLatencyEstimate; // Оценка сверху задержки от окончания последнего принятого кадра до его разбора в миллисекундах
 #endif
   IRsend *irTX;
 
+  RawCodeParser *_uploadParser; // Разбор загружаемого двоичного raw-кода (существует только во время загрузки)
+  uint16_t *_uploadBuf;
+
+  bool _buttonsDirty; // Кнопки ДУ изменены после последней записи файла
+  uint32_t _buttonsWrites; // Количество записей файла кнопок ДУ
+  uint32_t _buttonsSkips; // Количество пропущенных записей файла (без изменений)
+
+  struct irsend_t { // Код для разовой отправки (не сохраняется ни в EEPROM, ни в SPIFFS)
+    decode_type_t protocol; // UNKNOWN для raw-кода
+    uint64_t data;
+    uint16_t nbits;
+    irbutton_t code; // Raw-код, количество повторов и пауза между ними
+  } _irSend;
+  bool _irSendPending; // Код ожидает отправки из главного цикла
+  const irbutton_t *_txCode; // Передаваемый raw-код или NULL
+  uint8_t _txLeft; // Количество оставшихся повторов
+  uint32_t _txTime; // Значение millis() для следующего повтора
+  uint32_t _echoStart; // Значение millis() в начале собственной передачи
+  uint32_t _echoEnd; // Значение millis() по окончании последнего переданного кадра
+  uint32_t _echoes; // Количество отброшенных эхо-кодов
+  int8_t _macro; // Номер выполняющегося макроса или -1
+  uint8_t _macroStep; // Следующий шаг макроса
+  uint32_t _macroTime; // Значение millis() для следующего шага макроса
+  bool _macroWait; // Пауза после шага отсчитывается по окончании его передачи
+  bool _buttonsIndexed; // Индексы имен и кодов соответствуют кнопкам ДУ
+  uint8_t _buttonNames[BUTTON_NAME_INDEX_SIZE]; // Хэш-таблица имен кнопок ДУ с открытой адресацией (номер кнопки + 1 или 0)
+
   Schedule schedules[MAX_SCHEDULES]; // Массив расписания событий
   int8_t scheduleButtons[MAX_SCHEDULES]; // Что делать с реле по срабатыванию события
 };
@@ -150,10 +332,18 @@ void ESPIRBlaster::cleanup() {
 
 void ESPIRBlaster::setupExtra() {
   ESPWebMQTTBase::setupExtra();
+  mqttRoute(FPSTR(mqttRemoteBtnTopic), std::bind(&ESPIRBlaster::mqttButtonHandler, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+  mqttRoute(FPSTR(mqttIRSendTopic), std::bind(&ESPIRBlaster::mqttSendHandler, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 
 #ifdef IRRX_PIN
-  irRX = new IRrecv(IRRX_PIN, IR_CAPTURE_BUFFER_SIZE, IR_TIMEOUT, true);
+  _irTimeout = new IRTimeout(IR_TIMEOUT, IR_TIMEOUT_MIN);
+  _irPollTime = millis();
+  _irLatencyEstimate = 0;
+  _learnBuf = NULL;
+  _learnLen = 0;
+  irRX = new IRrecv(IRRX_PIN, IR_CAPTURE_BUFFER_SIZE, receiverTimeout(), true);
   irRX->enableIRIn();
+  _irMatcher = new IRMatcher(BUTTON_COLS * BUTTON_ROWS);
 #endif
   irTX = new IRsend(IRTX_PIN);
   irTX->begin();
@@ -165,24 +355,60 @@ void ESPIRBlaster::loopExtra() {
 #ifdef IRRX_PIN
   static decode_results results;
 
+  uint32_t pollTime = millis();
+
   if (irRX->decode(&results)) {
-    cloneRemoteCode(&results);
+    _irLatencyEstimate = receiverTimeout() + (pollTime - _irPollTime); // Кадр не был готов при предыдущей проверке
+
+    bool retune = false;
+
+    if (isEcho(&results)) {
+      ++_echoes;
+    } else {
+      uint16_t raw[IR_CAPTURE_BUFFER_SIZE]; // Вне режима обучения код нужен только для опознания кнопки
+      uint16_t len;
+
+      retune = _irTimeout->update(results.decode_type, results.rawbuf, results.rawlen) && (! _learnBuf); // В режиме обучения таймаут всегда длинный
+      if (_learnBuf) {
+        if (cloneRemoteCode(&results, _learnBuf, IR_LEARN_BUFFER_SIZE, len)) {
+          _learnLen = len;
+          bridgeRemoteCode(&results, _learnBuf, len);
+        }
+      } else {
+        if (cloneRemoteCode(&results, raw, IR_CAPTURE_BUFFER_SIZE, len))
+          bridgeRemoteCode(&results, raw, len);
+      }
+    }
     irRX->resume();
+    if (retune)
+      retuneReceiver();
   }
+  _irPollTime = pollTime;
+  if (_learnBuf && (millis() - _learnTime > IR_LEARN_TIMEOUT))
+    stopLearning();
 #endif
 
+  if (transmitting())
+    loopTransmit();
+  if (_irSendPending) {
+    sendIRSend();
+    _irSendPending = false;
+  }
+  if (_macro >= 0)
+    loopMacro();
+
   uint32_t now = getTime();
 
   if (now) {
     for (int8_t i = 0; i < MAX_SCHEDULES; ++i) {
       if (schedules[i].period() != Schedule::NONE) {
         if (schedules[i].check(now)) {
-          if ((scheduleButtons[i] >= 0) && (scheduleButtons[i] < BUTTON_ROWS * BUTTON_COLS)) {
+          if ((scheduleButtons[i] >= 0) && (scheduleButtons[i] < MACRO_BASE + MAX_MACROS)) {
             logDateTime(now);
             _log->print(F(" schedule \""));
             _log->print(schedules[i]);
             _log->println(F("\" triggered"));
-            sendButtonCode(scheduleButtons[i]);
+            triggerButton(scheduleButtons[i]);
           }
         }
       }
@@ -199,13 +425,13 @@ String ESPIRBlaster::getHostName() {
   return result;
 }
 
-bool ESPIRBlaster::readConfig(uint16_t &offset) {
-  if (! ESPWebMQTTBase::readConfig(offset))
+bool ESPIRBlaster::readEEPROMConfig(uint16_t &offset) {
+  if (! ESPWebMQTTBase::readEEPROMConfig(offset))
     return false;
 
   uint16_t start = offset;
 
-  if (! readSchedulesConfig(offset)) {
+  if (! readEEPROMSchedules(offset)) {
     _log->println(F("Error reading schedules configuration!"));
     defaultConfig(2);
     return false;
@@ -218,35 +444,44 @@ bool ESPIRBlaster::readConfig(uint16_t &offset) {
     return false;
   }
 
-  if (! readIRButtons()) {
-    _log->println(F("Unable to read IR buttons configuration file!"));
-    clearIRButtons();
-  }
+  loadIRButtons();
 
   return true;
 }
 
-bool ESPIRBlaster::writeConfig(uint16_t &offset, bool commit) {
-  if (! ESPWebMQTTBase::writeConfig(offset, false))
+bool ESPIRBlaster::readConfig() {
+  if (! ESPWebMQTTBase::readConfig())
     return false;
 
-  uint16_t start = offset;
+  readSchedulesConfig();
+  readMacrosConfig();
+  loadIRButtons();
+
+  return true;
+}
+
+bool ESPIRBlaster::writeConfig(bool commit) {
+  if (! ESPWebMQTTBase::writeConfig(false))
+    return false;
 
-  if (! writeSchedulesConfig(offset)) {
+  if (! writeSchedulesConfig()) {
     _log->println(F("Error writing schedules configuration!"));
     return false;
   }
-
-  uint8_t crc = crc8EEPROM(start, offset);
-  if (! writeEEPROM(offset, crc)) {
-    _log->println(F("Error writing CRC!"));
+  if (! writeMacrosConfig()) {
+    _log->println(F("Error writing macros configuration!"));
     return false;
   }
 
-  if (commit)
-    commitConfig();
+  if (commit && (! commitConfig()))
+    return false;
 
-  if (! writeIRButtons()) {
+  if (! _buttonsDirty) {
+    ++_buttonsSkips;
+  } else if (writeIRButtons()) {
+    _buttonsDirty = false;
+    ++_buttonsWrites;
+  } else {
     _log->println(F("Unable to write IR buttons configuration file!"));
   }
 
@@ -276,31 +511,44 @@ void ESPIRBlaster::defaultConfig(uint8_t level) {
       schedules[i].clear();
       scheduleButtons[i] = -1;
     }
+    memset(macros, 0, sizeof(macros));
 
     clearIRButtons();
+    _buttonsDirty = true;
   }
 }
 
-void ESPIRBlaster::setupHttpServer() {
-  ESPWebMQTTBase::setupHttpServer();
-
-  httpServer->on(String(FPSTR(pathRemote)).c_str(), std::bind(&ESPIRBlaster::handleRemoteConfig, this));
-  httpServer->on(String(FPSTR(pathGetRemote)).c_str(), std::bind(&ESPIRBlaster::handleGetRemote, this));
-  httpServer->on(String(FPSTR(pathSetRemote)).c_str(), std::bind(&ESPIRBlaster::handleSetRemote, this));
+const httproute_t ESPIRBlaster::httpRoutes[] PROGMEM = {
+  { pathRemote, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleRemoteConfig), NULL },
+  { pathGetRemote, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleGetRemote), NULL },
+  { pathSetRemote, HTTP_POST, HTTP_HANDLER(ESPIRBlaster::handleSetRemote), HTTP_HANDLER(ESPIRBlaster::handleRemoteUpload) },
+  { pathSetRemote, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleSetRemote), NULL },
 #ifdef IRRX_PIN
-  httpServer->on(String(FPSTR(pathRemoteData)).c_str(), std::bind(&ESPIRBlaster::handleRemoteData, this));
+  { pathRemoteData, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleRemoteData), NULL },
 #endif
-  httpServer->on(String(FPSTR(pathIRSend)).c_str(), std::bind(&ESPIRBlaster::handleIRSend, this));
-  httpServer->on(String(FPSTR(pathSchedulesJs)).c_str(), std::bind(&ESPIRBlaster::handleSchedulesJs, this));
-  httpServer->on(String(FPSTR(pathSchedules)).c_str(), std::bind(&ESPIRBlaster::handleSchedulesConfig, this));
-  httpServer->on(String(FPSTR(pathGetSchedule)).c_str(), std::bind(&ESPIRBlaster::handleGetSchedule, this));
-  httpServer->on(String(FPSTR(pathSetSchedule)).c_str(), std::bind(&ESPIRBlaster::handleSetSchedule, this));
+  { pathIRSend, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleIRSend), NULL },
+  { pathSchedulesJs, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleSchedulesJs), NULL },
+  { pathSchedules, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleSchedulesConfig), NULL },
+  { pathGetSchedule, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleGetSchedule), NULL },
+  { pathSetSchedule, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleSetSchedule), NULL },
+  { pathGetMacro, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleGetMacro), NULL },
+  { pathSetMacro, HTTP_ANY, HTTP_HANDLER(ESPIRBlaster::handleSetMacro), NULL }
+};
+
+void ESPIRBlaster::setupHttpServer() {
+  ESPWebMQTTBase::setupHttpServer();
+  _router->add(httpRoutes, sizeof(httpRoutes) / sizeof(httpRoutes[0]));
 }
 
 void ESPIRBlaster::handleRootPage() {
   if (! userAuthenticate())
     return;
 
+  String etag = String(charQuote) + String(_configGeneration, HEX) + String(charSlash) + String((int)WiFi.getMode()) + String(charQuote);
+
+  if (checkETag(etag))
+    return;
+
   String style = F("table {\n\
 border-spacing: 2px;\n\
 }\n\
@@ -410,23 +658,29 @@ Uptime: <span id=\"");
 <table cols=");
   page += String(BUTTON_COLS);
   page += F(">\n");
-  for (uint8_t r = 0; r < BUTTON_ROWS; ++r) {
-    page += F("<tr>");
-    for (uint8_t c = 0; c < BUTTON_COLS; ++c) {
-      if (irbuttons[r * BUTTON_COLS + c].rawBufLen) {
-        page += F("<td class=\"button\" onclick=\"sendIRButton(");
-        page += String(r * BUTTON_COLS + c);
-        page += F(")\">");
-      } else {
-        page += F("<td>");
+  if (! _pageCache->get(CACHE_BUTTONS, _configGeneration, page)) {
+    String grid;
+
+    for (uint8_t r = 0; r < BUTTON_ROWS; ++r) {
+      grid += F("<tr>");
+      for (uint8_t c = 0; c < BUTTON_COLS; ++c) {
+        if (irbuttons[r * BUTTON_COLS + c].rawBufLen) {
+          grid += F("<td class=\"button\" onclick=\"sendIRButton(");
+          grid += String(r * BUTTON_COLS + c);
+          grid += F(")\">");
+        } else {
+          grid += F("<td>");
+        }
+        if (*irbuttons[r * BUTTON_COLS + c].buttonName)
+          grid += escapeQuote(irbuttons[r * BUTTON_COLS + c].buttonName);
+        grid += F("<span class=\"number\">");
+        grid += String(r * BUTTON_COLS + c + 1);
+        grid += F("</span></td>");
       }
-      if (*irbuttons[r * BUTTON_COLS + c].buttonName)
-        page += escapeQuote(irbuttons[r * BUTTON_COLS + c].buttonName);
-      page += F("<span class=\"number\">");
-      page += String(r * BUTTON_COLS + c + 1);
-      page += F("</span></td>");
+      grid += F("</tr>\n");
     }
-    page += F("</tr>\n");
+    _pageCache->put(CACHE_BUTTONS, _configGeneration, grid);
+    page += grid;
   }
   page += F("</table>\n\
 <p>\n");
@@ -514,18 +768,32 @@ refreshData();\n\
 function lostFocus() {\n\
 currentInput=null;\n\
 clearTimeout(timeoutId);\n\
+var request=getXmlHttpRequest();\n\
+request.open('GET', '");
+  script += FPSTR(pathRemoteData);
+  script += F("?");
+  script += FPSTR(paramLearn);
+  script += F("=0&dummy='+Date.now(), true);\n\
+request.send(null);\n\
 }\n");
 #else
   String script = "";
 #endif
-  script += F("function loadData(form) {\n\
+  script += F("var remotes = null;\n\
+function loadData(form) {\n\
+if (! remotes) {\n\
 var request = getXmlHttpRequest();\n\
 request.open('GET', '");
   script += FPSTR(pathGetRemote);
-  script += F("?id=' + form.id.value + '&dummy=' + Date.now(), false);\n\
+  script += F("?");
+  script += FPSTR(paramAll);
+  script += F("&dummy=' + Date.now(), false);\n\
 request.send(null);\n\
-if (request.status == 200) {\n\
-var data = JSON.parse(request.responseText);\n\
+if (request.status == 200)\n\
+remotes = JSON.parse(request.responseText);\n\
+}\n\
+if (remotes && remotes[form.id.value]) {\n\
+var data = remotes[form.id.value];\n\
 form.");
   script += FPSTR(paramRemoteBtnName);
   script += F(".value = data.");
@@ -577,20 +845,26 @@ field.value = maxvalue;\n\
   page += F("<table><caption><h3>Remote Setup</h3></caption>\n\
 <tr><th>#</th><th>Button name</th><th>Repeat</th><th>Gap</th><th>Raw length</th></tr>\n");
 
-  for (i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
-    page += F("<tr><td><a href=\"#\" onclick=\"openForm(document.form, ");
-    page += String(i);
-    page += F(")\">");
-    page += String(i + 1);
-    page += F("</a></td><td>");
-    page += escapeQuote(irbuttons[i].buttonName);
-    page += F("</td><td>");
-    page += String(irbuttons[i].repeat + 1);
-    page += F("</td><td>");
-    page += String(irbuttons[i].gap);
-    page += F("</td><td>");
-    page += String(irbuttons[i].rawBufLen);
-    page += F("</td></tr>\n");
+  if (! _pageCache->get(CACHE_REMOTES, _configGeneration, page)) {
+    String rows;
+
+    for (i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
+      rows += F("<tr><td><a href=\"#\" onclick=\"openForm(document.form, ");
+      rows += String(i);
+      rows += F(")\">");
+      rows += String(i + 1);
+      rows += F("</a></td><td>");
+      rows += escapeQuote(irbuttons[i].buttonName);
+      rows += F("</td><td>");
+      rows += String(irbuttons[i].repeat + 1);
+      rows += F("</td><td>");
+      rows += String(irbuttons[i].gap);
+      rows += F("</td><td>");
+      rows += String(irbuttons[i].rawBufLen);
+      rows += F("</td></tr>\n");
+    }
+    _pageCache->put(CACHE_REMOTES, _configGeneration, rows);
+    page += rows;
   }
   page += F("</table>\n\
 <p>\n\
@@ -636,38 +910,36 @@ field.value = maxvalue;\n\
 }
 
 void ESPIRBlaster::handleGetRemote() {
+  if (httpServer->hasArg(FPSTR(paramAll)) && httpServer->hasArg(FPSTR(paramBinary))) { // Все кнопки в формате файла
+    WiFiClient client = httpServer->client();
+
+    httpServer->setContentLength(buttonsStreamSize());
+    httpServer->send(200, FPSTR(applicationOctetStream), strEmpty);
+    writeButtonsStream(client);
+    return;
+  }
+  if (httpServer->hasArg(FPSTR(paramAll))) { // Все кнопки одним ответом
+    httpServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    httpServer->send(200, FPSTR(textJson), strEmpty);
+    for (uint8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
+      String page;
+
+      page += i ? charComma : '[';
+      page += remoteJson(i);
+      httpServer->sendContent(page);
+    }
+    httpServer->sendContent(F("]"));
+    httpServer->sendContent(strEmpty);
+    return;
+  }
+
   int id = -1;
 
   if (httpServer->hasArg("id"))
     id = httpServer->arg("id").toInt();
 
   if ((id >= 0) && (id < BUTTON_COLS * BUTTON_ROWS)) {
-    String page;
-
-    page += charOpenBrace;
-    page += charQuote;
-    page += FPSTR(paramRemoteBtnName);
-    page += F("\":\"");
-    page += irbuttons[id].buttonName;
-    page += F("\",\"");
-    page += FPSTR(paramRemoteBtnCode);
-    page += F("\":\"");
-    for (uint16_t i = 0; i < irbuttons[id].rawBufLen; ++i) {
-      if (i)
-        page += charComma;
-      page += String(irbuttons[id].rawBuf[i]);
-    }
-    page += F("\",\"");
-    page += FPSTR(paramRemoteBtnRepeat);
-    page += F("\":");
-    page += String(irbuttons[id].repeat + 1);
-    page += F(",\"");
-    page += FPSTR(paramRemoteBtnGap);
-    page += F("\":");
-    page += String(irbuttons[id].gap);
-    page += charCloseBrace;
-
-    httpServer->send(200, FPSTR(textJson), page);
+    httpServer->send(200, FPSTR(textJson), remoteJson(id));
   } else {
     httpServer->send(204, FPSTR(textJson), strEmpty); // No content
   }
@@ -676,46 +948,71 @@ void ESPIRBlaster::handleGetRemote() {
 void ESPIRBlaster::handleSetRemote() {
   String argName, argValue;
   int8_t id = -1;
+  uint8_t count = 0;
+  bool all = httpServer->hasArg(FPSTR(paramAll));
+  rawcode_error_t error = RAWCODE_OK;
   irbutton_t irbutton;
+  irbutton_t *pending = NULL; // Кнопки группового запроса применяются только после разбора всего запроса
+  uint32_t pendingMask = 0;
 
-  memset(&irbutton, 0, sizeof(irbutton_t));
-  for (byte i = 0; i < httpServer->args(); i++) {
+  if (all)
+    pending = new (std::nothrow) irbutton_t[BUTTON_COLS * BUTTON_ROWS];
+  for (byte i = 0; (error == RAWCODE_OK) && (i < httpServer->args()); i++) {
     argName = httpServer->argName(i);
     argValue = httpServer->arg(i);
     if (argName.equals("id")) {
-      id = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramRemoteBtnName))) {
-      strncpy(irbutton.buttonName, argValue.c_str(), sizeof(irbutton.buttonName) - 1);
-    } else if (argName.equals(FPSTR(paramRemoteBtnCode))) {
-      uint16_t j = 0, l = argValue.length();
-
-      while ((j < l) && ((argValue[j] < '0') || (argValue[j] > '9'))) // Skip leading delimiter(s)
-        ++j;
-      while (j < l) {
-        while ((j < l) && ((argValue[j] >= '0') && (argValue[j] <= '9'))) {
-          irbutton.rawBuf[irbutton.rawBufLen] *= 10;
-          irbutton.rawBuf[irbutton.rawBufLen] += (argValue[j] - '0');
-          ++j;
+      if (pending) { // Каждый следующий "id" начинает новую кнопку
+        if ((id >= 0) && (id < BUTTON_COLS * BUTTON_ROWS)) {
+          pending[id].swap(irbutton);
+          pendingMask |= (1UL << id);
         }
-        if (++irbutton.rawBufLen >= IR_CAPTURE_BUFFER_SIZE)
-          break;
-        while ((j < l) && ((argValue[j] < '0') || (argValue[j] > '9'))) // Skip delimiter(s)
-          ++j;
+        irbutton.clear();
       }
-    } else if (argName.equals(FPSTR(paramRemoteBtnRepeat))) {
-      irbutton.repeat = constrain(argValue.toInt(), 1, 16) - 1;
-    } else if (argName.equals(FPSTR(paramRemoteBtnGap))) {
-      irbutton.gap = constrain(argValue.toInt(), 0, 4095);
-    } else {
+      id = argValue.toInt();
+    } else if (argName.equals(FPSTR(paramAll))) {
+      // Skip
+    } else if (! setButtonParam(irbutton, argName, argValue, error)) {
       _log->print(F("Unknown parameter \""));
       _log->print(argName);
       _log->print(F("\"!"));
     }
   }
+  if (_uploadParser) {
+    rawcode_error_t uploadError = finishRemoteUpload(irbutton);
 
-  if ((id >= 0) && (id < BUTTON_COLS * BUTTON_ROWS)) {
-    memcpy(&irbuttons[id], &irbutton, sizeof(irbutton_t));
+    if (error == RAWCODE_OK)
+      error = uploadError;
+  }
 
+  if (all && (! pending)) {
+    httpServer->send(500, FPSTR(textPlain), F("Not enough memory!"));
+  } else if (error != RAWCODE_OK) {
+    httpServer->send(400, FPSTR(textPlain), rawCodeErrorStr(error));
+  } else if (all) {
+    uint32_t total = 0;
+
+    if ((id >= 0) && (id < BUTTON_COLS * BUTTON_ROWS)) {
+      pending[id].swap(irbutton);
+      pendingMask |= (1UL << id);
+    }
+    for (int8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i)
+      total += (pendingMask & (1UL << i)) ? pending[i].rawBufLen : irbuttons[i].rawBufLen;
+    if (total > IR_BUTTONS_RAW_MAX) {
+      httpServer->send(400, FPSTR(textPlain), F("Total length of IR codes too big!"));
+      delete[] pending;
+      return;
+    }
+    for (int8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
+      if ((pendingMask & (1UL << i)) && storeButton(i, pending[i]))
+        ++count;
+    }
+    if (count && (! storeConfig()))
+      httpServer->send(500, FPSTR(textPlain), F("Error storing configuration!"));
+    else
+      httpServer->send(200, FPSTR(textPlain), String(count));
+  } else if ((id >= 0) && (id < BUTTON_COLS * BUTTON_ROWS) && (buttonsRawLength() - irbuttons[id].rawBufLen + irbutton.rawBufLen > IR_BUTTONS_RAW_MAX)) {
+    httpServer->send(400, FPSTR(textPlain), F("Total length of IR codes too big!"));
+  } else if (storeButton(id, irbutton)) {
     String page = ESPWebBase::webPageStart(F("Store IR Button"));
     page += F("<meta http-equiv=\"refresh\" content=\"1;URL=");
     page += FPSTR(pathRemote);
@@ -730,13 +1027,29 @@ Wait for 1 sec. to return to previous page.\n");
   } else {
     httpServer->send(204, FPSTR(textHtml), strEmpty);
   }
+  if (pending)
+    delete[] pending;
 }
 
 #ifdef IRRX_PIN
 void ESPIRBlaster::handleRemoteData() {
   static uint32_t lastTime = 0;
 
-  if ((! rawBufLen) || (millis() - lastTime > 1000)) {
+  if (httpServer->hasArg(FPSTR(paramLearn)) && (! httpServer->arg(FPSTR(paramLearn)).toInt())) {
+    stopLearning();
+    httpServer->send(204, FPSTR(textJson), strEmpty); // No content
+    return;
+  }
+  if (! _learnBuf) { // Запрос данных подразумевает режим обучения
+    if (! startLearning()) {
+      httpServer->send(503, FPSTR(textPlain), F("Not enough memory for learning!"));
+      return;
+    }
+    lastTime = millis();
+  }
+  _learnTime = millis();
+
+  if ((! _learnLen) || (millis() - lastTime > 1000)) {
     httpServer->send(204, FPSTR(textJson), strEmpty); // No content
   } else {
     String page;
@@ -745,10 +1058,11 @@ void ESPIRBlaster::handleRemoteData() {
     page += charQuote;
     page += FPSTR(jsonRemoteCode);
     page += F("\":\"");
-    for (uint16_t i = 0; i < rawBufLen; ++i) {
+    page.reserve(page.length() + _learnLen * 6 + 2);
+    for (uint16_t i = 0; i < _learnLen; ++i) {
       if (i)
         page += charComma;
-      page += String(rawBuf[i]);
+      page += String(_learnBuf[i]);
     }
     page += charQuote;
     page += charCloseBrace;
@@ -756,7 +1070,7 @@ void ESPIRBlaster::handleRemoteData() {
     httpServer->send(200, FPSTR(textJson), page);
   }
 
-  rawBufLen = 0;
+  _learnLen = 0;
   lastTime = millis();
 }
 #endif
@@ -764,24 +1078,55 @@ void ESPIRBlaster::handleRemoteData() {
 void ESPIRBlaster::handleIRSend() {
   int8_t btn = -1;
 
-  if (httpServer->hasArg(F("btn")))
-    btn = httpServer->arg(F("btn")).toInt();
-  if ((btn >= 0) && (btn < BUTTON_COLS * BUTTON_ROWS) && irbuttons[btn].rawBufLen) {
-    sendButtonCode(btn);
+  if (httpServer->hasArg(FPSTR(paramIRButton))) {
+    btn = httpServer->arg(FPSTR(paramIRButton)).toInt();
+  } else if (httpServer->hasArg(FPSTR(paramIRButtonName))) {
+    String name = httpServer->arg(FPSTR(paramIRButtonName));
+
+    btn = findButton(name.c_str(), name.length());
+    if (btn < 0) {
+      httpServer->send(404, FPSTR(textPlain), F("IR button not found"));
+      return;
+    }
+  } else if (httpServer->hasArg(FPSTR(paramIRCode)) || httpServer->hasArg(FPSTR(paramPlain))) {
+    String code = httpServer->arg(httpServer->hasArg(FPSTR(paramIRCode)) ? FPSTR(paramIRCode) : FPSTR(paramPlain));
+
+    if (irSendBusy()) {
+      httpServer->send(503, FPSTR(textPlain), F("IR transmitter busy"));
+      return;
+    }
+
+    rawcode_error_t error = parseIRSend((const uint8_t*)code.c_str(), code.length());
+
+    if (error != RAWCODE_OK) {
+      httpServer->send(400, FPSTR(textPlain), rawCodeErrorStr(error));
+      return;
+    }
+    _irSendPending = true;
+  }
+  if (buttonDefined(btn)) {
+    triggerButton(btn);
   }
 
   httpServer->send(200, FPSTR(textPlain), strEmpty);
 }
 
 void ESPIRBlaster::handleSchedulesJs() {
-  String script = F("function loadData(form) {\n\
+  String script = F("var schedules = null;\n\
+function loadData(form) {\n\
+if (! schedules) {\n\
 var request = getXmlHttpRequest();\n\
 request.open('GET', '");
   script += FPSTR(pathGetSchedule);
-  script += F("?id=' + form.id.value + '&dummy=' + Date.now(), false);\n\
+  script += F("?");
+  script += FPSTR(paramAll);
+  script += F("&dummy=' + Date.now(), false);\n\
 request.send(null);\n\
-if (request.status == 200) {\n\
-var data = JSON.parse(request.responseText);\n\
+if (request.status == 200)\n\
+schedules = JSON.parse(request.responseText);\n\
+}\n\
+if (schedules && schedules[form.id.value]) {\n\
+var data = schedules[form.id.value];\n\
 form.");
   script += FPSTR(paramSchedulePeriod);
   script += F(".value = data.");
@@ -1035,27 +1380,39 @@ display: none;\n\
   page += F("<table><caption><h3>Schedules Setup</h3></caption>\n\
 <tr><th>#</th><th>Event</th><th>Next time</th><th>IR button #</th></tr>\n");
 
-  for (i = 0; i < MAX_SCHEDULES; ++i) {
-    page += F("<tr><td><a href=\"#\" onclick=\"openForm(document.form, ");
-    page += String(i);
-    page += F(")\">");
-    page += String(i + 1);
-    page += F("</a></td><td>");
-    page += schedules[i];
-    page += F("</td><td>");
-    page += schedules[i].nextTimeStr();
-    page += F("</td><td>");
-    if (schedules[i].period() != Schedule::NONE) {
-      if (scheduleButtons[i] >= 0) {
-        page += String(scheduleButtons[i] + 1);
-        if (*irbuttons[scheduleButtons[i]].buttonName) {
-          page += F(" (");
-          page += escapeQuote(irbuttons[scheduleButtons[i]].buttonName);
-          page += ')';
+  if (! _pageCache->get(CACHE_SCHEDULES, schedulesKey(), page)) {
+    String rows;
+
+    for (i = 0; i < MAX_SCHEDULES; ++i) {
+      rows += F("<tr><td><a href=\"#\" onclick=\"openForm(document.form, ");
+      rows += String(i);
+      rows += F(")\">");
+      rows += String(i + 1);
+      rows += F("</a></td><td>");
+      rows += schedules[i];
+      rows += F("</td><td>");
+      rows += schedules[i].nextTimeStr();
+      rows += F("</td><td>");
+      if (schedules[i].period() != Schedule::NONE) {
+        int8_t btn = scheduleButtons[i];
+
+        if ((btn >= 0) && (btn < MACRO_BASE + MAX_MACROS)) { // Кнопка ДУ или макрос, как в списке выбора
+          if (btn >= MACRO_BASE) {
+            rows += F("Macro ");
+            rows += String(btn - MACRO_BASE + 1);
+          } else
+            rows += String(btn + 1);
+          if (*buttonName(btn)) {
+            rows += F(" (");
+            rows += escapeQuote(buttonName(btn));
+            rows += ')';
+          }
         }
       }
+      rows += F("</td></tr>\n");
     }
-    page += F("</td></tr>\n");
+    _pageCache->put(CACHE_SCHEDULES, schedulesKey(), rows);
+    page += rows;
   }
   page += F("</table>\n\
 <p>\n\
@@ -1151,20 +1508,40 @@ day\n\
   page += FPSTR(strNone);
   page += F("</option>\n");
 
-  for (i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
-    page += F("<option value=\"");
-    page += String(i);
-    if (! irbuttons[i].rawBufLen)
-      page += F("\" disabled>");
-    else
-      page += F("\">");
-    page += String(i + 1);
-    if (*irbuttons[i].buttonName) {
-      page += F(" (");
-      page += escapeQuote(irbuttons[i].buttonName);
-      page += ')';
+  if (! _pageCache->get(CACHE_BUTTONOPTIONS, _configGeneration, page)) {
+    String options;
+
+    for (i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
+      options += F("<option value=\"");
+      options += String(i);
+      if (! irbuttons[i].rawBufLen)
+        options += F("\" disabled>");
+      else
+        options += F("\">");
+      options += String(i + 1);
+      if (*irbuttons[i].buttonName) {
+        options += F(" (");
+        options += escapeQuote(irbuttons[i].buttonName);
+        options += ')';
+      }
+      options += F("</option>\n");
     }
-    page += F("</option>\n");
+    for (i = 0; i < MAX_MACROS; ++i) {
+      if (macros[i].count) {
+        options += F("<option value=\"");
+        options += String(MACRO_BASE + i);
+        options += F("\">Macro ");
+        options += String(i + 1);
+        if (*macros[i].name) {
+          options += F(" (");
+          options += escapeQuote(macros[i].name);
+          options += ')';
+        }
+        options += F("</option>\n");
+      }
+    }
+    _pageCache->put(CACHE_BUTTONOPTIONS, _configGeneration, options);
+    page += options;
   }
   page += F("</select>\n\
 </div>\n\
@@ -1179,54 +1556,28 @@ day\n\
 }
 
 void ESPIRBlaster::handleGetSchedule() {
+  if (httpServer->hasArg(FPSTR(paramAll))) { // Все элементы расписания одним ответом
+    httpServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    httpServer->send(200, FPSTR(textJson), strEmpty);
+    for (int8_t i = 0; i < MAX_SCHEDULES; ++i) {
+      String page;
+
+      page += i ? charComma : '[';
+      page += scheduleJson(i);
+      httpServer->sendContent(page);
+    }
+    httpServer->sendContent(F("]"));
+    httpServer->sendContent(strEmpty);
+    return;
+  }
+
   int id = -1;
 
   if (httpServer->hasArg("id"))
     id = httpServer->arg("id").toInt();
 
   if ((id >= 0) && (id < MAX_SCHEDULES)) {
-    String page;
-
-    page += charOpenBrace;
-    page += charQuote;
-    page += FPSTR(paramSchedulePeriod);
-    page += F("\":");
-    page += String(schedules[id].period());
-    page += F(",\"");
-    page += FPSTR(paramScheduleHour);
-    page += F("\":");
-    page += String(schedules[id].hour());
-    page += F(",\"");
-    page += FPSTR(paramScheduleMinute);
-    page += F("\":");
-    page += String(schedules[id].minute());
-    page += F(",\"");
-    page += FPSTR(paramScheduleSecond);
-    page += F("\":");
-    page += String(schedules[id].second());
-    page += F(",\"");
-    page += FPSTR(paramScheduleWeekdays);
-    page += F("\":");
-    page += String(schedules[id].weekdays());
-    page += F(",\"");
-    page += FPSTR(paramScheduleDay);
-    page += F("\":");
-    page += String(schedules[id].day());
-    page += F(",\"");
-    page += FPSTR(paramScheduleMonth);
-    page += F("\":");
-    page += String(schedules[id].month());
-    page += F(",\"");
-    page += FPSTR(paramScheduleYear);
-    page += F("\":");
-    page += String(schedules[id].year());
-    page += F(",\"");
-    page += FPSTR(paramScheduleIRButton);
-    page += F("\":");
-    page += String(scheduleButtons[id]);
-    page += charCloseBrace;
-
-    httpServer->send(200, FPSTR(textJson), page);
+    httpServer->send(200, FPSTR(textJson), scheduleJson(id));
   } else {
     httpServer->send(204, FPSTR(textJson), strEmpty); // No content
   }
@@ -1235,53 +1586,48 @@ void ESPIRBlaster::handleGetSchedule() {
 void ESPIRBlaster::handleSetSchedule() {
   String argName, argValue;
   int8_t id = -1;
-  Schedule::period_t period = Schedule::NONE;
-  int8_t hour = -1;
-  int8_t minute = -1;
-  int8_t second = -1;
-  uint8_t weekdays = 0;
-  int8_t day = 0;
-  int8_t month = 0;
-  int16_t year = 0;
-  int8_t button = -1;
+  uint8_t count = 0;
+  bool all = httpServer->hasArg(FPSTR(paramAll));
+  scheduleparams_t params;
+  scheduleparams_t pending[MAX_SCHEDULES]; // Элементы группового запроса применяются только после разбора всего запроса
+  uint16_t pendingMask = 0;
 
+  clearScheduleParams(params);
   for (byte i = 0; i < httpServer->args(); i++) {
     argName = httpServer->argName(i);
     argValue = httpServer->arg(i);
     if (argName.equals("id")) {
+      if (all) { // Каждый следующий "id" начинает новый элемент расписания
+        if ((id >= 0) && (id < MAX_SCHEDULES)) {
+          pending[id] = params;
+          pendingMask |= (1 << id);
+        }
+        clearScheduleParams(params);
+      }
       id = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramSchedulePeriod))) {
-      period = (Schedule::period_t)argValue.toInt();
-    } else if (argName.equals(FPSTR(paramScheduleHour))) {
-      hour = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramScheduleMinute))) {
-      minute = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramScheduleSecond))) {
-      second = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramScheduleWeekdays))) {
-      weekdays = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramScheduleDay))) {
-      day = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramScheduleMonth))) {
-      month = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramScheduleYear))) {
-      year = argValue.toInt();
-    } else if (argName.equals(FPSTR(paramScheduleIRButton))) {
-      button = constrain(argValue.toInt(), -1, BUTTON_COLS * BUTTON_ROWS - 1);
-    } else {
+    } else if (argName.equals(FPSTR(paramAll))) {
+      // Skip
+    } else if (! setScheduleParam(params, argName, argValue)) {
       _log->print(F("Unknown parameter \""));
       _log->print(argName);
       _log->print(F("\"!"));
     }
   }
 
-  if ((id >= 0) && (id < MAX_SCHEDULES)) {
-    if (period == Schedule::NONE)
-      schedules[id].clear();
+  if (all) {
+    if ((id >= 0) && (id < MAX_SCHEDULES)) {
+      pending[id] = params;
+      pendingMask |= (1 << id);
+    }
+    for (int8_t i = 0; i < MAX_SCHEDULES; ++i) {
+      if ((pendingMask & (1 << i)) && storeSchedule(i, pending[i]))
+        ++count;
+    }
+    if (count && (! storeConfig()))
+      httpServer->send(500, FPSTR(textPlain), F("Error storing configuration!"));
     else
-      schedules[id].set(period, hour, minute, second, weekdays, day, month, year);
-    scheduleButtons[id] = button;
-
+      httpServer->send(200, FPSTR(textPlain), String(count));
+  } else if (storeSchedule(id, params)) {
     String page = ESPWebBase::webPageStart(F("Store Schedule"));
     page += F("<meta http-equiv=\"refresh\" content=\"1;URL=");
     page += FPSTR(pathSchedules);
@@ -1298,6 +1644,49 @@ Wait for 1 sec. to return to previous page.\n");
   }
 }
 
+void ESPIRBlaster::handleGetMacro() {
+  if (httpServer->hasArg(FPSTR(paramAll))) { // Все макросы одним ответом
+    httpServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    httpServer->send(200, FPSTR(textJson), strEmpty);
+    for (int8_t i = 0; i < MAX_MACROS; ++i) {
+      String page;
+
+      page += i ? charComma : '[';
+      page += macroJson(i);
+      httpServer->sendContent(page);
+    }
+    httpServer->sendContent(F("]"));
+    httpServer->sendContent(strEmpty);
+    return;
+  }
+
+  int id = -1;
+
+  if (httpServer->hasArg("id"))
+    id = httpServer->arg("id").toInt();
+
+  if ((id >= 0) && (id < MAX_MACROS)) {
+    httpServer->send(200, FPSTR(textJson), macroJson(id));
+  } else {
+    httpServer->send(204, FPSTR(textJson), strEmpty); // No content
+  }
+}
+
+void ESPIRBlaster::handleSetMacro() {
+  int8_t id = -1;
+
+  if (httpServer->hasArg("id"))
+    id = httpServer->arg("id").toInt();
+
+  if (! storeMacro(id, httpServer->arg(FPSTR(paramMacroName)), httpServer->arg(FPSTR(paramMacroSteps)))) {
+    httpServer->send(400, FPSTR(textPlain), F("Wrong macro parameters!"));
+  } else if (! storeConfig()) {
+    httpServer->send(500, FPSTR(textPlain), F("Error storing configuration!"));
+  } else {
+    httpServer->send(200, FPSTR(textJson), macroJson(id));
+  }
+}
+
 String ESPIRBlaster::navigator() {
   String result = btnWiFiConfig();
   result += btnTimeConfig();
@@ -1324,36 +1713,188 @@ String ESPIRBlaster::btnSchedulesConfig() {
   return result;
 }
 
-void ESPIRBlaster::mqttCallback(char *topic, byte *payload, unsigned int length) {
-  ESPWebMQTTBase::mqttCallback(topic, payload, length);
+String ESPIRBlaster::jsonData() {
+  String result = ESPWebMQTTBase::jsonData();
+  result += F(",\"");
+  result += FPSTR(jsonButtonsWrites);
+  result += F("\":");
+  result += String(_buttonsWrites);
+  result += F(",\"");
+  result += FPSTR(jsonButtonsSkips);
+  result += F("\":");
+  result += String(_buttonsSkips);
+#ifdef IRRX_PIN
+  result += F(",\"");
+  result += FPSTR(jsonIRHashHits);
+  result += F("\":");
+  result += String(_irMatcher->hashHits());
+  result += F(",\"");
+  result += FPSTR(jsonIRScans);
+  result += F("\":");
+  result += String(_irMatcher->scans());
+  result += F(",\"");
+  result += FPSTR(jsonIREchoes);
+  result += F("\":");
+  result += String(_echoes);
+  result += F(",\"");
+  result += FPSTR(jsonIRTimeout);
+  result += F("\":");
+  result += String(receiverTimeout());
+  result += F(",\"");
+  result += FPSTR(jsonIRLatencyEstimate);
+  result += F("\":");
+  result += String(_irLatencyEstimate);
+  result += F(",\"");
+  result += FPSTR(jsonIRLearning);
+  result += F("\":");
+  result += FPSTR(_learnBuf ? bools[1] : bools[0]);
+#endif
 
-  char* topicBody = topic + strlen(_mqttClient) + 1; // Skip "/ClientName" from topic
-  if (! strcmp_P(topicBody, mqttRemoteBtnTopic)) {
-    int8_t btn = -1;
+  return result;
+}
 
-    if (length)
-      btn = atoi((char*)payload);
-    if ((btn > 0) && (btn <= BUTTON_COLS * BUTTON_ROWS)) {
-      sendButtonCode(btn - 1);
-    } else
-      _log->println(F("Wrong IR button index!"));
-  } else {
-    _log->println(F("Unexpected topic!"));
+uint32_t ESPIRBlaster::schedulesKey() {
+  uint32_t result = _configGeneration;
+
+  for (int8_t i = 0; i < MAX_SCHEDULES; ++i)
+    result = result * 31 + schedules[i].nextTime();
+
+  return result;
+}
+
+String ESPIRBlaster::remoteJson(uint8_t id) {
+  String result;
+
+  result += charOpenBrace;
+  result += charQuote;
+  result += FPSTR(paramRemoteBtnName);
+  result += F("\":\"");
+  result += escapeJson(irbuttons[id].buttonName);
+  result += F("\",\"");
+  result += FPSTR(paramRemoteBtnCode);
+  result += F("\":\"");
+  for (uint16_t i = 0; i < irbuttons[id].rawBufLen; ++i) {
+    if (i)
+      result += charComma;
+    result += String(irbuttons[id].rawBuf[i]);
+  }
+  result += F("\",\"");
+  result += FPSTR(paramRemoteBtnRepeat);
+  result += F("\":");
+  result += String(irbuttons[id].repeat + 1);
+  result += F(",\"");
+  result += FPSTR(paramRemoteBtnGap);
+  result += F("\":");
+  result += String(irbuttons[id].gap);
+  result += charCloseBrace;
+
+  return result;
+}
+
+String ESPIRBlaster::scheduleJson(int8_t id) {
+  String result;
+
+  result += charOpenBrace;
+  result += charQuote;
+  result += FPSTR(paramSchedulePeriod);
+  result += F("\":");
+  result += String(schedules[id].period());
+  result += F(",\"");
+  result += FPSTR(paramScheduleHour);
+  result += F("\":");
+  result += String(schedules[id].hour());
+  result += F(",\"");
+  result += FPSTR(paramScheduleMinute);
+  result += F("\":");
+  result += String(schedules[id].minute());
+  result += F(",\"");
+  result += FPSTR(paramScheduleSecond);
+  result += F("\":");
+  result += String(schedules[id].second());
+  result += F(",\"");
+  result += FPSTR(paramScheduleWeekdays);
+  result += F("\":");
+  result += String(schedules[id].weekdays());
+  result += F(",\"");
+  result += FPSTR(paramScheduleDay);
+  result += F("\":");
+  result += String(schedules[id].day());
+  result += F(",\"");
+  result += FPSTR(paramScheduleMonth);
+  result += F("\":");
+  result += String(schedules[id].month());
+  result += F(",\"");
+  result += FPSTR(paramScheduleYear);
+  result += F("\":");
+  result += String(schedules[id].year());
+  result += F(",\"");
+  result += FPSTR(paramScheduleIRButton);
+  result += F("\":");
+  result += String(scheduleButtons[id]);
+  result += charCloseBrace;
+
+  return result;
+}
+
+String ESPIRBlaster::macroJson(int8_t id) {
+  String result;
+
+  result += charOpenBrace;
+  result += charQuote;
+  result += FPSTR(paramMacroName);
+  result += F("\":\"");
+  result += escapeJson(macros[id].name);
+  result += F("\",\"");
+  result += FPSTR(paramMacroSteps);
+  result += F("\":\"");
+  for (uint8_t i = 0; i < macros[id].count; ++i) {
+    if (i)
+      result += charComma;
+    result += String(macros[id].buttons[i]);
+    result += charColon;
+    result += String(macros[id].delays[i]);
+  }
+  result += charQuote;
+  result += charCloseBrace;
+
+  return result;
+}
+
+void ESPIRBlaster::mqttButtonHandler(const char *topic, const uint8_t *payload, uint16_t length) {
+  int16_t btn = 0;
+
+  (void)topic;
+  for (uint16_t i = 0; (i < length) && (btn <= MACRO_BASE + MAX_MACROS); ++i) { // Значение топика не завершается нулем
+    if ((payload[i] < '0') || (payload[i] > '9')) { // Не номер, а имя кнопки
+      btn = findButton((const char*)payload, length) + 1;
+      break;
+    }
+    btn = btn * 10 + payload[i] - '0';
   }
+  if ((btn > 0) && (btn <= MACRO_BASE + MAX_MACROS)) {
+    triggerButton(btn - 1);
+  } else
+    _log->println(F("Wrong IR button index!"));
 }
 
-void ESPIRBlaster::mqttResubscribe() {
-  String topic;
+void ESPIRBlaster::mqttSendHandler(const char *topic, const uint8_t *payload, uint16_t length) {
+  (void)topic;
+  if (irSendBusy()) {
+    _log->println(F("IR transmitter busy, MQTT code ignored!"));
+    return;
+  }
+
+  rawcode_error_t error = parseIRSend(payload, length);
 
-  if (_mqttClient != strEmpty) {
-    topic += charSlash;
-    topic += _mqttClient;
+  if (error == RAWCODE_OK) {
+    _irSendPending = true;
+  } else {
+    _log->print(F("Wrong MQTT IR code: "));
+    _log->println(rawCodeErrorStr(error));
   }
-  topic += FPSTR(mqttRemoteBtnTopic);
-  mqttSubscribe(topic);
 }
 
-bool ESPIRBlaster::readSchedulesConfig(uint16_t &offset) {
+bool ESPIRBlaster::readEEPROMSchedules(uint16_t &offset) {
   Schedule::period_t period;
   int8_t hour;
   int8_t minute;
@@ -1364,18 +1905,16 @@ bool ESPIRBlaster::readSchedulesConfig(uint16_t &offset) {
   int16_t year;
 
   for (int8_t i = 0; i < MAX_SCHEDULES; ++i) {
-    if ((! readEEPROM(offset, (uint8_t*)&period, sizeof(period))) || (! readEEPROM(offset, (uint8_t*)&hour, sizeof(hour))) ||
-      (! readEEPROM(offset, (uint8_t*)&minute, sizeof(minute))) || (! readEEPROM(offset, (uint8_t*)&second, sizeof(second))))
+    if (! getEEPROM(offset, period, hour, minute, second))
       return false;
     if (period == Schedule::WEEKLY) {
-      if (! readEEPROM(offset, (uint8_t*)&weekdays, sizeof(weekdays)))
+      if (! getEEPROM(offset, weekdays))
         return false;
     } else {
-      if ((! readEEPROM(offset, (uint8_t*)&day, sizeof(day))) || (! readEEPROM(offset, (uint8_t*)&month, sizeof(month))) ||
-        (! readEEPROM(offset, (uint8_t*)&year, sizeof(year))))
+      if (! getEEPROM(offset, day, month, year))
         return false;
     }
-    if (! readEEPROM(offset, (uint8_t*)&scheduleButtons[i], sizeof(scheduleButtons[i])))
+    if (! getEEPROM(offset, scheduleButtons[i]))
       return false;
 
     if (period == Schedule::NONE)
@@ -1387,154 +1926,699 @@ bool ESPIRBlaster::readSchedulesConfig(uint16_t &offset) {
   return true;
 }
 
-bool ESPIRBlaster::writeSchedulesConfig(uint16_t &offset) {
-  Schedule::period_t period;
-  int8_t hour;
-  int8_t minute;
-  int8_t second;
-  uint8_t weekdays;
-  int8_t day;
-  int8_t month;
-  int16_t year;
+bool ESPIRBlaster::readSchedulesConfig() {
+  for (int8_t i = 0; i < MAX_SCHEDULES; ++i) {
+    String key = FPSTR(configSchedule);
+    uint8_t data[SCHEDULE_RECORD_SIZE];
+    uint16_t len;
+
+    key += String(i);
+    len = _config->length(key);
+    if (len > sizeof(data))
+      len = sizeof(data); // Запись более новой версии, лишние поля игнорируются
+    if (len && _config->get(key, data, len))
+      decodeSchedule(i, data, len);
+  }
+
+  return true;
+}
 
+bool ESPIRBlaster::writeSchedulesConfig() {
   for (int8_t i = 0; i < MAX_SCHEDULES; ++i) {
-    period = schedules[i].period();
-    hour = schedules[i].hour();
-    minute = schedules[i].minute();
-    second = schedules[i].second();
-    if (period == Schedule::WEEKLY) {
-      weekdays = schedules[i].weekdays();
-    } else {
-      day = schedules[i].day();
-      month = schedules[i].month();
-      year = schedules[i].year();
-    }
+    String key = FPSTR(configSchedule);
+    uint8_t data[SCHEDULE_RECORD_SIZE];
 
-    if ((! writeEEPROM(offset, (uint8_t*)&period, sizeof(period))) || (! writeEEPROM(offset, (uint8_t*)&hour, sizeof(hour))) ||
-      (! writeEEPROM(offset, (uint8_t*)&minute, sizeof(minute))) || (! writeEEPROM(offset, (uint8_t*)&second, sizeof(second))))
-      return false;
-    if (period == Schedule::WEEKLY) {
-      if (! writeEEPROM(offset, (uint8_t*)&weekdays, sizeof(weekdays)))
-        return false;
-    } else {
-      if ((! writeEEPROM(offset, (uint8_t*)&day, sizeof(day))) || (! writeEEPROM(offset, (uint8_t*)&month, sizeof(month))) ||
-        (! writeEEPROM(offset, (uint8_t*)&year, sizeof(year))))
-        return false;
-    }
-    if (! writeEEPROM(offset, (uint8_t*)&scheduleButtons[i], sizeof(scheduleButtons[i])))
+    key += String(i);
+    if (! _config->put(key, data, encodeSchedule(i, data, sizeof(data))))
       return false;
   }
 
   return true;
 }
 
-static const uint32_t IR_SIGNATURE = 0x42524923; // "#IRB"
+uint16_t ESPIRBlaster::encodeSchedule(int8_t id, uint8_t *data, uint16_t size) {
+  RecordWriter record(data, size);
+
+  record.put8(schedules[id].period());
+  record.put8(schedules[id].hour());
+  record.put8(schedules[id].minute());
+  record.put8(schedules[id].second());
+  record.put8(schedules[id].weekdays());
+  record.put8(schedules[id].day());
+  record.put8(schedules[id].month());
+  record.put16(schedules[id].year());
+  record.put8(scheduleButtons[id]);
 
-static uint16_t memcrc16(const uint8_t *pcBlock, size_t len) {
-  uint16_t crc = 0xFFFF;
+  return record.ok() ? record.length() : 0;
+}
 
-  while (len--) {
-    crc ^= *pcBlock++ << 8;
+bool ESPIRBlaster::decodeSchedule(int8_t id, const uint8_t *data, uint16_t len) {
+  RecordReader record(data, len);
+  uint8_t period = Schedule::NONE, hour = 0, minute = 0, second = 0, weekdays = 0, day = 0, month = 0, button = (uint8_t)-1;
+  uint16_t year = 0;
 
-    for (uint8_t i = 0; i < 8; ++i)
-      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
-  }
+  if (! record.get8(period))
+    return false;
+  record.get8(hour) && record.get8(minute) && record.get8(second) && record.get8(weekdays) && record.get8(day) && record.get8(month) &&
+    record.get16(year) && record.get8(button); // Поля, отсутствующие в записи старой версии, остаются по умолчанию
+  if (period == Schedule::NONE)
+    schedules[id].clear();
+  else
+    schedules[id].set((Schedule::period_t)period, (int8_t)hour, (int8_t)minute, (int8_t)second, weekdays, (int8_t)day, (int8_t)month, (int16_t)year);
+  scheduleButtons[id] = (int8_t)button;
 
-  return crc;
+  return true;
 }
 
-bool ESPIRBlaster::readIRButtons() {
-  static const char strError[] PROGMEM = "Error reading from file!";
+bool ESPIRBlaster::readMacrosConfig() {
+  for (int8_t i = 0; i < MAX_MACROS; ++i) {
+    String key = FPSTR(configMacro);
+    uint8_t data[MACRO_RECORD_SIZE];
+    uint16_t len;
+
+    key += String(i);
+    len = _config->length(key);
+    if (len > sizeof(data))
+      len = sizeof(data); // Запись более новой версии, лишние поля игнорируются
+    if (len && _config->get(key, data, len))
+      decodeMacro(i, data, len);
+  }
+  _buttonsIndexed = false;
 
-  File file;
-  uint32_t sign;
-  uint16_t crc;
+  return true;
+}
 
-  _log->println(F("Reading IR buttons configuration file"));
-  file = SPIFFS.open(FPSTR(remoteFileName), "r");
-  if (! file) {
-    _log->println(F("Error opening file!"));
-    return false;
-  }
-  if ((file.read((uint8_t*)&sign, sizeof(sign)) != sizeof(sign)) || (sign != IR_SIGNATURE)) {
-    file.close();
-    _log->println(F("Error reading or illegal signature!"));
-    return false;
-  }
-  memset(irbuttons, 0, sizeof(irbuttons));
-  for (uint8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
-    if (file.read((uint8_t*)&irbuttons[i], sizeof(irbuttons[i]) - sizeof(irbuttons[i].rawBuf)) != sizeof(irbuttons[i]) - sizeof(irbuttons[i].rawBuf)) { // read without rawBuf field
-      file.close();
-      _log->println(FPSTR(strError));
+bool ESPIRBlaster::writeMacrosConfig() {
+  for (int8_t i = 0; i < MAX_MACROS; ++i) {
+    String key = FPSTR(configMacro);
+    uint8_t data[MACRO_RECORD_SIZE];
+
+    key += String(i);
+    if (! _config->put(key, data, encodeMacro(i, data, sizeof(data))))
       return false;
-    }
-    if (irbuttons[i].rawBufLen) {
-      if (file.read((uint8_t*)irbuttons[i].rawBuf, sizeof(uint16_t) * irbuttons[i].rawBufLen) != sizeof(uint16_t) * irbuttons[i].rawBufLen) { // read rawBuf field
-        file.close();
-        _log->println(FPSTR(strError));
-        return false;
-      }
-    }
-  }
-  if ((file.read((uint8_t*)&crc, sizeof(crc)) != sizeof(crc)) || (crc != memcrc16((uint8_t*)irbuttons, sizeof(irbuttons)))) {
-    file.close();
-    _log->println(F("Error reading or illegal CRC!"));
-    return false;
   }
-  file.close();
 
   return true;
 }
 
-bool ESPIRBlaster::writeIRButtons() {
-  static const char strError[] PROGMEM = "Error writing to file!";
+uint16_t ESPIRBlaster::encodeMacro(int8_t id, uint8_t *data, uint16_t size) {
+  RecordWriter record(data, size);
 
-  File file;
-  uint32_t sign = IR_SIGNATURE;
-  uint16_t crc;
+  record.putStr(macros[id].name, sizeof(macros[id].name) - 1);
+  record.put8(macros[id].count);
+  for (uint8_t i = 0; i < macros[id].count; ++i) {
+    record.put8(macros[id].buttons[i]);
+    record.put16(macros[id].delays[i]);
+  }
 
-  _log->println(F("Writing IR buttons configuration file"));
-  file = SPIFFS.open(FPSTR(remoteFileName), "w");
-  if (! file) {
-    _log->println(F("Error creating file!"));
+  return record.ok() ? record.length() : 0;
+}
+
+bool ESPIRBlaster::decodeMacro(int8_t id, const uint8_t *data, uint16_t len) {
+  RecordReader record(data, len);
+  uint8_t count, button;
+
+  memset(&macros[id], 0, sizeof(macro_t));
+  if ((! record.getStr(macros[id].name, sizeof(macros[id].name))) || (! record.get8(count)))
     return false;
+  for (uint8_t i = 0; (i < count) && (i < MACRO_STEPS); ++i) {
+    if ((! record.get8(button)) || (! record.get16(macros[id].delays[i])) || ((int8_t)button >= MACRO_BASE))
+      return false;
+    macros[id].buttons[i] = button;
+    macros[id].count = i + 1;
   }
-  if (file.write((uint8_t*)&sign, sizeof(sign)) != sizeof(sign)) {
-    file.close();
-    _log->println(FPSTR(strError));
+
+  return true;
+}
+
+bool ESPIRBlaster::storeMacro(int8_t id, const String &name, const String &steps) {
+  if ((id < 0) || (id >= MAX_MACROS))
+    return false;
+
+  macro_t macro;
+  const char *step = steps.c_str();
+
+  memset(&macro, 0, sizeof(macro_t));
+  strncpy(macro.name, name.c_str(), sizeof(macro.name) - 1);
+  while (*step) {
+    const char *end = step;
+
+    while (*end && (*end != charComma) && (*end != charColon))
+      ++end;
+    if (end > step) {
+      char *num;
+      long btn = strtol(step, &num, 10);
+
+      if (num != end) // Не номер, а имя кнопки ДУ
+        btn = findButton(step, end - step);
+      if ((btn < 0) || (btn >= MACRO_BASE) || (macro.count >= MACRO_STEPS)) // Вложенные макросы не поддерживаются
+        return false;
+      macro.buttons[macro.count] = btn;
+      if (*end == charColon) {
+        macro.delays[macro.count] = constrain(strtol(end + 1, &num, 10), 0, UINT16_MAX);
+        end = num;
+      }
+      ++macro.count;
+    }
+    if (*end && (*end != charComma))
+      return false;
+    step = *end ? end + 1 : end;
+  }
+
+  if (! memcmp(&macros[id], &macro, sizeof(macro_t)))
+    return true;
+  if (_macro == id)
+    _macro = -1; // Изменяемый макрос прерывается
+  memcpy(&macros[id], &macro, sizeof(macro_t));
+  _buttonsIndexed = false;
+  configChanged();
+
+  return true;
+}
+
+bool ESPIRBlaster::storeConfig() {
+  return writeConfig();
+}
+
+bool ESPIRBlaster::setButtonParam(irbutton_t &irbutton, const String &name, const String &value, rawcode_error_t &error) {
+  if (name.equals(FPSTR(paramRemoteBtnName))) {
+    strncpy(irbutton.buttonName, value.c_str(), sizeof(irbutton.buttonName) - 1);
+  } else if (name.equals(FPSTR(paramRemoteBtnCode)) || name.equals(FPSTR(paramRemoteBtnRaw)) || name.equals(FPSTR(paramPlain))) {
+    uint16_t len = 0;
+
+    if (! irbutton.resize(IR_LEARN_BUFFER_SIZE)) { // Код разбирается в буфер максимальной длины, который затем усекается
+      error = RAWCODE_NOMEMORY;
+    } else {
+      if (name.equals(FPSTR(paramRemoteBtnCode)))
+        error = parseRawDecimal(value.c_str(), value.length(), irbutton.rawBuf, IR_LEARN_BUFFER_SIZE, len);
+      else
+        error = parseRawBase64(value.c_str(), value.length(), irbutton.rawBuf, IR_LEARN_BUFFER_SIZE, len);
+      irbutton.resize(error == RAWCODE_OK ? len : 0); // Уменьшение блока памяти не перемещает его
+    }
+  } else if (name.equals(FPSTR(paramRemoteBtnRepeat))) {
+    irbutton.repeat = constrain(value.toInt(), 1, 16) - 1;
+  } else if (name.equals(FPSTR(paramRemoteBtnGap))) {
+    irbutton.gap = constrain(value.toInt(), 0, 4095);
+  } else
     return false;
+
+  return true;
+}
+
+void ESPIRBlaster::handleRemoteUpload() {
+  HTTPUpload& upload = httpServer->upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    if (! _uploadParser) {
+      _uploadBuf = new (std::nothrow) uint16_t[IR_LEARN_BUFFER_SIZE];
+      if (_uploadBuf)
+        _uploadParser = new RawCodeParser(_uploadBuf, IR_LEARN_BUFFER_SIZE);
+    } else
+      _uploadParser->reset();
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (_uploadParser)
+      _uploadParser->write(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    if (_uploadParser)
+      _uploadParser->finish();
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    freeRemoteUpload();
+  }
+}
+
+rawcode_error_t ESPIRBlaster::finishRemoteUpload(irbutton_t &irbutton) {
+  rawcode_error_t result = _uploadParser->error();
+
+  if ((result == RAWCODE_OK) && (! irbutton.setRaw(_uploadBuf, _uploadParser->length())))
+    result = RAWCODE_NOMEMORY;
+  freeRemoteUpload();
+
+  return result;
+}
+
+void ESPIRBlaster::freeRemoteUpload() {
+  if (_uploadParser) {
+    delete _uploadParser;
+    _uploadParser = NULL;
+  }
+  if (_uploadBuf) {
+    delete[] _uploadBuf;
+    _uploadBuf = NULL;
+  }
+}
+
+uint8_t ESPIRBlaster::buttonNameHash(const char *name, uint16_t len) {
+  uint32_t result = 2166136261UL; // FNV-1a
+
+  while (len--)
+    result = (result ^ (uint8_t)tolower(*name++)) * 16777619UL;
+
+  return (result ^ (result >> 16)) & (BUTTON_NAME_INDEX_SIZE - 1);
+}
+
+void ESPIRBlaster::indexButtons() {
+  memset(_buttonNames, 0, sizeof(_buttonNames));
+  _buttonsIndexed = true; // Таблица имен уже используется findButton() для пропуска повторяющихся имен
+  for (int8_t i = 0; i < MACRO_BASE + MAX_MACROS; ++i) {
+    const char *name = buttonName(i);
+
+    if (*name && (findButton(name, strlen(name)) < 0)) { // При совпадении имен находится первая кнопка
+      uint8_t slot = buttonNameHash(name, strlen(name));
+
+      while (_buttonNames[slot])
+        slot = (slot + 1) & (BUTTON_NAME_INDEX_SIZE - 1);
+      _buttonNames[slot] = i + 1;
+    }
+  }
+#ifdef IRRX_PIN
+  _irMatcher->clear();
+  for (uint8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
+    if (irbuttons[i].rawBufLen)
+      _irMatcher->add(i, irbuttons[i].rawBuf, irbuttons[i].rawBufLen);
+  }
+#endif
+}
+
+int8_t ESPIRBlaster::findButton(const char *name, uint16_t len) {
+  if ((! len) || (len >= BUTTON_NAME_SIZE))
+    return -1;
+  if (! _buttonsIndexed)
+    indexButtons();
+
+  for (uint8_t slot = buttonNameHash(name, len); _buttonNames[slot]; slot = (slot + 1) & (BUTTON_NAME_INDEX_SIZE - 1)) {
+    const char *slotName = buttonName(_buttonNames[slot] - 1);
+
+    if ((! strncasecmp(slotName, name, len)) && (! slotName[len]))
+      return _buttonNames[slot] - 1;
   }
+
+  return -1;
+}
+
+bool ESPIRBlaster::storeButton(int8_t id, irbutton_t &irbutton) {
+  if ((id < 0) || (id >= BUTTON_COLS * BUTTON_ROWS))
+    return false;
+
+  if (irbuttons[id].equals(irbutton))
+    return true;
+  irbuttons[id].swap(irbutton); // Передаваемый код остается доступным: _txCode указывает на саму кнопку, а не на ее буфер
+  _buttonsDirty = true;
+  _buttonsIndexed = false;
+  configChanged();
+
+  return true;
+}
+
+uint32_t ESPIRBlaster::buttonsRawLength() const {
+  uint32_t result = 0;
+
+  for (uint8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i)
+    result += irbuttons[i].rawBufLen;
+
+  return result;
+}
+
+void ESPIRBlaster::clearScheduleParams(scheduleparams_t &params) {
+  params.period = Schedule::NONE;
+  params.hour = -1;
+  params.minute = -1;
+  params.second = -1;
+  params.weekdays = 0;
+  params.day = 0;
+  params.month = 0;
+  params.year = 0;
+  params.button = -1;
+}
+
+bool ESPIRBlaster::setScheduleParam(scheduleparams_t &params, const String &name, const String &value) {
+  if (name.equals(FPSTR(paramSchedulePeriod))) {
+    params.period = (Schedule::period_t)value.toInt();
+  } else if (name.equals(FPSTR(paramScheduleHour))) {
+    params.hour = value.toInt();
+  } else if (name.equals(FPSTR(paramScheduleMinute))) {
+    params.minute = value.toInt();
+  } else if (name.equals(FPSTR(paramScheduleSecond))) {
+    params.second = value.toInt();
+  } else if (name.equals(FPSTR(paramScheduleWeekdays))) {
+    params.weekdays = value.toInt();
+  } else if (name.equals(FPSTR(paramScheduleDay))) {
+    params.day = value.toInt();
+  } else if (name.equals(FPSTR(paramScheduleMonth))) {
+    params.month = value.toInt();
+  } else if (name.equals(FPSTR(paramScheduleYear))) {
+    params.year = value.toInt();
+  } else if (name.equals(FPSTR(paramScheduleIRButton))) {
+    params.button = constrain(value.toInt(), -1, MACRO_BASE + MAX_MACROS - 1);
+  } else
+    return false;
+
+  return true;
+}
+
+bool ESPIRBlaster::storeSchedule(int8_t id, const scheduleparams_t &params) {
+  if ((id < 0) || (id >= MAX_SCHEDULES))
+    return false;
+
+  if (params.period == Schedule::NONE)
+    schedules[id].clear();
+  else
+    schedules[id].set(params.period, params.hour, params.minute, params.second, params.weekdays, params.day, params.month, params.year);
+  scheduleButtons[id] = params.button;
+  configChanged();
+
+  return true;
+}
+
+static const uint32_t IR_SIGNATURE = 0x42524923; // "#IRB", старый формат (массив структур в памяти)
+static const uint32_t IR_RECORDS_SIGNATURE = 0x52524923; // "#IRR", формат с записями little-endian
+static const uint8_t IR_RECORDS_VERSION = 1;
+
+uint32_t ESPIRBlaster::buttonsStreamSize() {
+  uint32_t result = sizeof(uint32_t) + 2 + sizeof(uint16_t); // Сигнатура, версия, количество кнопок и CRC
+
+  for (uint8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i)
+    result += sizeof(uint16_t) + irbuttons[i].recordSize();
+
+  return result;
+}
+
+bool ESPIRBlaster::writeButtonsStream(Print &out) {
+  uint8_t data[sizeof(uint32_t) + 2];
+  uint16_t crc;
+  RecordWriter header(data, sizeof(data));
+
+  header.put32(IR_RECORDS_SIGNATURE);
+  header.put8(IR_RECORDS_VERSION);
+  header.put8(BUTTON_COLS * BUTTON_ROWS);
+  if (out.write(data, header.length()) != header.length())
+    return false;
+  crc = crc16(data, header.length());
   for (uint8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
-    if (file.write((uint8_t*)&irbuttons[i], sizeof(irbuttons[i]) - sizeof(irbuttons[i].rawBuf)) != sizeof(irbuttons[i]) - sizeof(irbuttons[i].rawBuf)) { // write without rawBuf field
-      file.close();
-      _log->println(FPSTR(strError));
+    uint16_t size = sizeof(uint16_t) + irbuttons[i].recordSize();
+    uint8_t *record = (uint8_t*)malloc(size); // Записи кнопок разной длины, буфер выделяется под каждую
+    uint16_t len;
+
+    if (! record)
+      return false;
+    len = irbuttons[i].encode(&record[sizeof(uint16_t)], size - sizeof(uint16_t));
+    RecordWriter(record, sizeof(uint16_t)).put16(len); // Длина записи позволяет пропускать поля новых версий
+    len += sizeof(uint16_t);
+    if (out.write(record, len) != len) {
+      free(record);
       return false;
     }
-    if (irbuttons[i].rawBufLen) {
-      if (file.write((uint8_t*)irbuttons[i].rawBuf, sizeof(uint16_t) * irbuttons[i].rawBufLen) != sizeof(uint16_t) * irbuttons[i].rawBufLen) { // write rawBuf field
-        file.close();
-        _log->println(FPSTR(strError));
+    crc = crc16(record, len, crc);
+    free(record);
+  }
+
+  RecordWriter trailer(data, sizeof(uint16_t));
+
+  trailer.put16(crc);
+
+  return (out.write(data, trailer.length()) == trailer.length());
+}
+
+bool ESPIRBlaster::readButtonsStream(BufferedFile &in) {
+  static const uint16_t BUTTON_RECORD_MAX = 1 + IRBUTTON_NAME_SIZE + 1 + 2 + 2 + 2 * IRBUTTON_MAX_RAW; // Максимальная длина известной части записи кнопки
+  uint8_t data[sizeof(uint16_t) * 2];
+  uint8_t version, count;
+  uint16_t len, crc;
+
+  if (! in.read(data, 2))
+    return false;
+
+  RecordReader header(data, 2);
+
+  header.get8(version);
+  header.get8(count);
+  (void)version; // Версия 1 - первая; более новые версии только дописывают поля в конец записей
+  _buttonsIndexed = false;
+  for (uint8_t i = 0; i < count; ++i) {
+    if (! in.read(data, sizeof(uint16_t)))
+      return false;
+    len = data[0] | (data[1] << 8);
+    if (i >= BUTTON_COLS * BUTTON_ROWS) {
+      if (! in.skip(len))
         return false;
-      }
+      continue;
+    }
+
+    uint16_t part = len < BUTTON_RECORD_MAX ? len : BUTTON_RECORD_MAX;
+    uint8_t *record = (uint8_t*)malloc(part ? part : 1);
+    bool result;
+
+    if (! record)
+      return false;
+    result = in.read(record, part) && in.skip(len - part) && irbuttons[i].decode(record, part); // Хвост записи сверх известных полей пропускается
+    free(record);
+    if (! result)
+      return false;
+  }
+  crc = in.crc();
+  if (! in.read(data, sizeof(uint16_t)))
+    return false;
+
+  return ((data[0] | (data[1] << 8)) == crc);
+}
+
+bool ESPIRBlaster::readLegacyButtons(BufferedFile &in) {
+  static const uint8_t LEGACY_HEADER_SIZE = IRBUTTON_NAME_SIZE + 2 + 2; // Имя, repeat:4 + gap:12, длина кода
+  static const uint16_t LEGACY_RAW_SIZE = 128; // Размер массива кода в старой структуре кнопки
+  static const uint8_t zeros[16] = { 0 };
+  uint8_t data[LEGACY_HEADER_SIZE];
+  uint16_t crc, streamCrc, memCrc = CRC16_INIT;
+
+  for (uint8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i) {
+    uint16_t repeatgap, len;
+
+    if (! in.read(data, sizeof(data)))
+      return false;
+    memCrc = crc16(data, sizeof(data), memCrc);
+
+    RecordReader header(&data[IRBUTTON_NAME_SIZE], sizeof(data) - IRBUTTON_NAME_SIZE);
+
+    header.get16(repeatgap);
+    header.get16(len);
+    if ((len > LEGACY_RAW_SIZE) || (! irbuttons[i].resize(len)) ||
+      (len && (! in.read(irbuttons[i].rawBuf, sizeof(uint16_t) * len))))
+      return false;
+    memcpy(irbuttons[i].buttonName, data, IRBUTTON_NAME_SIZE - 1);
+    irbuttons[i].buttonName[IRBUTTON_NAME_SIZE - 1] = '\0';
+    irbuttons[i].repeat = repeatgap & 0x0F;
+    irbuttons[i].gap = repeatgap >> 4;
+    if (len)
+      memCrc = crc16((uint8_t*)irbuttons[i].rawBuf, sizeof(uint16_t) * len, memCrc);
+    for (uint16_t pad = sizeof(uint16_t) * (LEGACY_RAW_SIZE - len); pad; ) { // Неиспользованный хвост массива в памяти был обнулен
+      uint16_t part = pad < sizeof(zeros) ? pad : sizeof(zeros);
+
+      memCrc = crc16(zeros, part, memCrc);
+      pad -= part;
     }
   }
-  crc = memcrc16((uint8_t*)irbuttons, sizeof(irbuttons));
-  if (file.write((uint8_t*)&crc, sizeof(crc)) != sizeof(crc)) {
+  streamCrc = in.crc();
+
+  return in.read(&crc, sizeof(crc)) && ((crc == streamCrc) || (crc == memCrc)); // Самые старые версии считали CRC по массиву в памяти
+}
+
+void ESPIRBlaster::loadIRButtons() {
+  if (! readIRButtons()) {
+    _log->println(F("Unable to read IR buttons configuration file!"));
+    clearIRButtons();
+    _buttonsDirty = true;
+  } else
+    _buttonsDirty = false;
+}
+
+bool ESPIRBlaster::readIRButtons() {
+  File file;
+  uint8_t data[sizeof(uint32_t)];
+  uint32_t sign;
+  bool result;
+
+  _log->println(F("Reading IR buttons configuration file"));
+  if ((! SPIFFS.exists(FPSTR(remoteFileName))) && SPIFFS.exists(FPSTR(remoteTempFileName))) // Запись прервана после удаления старого файла
+    SPIFFS.rename(FPSTR(remoteTempFileName), FPSTR(remoteFileName));
+  file = SPIFFS.open(FPSTR(remoteFileName), "r");
+  if (! file) {
+    _log->println(F("Error opening file!"));
+    return false;
+  }
+
+  BufferedFile buf(file);
+
+  if ((! buf.read(data, sizeof(data))) || (! RecordReader(data, sizeof(data)).get32(sign)) || ((sign != IR_RECORDS_SIGNATURE) && (sign != IR_SIGNATURE))) {
     file.close();
-    _log->println(F("Error writing CRC to file!"));
+    _log->println(F("Error reading or illegal signature!"));
+    return false;
+  }
+  clearIRButtons();
+  if (sign == IR_RECORDS_SIGNATURE)
+    result = readButtonsStream(buf);
+  else
+    result = readLegacyButtons(buf);
+  file.close();
+  if (! result) {
+    clearIRButtons();
+    _log->println(F("Error reading from file or illegal CRC!"));
+    return false;
+  }
+  if (sign == IR_SIGNATURE) { // Перевод файла в новый формат
+    _log->println(F("Converting IR buttons configuration file"));
+    if (! writeIRButtons())
+      _buttonsDirty = true;
+  }
+
+  return true;
+}
+
+bool ESPIRBlaster::writeIRButtons() {
+  return prepareIRButtons() && replaceIRButtons(); // Старый файл заменяется только после успешной записи нового
+}
+
+bool ESPIRBlaster::prepareIRButtons() {
+  File file;
+  bool result;
+
+  _log->println(F("Writing IR buttons configuration file"));
+  file = SPIFFS.open(FPSTR(remoteTempFileName), "w");
+  if (! file) {
+    _log->println(F("Error creating file!"));
     return false;
   }
+
+  BufferedFile buf(file);
+
+  result = writeButtonsStream(buf) && buf.flush();
   file.close();
+  if (! result) {
+    SPIFFS.remove(FPSTR(remoteTempFileName));
+    _log->println(F("Error writing to file!"));
+    return false;
+  }
+
+  return true;
+}
+
+bool ESPIRBlaster::replaceIRButtons() {
+  if ((! SPIFFS.remove(FPSTR(remoteFileName)) && SPIFFS.exists(FPSTR(remoteFileName))) ||
+    (! SPIFFS.rename(FPSTR(remoteTempFileName), FPSTR(remoteFileName)))) {
+    SPIFFS.remove(FPSTR(remoteTempFileName));
+    _log->println(F("Error replacing file!"));
+    return false;
+  }
+  _files->invalidate();
 
   return true;
 }
 
 void ESPIRBlaster::clearIRButtons() {
-  memset(irbuttons, 0, sizeof(irbuttons));
+  for (uint8_t i = 0; i < BUTTON_COLS * BUTTON_ROWS; ++i)
+    irbuttons[i].clear();
+  _buttonsIndexed = false;
+}
+
+static const uint8_t BACKUP_BUTTONS = BACKUP_EXTRA; // Секция архива с кнопками ДУ в формате файла
+
+uint32_t ESPIRBlaster::backupSize() {
+  return ESPWebMQTTBase::backupSize() + BACKUP_SECTION_HEADER + buttonsStreamSize();
+}
+
+bool ESPIRBlaster::writeBackup(Print &out) {
+  return ESPWebMQTTBase::writeBackup(out) && writeBackupSection(out, BACKUP_BUTTONS, buttonsStreamSize()) && writeButtonsStream(out);
+}
+
+bool ESPIRBlaster::restoreSection(uint8_t section, uint32_t len, BufferedFile &in) {
+  if (section != BACKUP_BUTTONS)
+    return ESPWebMQTTBase::restoreSection(section, len, in);
+
+  uint8_t data[sizeof(uint32_t)];
+  uint32_t sign;
+
+  in.resetCrc(); // CRC потока кнопок считается от его сигнатуры
+  if ((len < sizeof(data)) || (! in.read(data, sizeof(data))) || (! RecordReader(data, sizeof(data)).get32(sign)) || (sign != IR_RECORDS_SIGNATURE))
+    return false;
+  clearIRButtons();
+  if (! readButtonsStream(in))
+    return false;
+  _buttonsDirty = true;
+
+  return true;
+}
+
+bool ESPIRBlaster::prepareRestore() {
+  return ESPWebMQTTBase::prepareRestore() && ((! _buttonsDirty) || prepareIRButtons());
+}
+
+bool ESPIRBlaster::commitRestore() { // Файл кнопок ДУ уже записан prepareRestore(), журнал и кнопки заменяются только после записи обоих
+  if (! ESPWebMQTTBase::commitRestore()) {
+    if (_buttonsDirty)
+      SPIFFS.remove(FPSTR(remoteTempFileName));
+    return false;
+  }
+  if (_buttonsDirty) {
+    if (! replaceIRButtons())
+      return false;
+    _buttonsDirty = false;
+  }
+
+  return true;
+}
+
+void ESPIRBlaster::abortRestore() {
+  ESPWebMQTTBase::abortRestore();
+  loadIRButtons();
 }
 
 #ifdef IRRX_PIN
-bool ESPIRBlaster::cloneRemoteCode(decode_results *results) {
+bool ESPIRBlaster::isEcho(decode_results *results) {
+  uint32_t duration = 0;
+
+  for (uint16_t i = 1; i < results->rawlen; ++i) // rawbuf[0] - пауза перед кодом
+    duration += results->rawbuf[i] * RAWTICK;
+
+  return IRTimeout::overlaps(_irPollTime, millis(), receiverTimeout(), (duration + 999) / 1000, _echoStart - IR_ECHO_GUARD, _echoEnd + IR_ECHO_GUARD);
+}
+
+void ESPIRBlaster::retuneReceiver() {
+  irRX->disableIRIn();
+  delete irRX;
+  irRX = new IRrecv(IRRX_PIN, _learnBuf ? IR_LEARN_BUFFER_SIZE : IR_CAPTURE_BUFFER_SIZE, receiverTimeout(), true);
+  irRX->enableIRIn();
+
+  _log->print(F("IR receiver timeout set to "));
+  _log->print(receiverTimeout());
+  _log->println(F(" ms"));
+}
+
+bool ESPIRBlaster::startLearning() {
+  if (_learnBuf)
+    return true;
+
+  _learnBuf = new (std::nothrow) uint16_t[IR_LEARN_BUFFER_SIZE];
+  if (! _learnBuf) {
+    _log->println(F("Not enough memory for IR learning buffer!"));
+    return false;
+  }
+  _learnLen = 0;
+  _learnTime = millis();
+  retuneReceiver();
+  _log->println(F("IR learning mode started"));
+
+  return true;
+}
+
+void ESPIRBlaster::stopLearning() {
+  if (! _learnBuf)
+    return;
+
+  delete[] _learnBuf;
+  _learnBuf = NULL;
+  _learnLen = 0;
+  retuneReceiver();
+  _log->println(F("IR learning mode stopped"));
+}
+
+bool ESPIRBlaster::cloneRemoteCode(decode_results *results, uint16_t *buf, uint16_t size, uint16_t &len) {
   if (results->repeat) {
     _log->println(F("IR sequence is repeat code, ignored!"));
     return false;
@@ -1544,42 +2628,98 @@ bool ESPIRBlaster::cloneRemoteCode(decode_results *results) {
     return false;
   }
 
-  memset(rawBuf, 0, sizeof(rawBuf));
-  rawBufLen = 0;
+  len = 0;
   for (uint16_t i = 1; i < results->rawlen; ++i) {
     uint32_t usecs;
 
     for (usecs = results->rawbuf[i] * RAWTICK; usecs > UINT16_MAX; usecs -= UINT16_MAX) {
-      rawBuf[rawBufLen++] = UINT16_MAX;
-      rawBuf[rawBufLen++] = 0;
+      if (len + 3 > size)
+        break;
+      buf[len++] = UINT16_MAX;
+      buf[len++] = 0;
     }
-    rawBuf[rawBufLen++] = usecs;
+    if ((len >= size) || (usecs > UINT16_MAX)) {
+      _log->println(F("IR sequence too big!"));
+      return false;
+    }
+    buf[len++] = usecs;
   }
   _log->print(F("IR raw code buffer length: "));
-  _log->println(rawBufLen);
+  _log->println(len);
 
   return true;
 }
-#endif
 
-void ESPIRBlaster::sendButtonCode(uint8_t btn) {
-  if ((btn >= BUTTON_COLS * BUTTON_ROWS) || (! irbuttons[btn].rawBufLen)) // Wrong IR button index or empty code!
+void ESPIRBlaster::bridgeRemoteCode(decode_results *results, const uint16_t *raw, uint16_t len) {
+  if (! *_mqttServer)
     return;
-#ifdef IRRX_PIN
-  irRX->disableIRIn();
-#endif
 
-  uint8_t repeat = irbuttons[btn].repeat + 1;
-  while (repeat--) {
-    irTX->sendRaw(irbuttons[btn].rawBuf, irbuttons[btn].rawBufLen, 38);
-    if (repeat)
-      delay(irbuttons[btn].gap);
+  if (! _buttonsIndexed)
+    indexButtons();
+
+  String value;
+  int32_t btn = _irMatcher->match(raw, len);
+
+  if (btn >= 0) {
+    if (*irbuttons[btn].buttonName)
+      value = irbuttons[btn].buttonName;
+    else
+      value = String(btn + 1);
+  } else {
+    irprotocol_t protocol;
+
+    for (uint8_t i = 0; i < sizeof(irProtocols) / sizeof(irProtocols[0]); ++i) {
+      memcpy_P(&protocol, &irProtocols[i], sizeof(irprotocol_t));
+      if (protocol.type == results->decode_type) {
+        String low = String((uint32_t)results->value, HEX);
+
+        value = protocol.name;
+        value += charColon;
+        if (results->value >> 32) {
+          value += String((uint32_t)(results->value >> 32), HEX);
+          for (uint8_t j = low.length(); j < 8; ++j)
+            value += '0';
+        }
+        value += low;
+        value += charColon;
+        value += String(results->bits);
+        break;
+      }
+    }
+    if (! value.length()) // Неизвестный код
+      return;
   }
 
-#ifdef IRRX_PIN
-  irRX->enableIRIn();
+  mqttPublish(mqttTopic(FPSTR(mqttIRReceivedTopic)), value, false);
+}
 #endif
 
+void ESPIRBlaster::sendIRCode(const irbutton_t &irbutton) {
+  _txCode = &irbutton;
+  _txLeft = irbutton.repeat + 1;
+  _txTime = millis();
+  _echoStart = _txTime;
+  loopTransmit(); // Первый кадр передается без задержки
+}
+
+void ESPIRBlaster::loopTransmit() {
+  if ((int32_t)(millis() - _txTime) < 0)
+    return;
+
+  irTX->sendRaw((uint16_t*)_txCode->rawBuf, _txCode->rawBufLen, 38); // Приемник остается включенным, эхо отбрасывается по времени
+  _echoEnd = millis();
+  if (--_txLeft)
+    _txTime = _echoEnd + _txCode->gap; // Пауза между повторами не блокирует главный цикл
+  else
+    _txCode = NULL;
+}
+
+void ESPIRBlaster::sendButtonCode(uint8_t btn) {
+  if ((btn >= BUTTON_COLS * BUTTON_ROWS) || (! irbuttons[btn].rawBufLen)) // Wrong IR button index or empty code!
+    return;
+
+  sendIRCode(irbuttons[btn]);
+
   logDateTime();
   _log->print(F(" code for IR button #"));
   _log->print(btn + 1);
@@ -1591,6 +2731,166 @@ void ESPIRBlaster::sendButtonCode(uint8_t btn) {
   _log->println(F(" sended"));
 }
 
+void ESPIRBlaster::triggerButton(int8_t btn) {
+  if (btn < MACRO_BASE) {
+    sendButtonCode(btn);
+    return;
+  }
+  if (! buttonDefined(btn)) // Wrong macro index or empty macro!
+    return;
+
+  if (_macro >= 0)
+    _log->println(F("Running macro interrupted"));
+  _macro = btn - MACRO_BASE;
+  _macroStep = 0;
+  _macroTime = millis();
+  _macroWait = false;
+
+  logDateTime();
+  _log->print(F(" macro #"));
+  _log->print(_macro + 1);
+  if (*macros[_macro].name) {
+    _log->print(F(" ("));
+    _log->print(macros[_macro].name);
+    _log->print(')');
+  }
+  _log->println(F(" started"));
+}
+
+void ESPIRBlaster::loopMacro() {
+  if (transmitting())
+    return;
+
+  const macro_t &macro = macros[_macro];
+
+  if (_macroWait) {
+    _macroTime = millis() + macro.delays[_macroStep - 1];
+    _macroWait = false;
+  }
+  if ((int32_t)(millis() - _macroTime) < 0)
+    return;
+  if (_macroStep >= macro.count) {
+    _macro = -1;
+    return;
+  }
+  sendButtonCode(macro.buttons[_macroStep++]);
+  _macroWait = true;
+}
+
+rawcode_error_t ESPIRBlaster::parseIRSend(const uint8_t *data, uint16_t len) {
+  _irSend.protocol = UNKNOWN;
+  _irSend.data = 0;
+  _irSend.nbits = 0;
+  _irSend.code.clear();
+  if (! len)
+    return RAWCODE_TRUNCATED;
+
+  if (*data < ' ') // Двоичная запись в формате файла кнопок ДУ (первый байт - длина имени кнопки)
+    return (_irSend.code.decode(data, len) && _irSend.code.rawBufLen) ? RAWCODE_OK : RAWCODE_ILLEGAL;
+
+  if (! memchr(data, ':', len)) { // Raw-код в кодировке Base64
+    uint16_t rawLen = 0;
+    rawcode_error_t result;
+
+    if (! _irSend.code.resize(IR_LEARN_BUFFER_SIZE))
+      return RAWCODE_NOMEMORY;
+    result = parseRawBase64((const char*)data, len, _irSend.code.rawBuf, IR_LEARN_BUFFER_SIZE, rawLen);
+    if ((result == RAWCODE_OK) && (! rawLen))
+      result = RAWCODE_TRUNCATED;
+    _irSend.code.resize(result == RAWCODE_OK ? rawLen : 0);
+    return result;
+  }
+
+  char str[48];
+
+  if (len >= sizeof(str))
+    return RAWCODE_OVERFLOW;
+  memcpy(str, data, len);
+  str[len] = '\0';
+
+  char *field = strchr(str, ':');
+  irprotocol_t protocol;
+  uint8_t i;
+
+  *field++ = '\0';
+  for (i = 0; i < sizeof(irProtocols) / sizeof(irProtocols[0]); ++i) {
+    memcpy_P(&protocol, &irProtocols[i], sizeof(irprotocol_t));
+    if (! strcasecmp(str, protocol.name))
+      break;
+  }
+  if (i >= sizeof(irProtocols) / sizeof(irProtocols[0]))
+    return RAWCODE_ILLEGAL;
+
+  char *end;
+
+  _irSend.protocol = protocol.type;
+  _irSend.nbits = protocol.nbits;
+  _irSend.data = strtoull(field, &end, 16);
+  if (end == field)
+    return RAWCODE_ILLEGAL;
+  if (*end == ':') {
+    field = end + 1;
+    _irSend.nbits = strtoul(field, &end, 10);
+    if ((end == field) || (! _irSend.nbits) || (_irSend.nbits > 64))
+      return RAWCODE_ILLEGAL;
+  }
+  if (*end == ':') {
+    field = end + 1;
+    _irSend.code.repeat = constrain(strtoul(field, &end, 10), 0, 15);
+    if (end == field)
+      return RAWCODE_ILLEGAL;
+  }
+
+  return *end ? RAWCODE_ILLEGAL : RAWCODE_OK;
+}
+
+void ESPIRBlaster::sendIRSend() {
+  if (_irSend.protocol == UNKNOWN) {
+    sendIRCode(_irSend.code);
+  } else {
+    _txCode = NULL; // Прерывание передачи повторов raw-кода
+    _echoStart = millis();
+    switch (_irSend.protocol) {
+      case NEC:
+        irTX->sendNEC(_irSend.data, _irSend.nbits, _irSend.code.repeat);
+        break;
+      case SONY:
+        irTX->sendSony(_irSend.data, _irSend.nbits, _irSend.code.repeat);
+        break;
+      case SAMSUNG:
+        irTX->sendSAMSUNG(_irSend.data, _irSend.nbits, _irSend.code.repeat);
+        break;
+      case LG:
+        irTX->sendLG(_irSend.data, _irSend.nbits, _irSend.code.repeat);
+        break;
+      case JVC:
+        irTX->sendJVC(_irSend.data, _irSend.nbits, _irSend.code.repeat);
+        break;
+      case RC5:
+        irTX->sendRC5(_irSend.data, _irSend.nbits, _irSend.code.repeat);
+        break;
+      case RC6:
+        irTX->sendRC6(_irSend.data, _irSend.nbits, _irSend.code.repeat);
+        break;
+      case PANASONIC:
+        irTX->sendPanasonic64(_irSend.data, _irSend.nbits, _irSend.code.repeat);
+        break;
+      default:
+        break;
+    }
+    _echoEnd = millis();
+  }
+
+  logDateTime();
+  _log->print(F(" ad-hoc IR code"));
+  if (*_irSend.code.buttonName) {
+    _log->print(F(" ("));
+    _log->print(_irSend.code.buttonName);
+    _log->print(')');
+  }
+  _log->println(F(" sended"));
+}
+
 ESPIRBlaster *app = new ESPIRBlaster();
 
 void setup() {
@@ -1604,4 +2904,4 @@ void setup() {
 
 void loop() {
   app->loop();
-}
+}
@@ -0,0 +1,120 @@
+#include <FS.h>
+#include "FileIndex.h"
+
+static const char extGz[] PROGMEM = ".gz";
+
+uint32_t FileIndex::hash(const char *str) {
+  uint32_t result = 2166136261UL;
+
+  while (*str) {
+    result ^= (uint8_t)*str++;
+    result *= 16777619UL;
+  }
+
+  return result;
+}
+
+void FileIndex::clear() {
+  if (_entries) {
+    for (uint16_t i = 0; i < _count; ++i)
+      free(_entries[i].path);
+    delete[] _entries;
+    _entries = NULL;
+  }
+  if (_slots) {
+    delete[] _slots;
+    _slots = NULL;
+  }
+  _count = 0;
+  _capacity = 0;
+  _slotMask = 0;
+  _valid = false;
+}
+
+int16_t *FileIndex::slot(const char *path) {
+  uint16_t i = hash(path) & _slotMask;
+
+  while ((_slots[i] >= 0) && strcmp(_entries[_slots[i]].path, path))
+    i = (i + 1) & _slotMask;
+
+  return &_slots[i];
+}
+
+FileIndex::entry_t *FileIndex::add(const String &path) {
+  int16_t *s = slot(path.c_str());
+
+  if (*s < 0) {
+    if (_count >= _capacity)
+      return NULL;
+    entry_t *entry = &_entries[_count];
+    entry->path = strdup(path.c_str());
+    if (! entry->path)
+      return NULL;
+    entry->size = 0;
+    entry->gzip = false;
+    *s = _count++;
+  }
+
+  return &_entries[*s];
+}
+
+void FileIndex::build() {
+  uint16_t files = 0;
+
+  clear();
+  Dir dir = SPIFFS.openDir("/");
+  while (dir.next())
+    ++files;
+  _capacity = files * 2; // Для каждого .gz-файла дополнительно индексируется путь без расширения
+  if (_capacity) {
+    uint16_t slots = 2;
+
+    while (slots < _capacity * 2)
+      slots <<= 1;
+    _entries = new entry_t[_capacity];
+    _slots = new int16_t[slots];
+    memset(_slots, 0xFF, sizeof(int16_t) * slots);
+    _slotMask = slots - 1;
+
+    dir = SPIFFS.openDir("/");
+    while (dir.next()) {
+      String fileName = dir.fileName();
+      uint32_t fileSize = dir.fileSize();
+      entry_t *entry;
+
+      if (! fileName.startsWith("/"))
+        fileName = '/' + fileName;
+      entry = add(fileName);
+      if (entry && (! entry->gzip))
+        entry->size = fileSize;
+      if (fileName.endsWith(FPSTR(extGz))) {
+        entry = add(fileName.substring(0, fileName.length() - strlen_P(extGz)));
+        if (entry) {
+          entry->size = fileSize;
+          entry->gzip = true;
+        }
+      }
+    }
+  }
+
+  _salt ^= ESP.getCycleCount() ^ micros();
+  for (uint16_t i = 0; i < _count; ++i) {
+    _entries[i].type = _typeOf(_entries[i].path);
+    _entries[i].etag = (hash(_entries[i].path) ^ _salt) + _entries[i].size * 2654435761UL;
+  }
+  _valid = true;
+}
+
+const FileIndex::entry_t *FileIndex::find(const String &path) {
+  if (! _valid)
+    build();
+  if (! _count)
+    return NULL;
+
+  int16_t *s = slot(path.c_str());
+
+  if (*s < 0)
+    return NULL;
+
+  return &_entries[*s];
+}
@@ -0,0 +1,47 @@
+#ifndef __FILEINDEX_H
+#define __FILEINDEX_H
+
+#include <Arduino.h>
+
+class FileIndex { // Индекс файлов SPIFFS, отдаваемых Web-сервером (путь -> сжатый вариант, размер, MIME-тип, ETag)
+public:
+  typedef uint8_t (*typeof_t)(const String &fileName); // Функция, возвращающая индекс MIME-типа по имени файла
+
+  struct entry_t {
+    char *path; // Запрашиваемый путь
+    uint32_t size; // Размер отдаваемого файла
+    uint32_t etag;
+    uint8_t type; // Индекс MIME-типа
+    bool gzip; // Отдается сжатый вариант (path + ".gz")
+  };
+
+  FileIndex(typeof_t typeOf) : _typeOf(typeOf), _entries(NULL), _slots(NULL), _count(0), _capacity(0), _slotMask(0), _valid(false), _salt(0) {}
+  ~FileIndex() {
+    clear();
+  }
+  void build(); // Построение индекса по содержимому SPIFFS
+  void invalidate() { // Индекс будет перестроен при следующем обращении
+    _valid = false;
+  }
+  const entry_t *find(const String &path); // Поиск файла по запрашиваемому пути
+  uint16_t count() const {
+    return _count;
+  }
+  static uint32_t hash(const char *str); // FNV-1a хэш строки
+
+protected:
+  void clear();
+  entry_t *add(const String &path); // Поиск или добавление элемента индекса
+  int16_t *slot(const char *path); // Ячейка хэш-таблицы для пути
+
+  typeof_t _typeOf;
+  entry_t *_entries;
+  int16_t *_slots; // Хэш-таблица с открытой адресацией (индексы _entries или -1)
+  uint16_t _count;
+  uint16_t _capacity;
+  uint16_t _slotMask;
+  bool _valid;
+  uint32_t _salt; // Уникальное для каждого построения значение, подмешиваемое в ETag
+};
+
+#endif
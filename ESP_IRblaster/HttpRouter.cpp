@@ -0,0 +1,164 @@
+#include "HttpRouter.h"
+#include "ESPWeb.h"
+
+HttpRouter::~HttpRouter() {
+  if (_routes)
+    free(_routes);
+  if (_hashes)
+    free(_hashes);
+  if (_stats)
+    free(_stats);
+  if (_slots)
+    delete[] _slots;
+}
+
+uint16_t HttpRouter::hash(const char *str) {
+  uint32_t result = 2166136261UL;
+
+  while (*str) {
+    result ^= (uint8_t)*str++;
+    result *= 16777619UL;
+  }
+
+  return (result >> 16) ^ (result & 0xFFFF);
+}
+
+uint16_t HttpRouter::hash_P(PGM_P str) {
+  uint32_t result = 2166136261UL;
+  uint8_t c;
+
+  while ((c = pgm_read_byte(str++)) != 0) {
+    result ^= c;
+    result *= 16777619UL;
+  }
+
+  return (result >> 16) ^ (result & 0xFFFF);
+}
+
+bool HttpRouter::add(const httproute_t *routes, uint8_t count) {
+  uint16_t slots = 2;
+
+  if (_count + count > 127) // Индексы маршрутов должны помещаться в uint8_t хэш-таблицы
+    return false;
+  while (slots < (_count + count) * 2)
+    slots <<= 1;
+
+  const httproute_t **newRoutes = (const httproute_t**)realloc(_routes, sizeof(const httproute_t*) * (_count + count));
+  if (! newRoutes)
+    return false;
+  _routes = newRoutes;
+  uint16_t *newHashes = (uint16_t*)realloc(_hashes, sizeof(uint16_t) * (_count + count));
+  if (! newHashes)
+    return false;
+  _hashes = newHashes;
+  stat_t *newStats = (stat_t*)realloc(_stats, sizeof(stat_t) * (_count + count));
+  if (! newStats)
+    return false;
+  _stats = newStats;
+  uint8_t *newSlots = new uint8_t[slots];
+  if (! newSlots)
+    return false;
+  if (_slots)
+    delete[] _slots;
+  _slots = newSlots;
+  _slotMask = slots - 1;
+
+  for (uint8_t i = 0; i < count; ++i) {
+    httproute_t r;
+
+    _routes[_count + i] = &routes[i];
+    memcpy_P(&r, &routes[i], sizeof(httproute_t));
+    _hashes[_count + i] = hash_P(r.path);
+    _stats[_count + i].hits = 0;
+    _stats[_count + i].time = 0;
+  }
+  _count += count;
+
+  memset(_slots, 0, slots);
+  for (uint8_t i = 0; i < _count; ++i) { // Линейное пробирование без удалений сохраняет порядок добавления маршрутов с одинаковым путем
+    uint8_t s = _hashes[i] & _slotMask;
+
+    while (_slots[s])
+      s = (s + 1) & _slotMask;
+    _slots[s] = i + 1;
+  }
+
+  return true;
+}
+
+void HttpRouter::route(uint8_t index, httproute_t &route) const {
+  memcpy_P(&route, _routes[index], sizeof(httproute_t));
+}
+
+int16_t HttpRouter::find(HTTPMethod method, const char *uri) {
+  if (! _count)
+    return -1;
+
+  uint16_t h = hash(uri);
+
+  for (uint8_t s = h & _slotMask; _slots[s]; s = (s + 1) & _slotMask) {
+    uint8_t i = _slots[s] - 1;
+
+    if (_hashes[i] == h) {
+      httproute_t r;
+
+      route(i, r);
+      if (((r.method == HTTP_ANY) || (r.method == method)) && (! strcmp_P(uri, r.path)))
+        return i;
+    }
+  }
+
+  return -1;
+}
+
+void HttpRouter::call(httphandler_t handler) {
+  uint32_t start = micros();
+
+  (_owner->*handler)();
+  _stats[_current].time += micros() - start;
+}
+
+bool HttpRouter::canHandle(HTTPMethod method, String uri) {
+  _current = find(method, uri.c_str());
+
+  return (_current >= 0);
+}
+
+bool HttpRouter::canUpload(String uri) {
+  if (! canHandle(HTTP_POST, uri))
+    return false;
+
+  httproute_t r;
+
+  route(_current, r);
+
+  return (r.upload != NULL);
+}
+
+bool HttpRouter::handle(ESP8266WebServer &server, HTTPMethod requestMethod, String requestUri) {
+  (void)server;
+
+  if (! canHandle(requestMethod, requestUri))
+    return false;
+
+  httproute_t r;
+
+  route(_current, r);
+  ++_stats[_current].hits;
+  call(r.handler);
+
+  return true;
+}
+
+void HttpRouter::upload(ESP8266WebServer &server, String requestUri, HTTPUpload &upload) {
+  (void)server;
+  (void)upload;
+
+  if (! canUpload(requestUri))
+    return;
+
+  httproute_t r;
+
+  route(_current, r);
+  call(r.upload);
+}
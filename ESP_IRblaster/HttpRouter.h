@@ -0,0 +1,62 @@
+#ifndef __HTTPROUTER_H
+#define __HTTPROUTER_H
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+
+class ESPWebBase;
+
+typedef void (ESPWebBase::*httphandler_t)(); // Обработчик страницы
+
+#define HTTP_HANDLER(handler) static_cast<httphandler_t>(&handler) // Приведение метода наследника к типу обработчика
+
+struct httproute_t { // Элемент таблицы маршрутов (размещается в PROGMEM)
+  PGM_P path; // Путь до страницы (PROGMEM-строка)
+  HTTPMethod method; // Метод запроса (HTTP_ANY - любой)
+  httphandler_t handler; // Обработчик страницы
+  httphandler_t upload; // Обработчик загрузки файла (или NULL)
+};
+
+class HttpRouter : public RequestHandler { // Диспетчер запросов Web-сервера по таблицам маршрутов с хэш-индексом
+public:
+  HttpRouter(ESPWebBase *owner) : _owner(owner), _routes(NULL), _hashes(NULL), _stats(NULL), _slots(NULL), _count(0), _slotMask(0), _current(-1) {}
+  ~HttpRouter();
+  bool add(const httproute_t *routes, uint8_t count); // Добавление таблицы маршрутов из PROGMEM (при совпадении пути и метода приоритет у добавленных раньше)
+  uint8_t count() const {
+    return _count;
+  }
+  void route(uint8_t index, httproute_t &route) const; // Копия элемента таблицы маршрутов в RAM
+  uint32_t hits(uint8_t index) const { // Количество вызовов обработчика
+    return _stats[index].hits;
+  }
+  uint32_t time(uint8_t index) const { // Суммарное время работы обработчика в микросекундах
+    return _stats[index].time;
+  }
+
+  bool canHandle(HTTPMethod method, String uri);
+  bool canUpload(String uri);
+  bool handle(ESP8266WebServer &server, HTTPMethod requestMethod, String requestUri);
+  void upload(ESP8266WebServer &server, String requestUri, HTTPUpload &upload);
+
+protected:
+  static uint16_t hash(const char *str); // FNV-1a хэш строки, свернутый до 16 бит
+  static uint16_t hash_P(PGM_P str); // То же для PROGMEM-строки
+  int16_t find(HTTPMethod method, const char *uri); // Поиск маршрута (-1, если не найден)
+  void call(httphandler_t handler); // Вызов обработчика с учетом статистики текущего маршрута
+
+  struct stat_t {
+    uint32_t hits;
+    uint32_t time;
+  };
+
+  ESPWebBase *_owner;
+  const httproute_t **_routes; // Указатели на элементы таблиц маршрутов в PROGMEM
+  uint16_t *_hashes; // Хэши путей маршрутов
+  stat_t *_stats;
+  uint8_t *_slots; // Хэш-таблица с открытой адресацией (индекс маршрута + 1 или 0)
+  uint8_t _count;
+  uint8_t _slotMask;
+  int16_t _current; // Маршрут текущего запроса
+};
+
+#endif
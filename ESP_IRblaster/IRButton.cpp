@@ -0,0 +1,99 @@
+#include <algorithm>
+#include "IRButton.h"
+#include "Record.h"
+
+void irbutton_t::clear() {
+  memset(buttonName, 0, sizeof(buttonName));
+  repeat = 0;
+  gap = 0;
+  resize(0);
+}
+
+bool irbutton_t::resize(uint16_t len) {
+  if (! len) {
+    free(rawBuf);
+    rawBuf = NULL;
+  } else if (len != rawBufLen) {
+    uint16_t *buf = (uint16_t*)realloc(rawBuf, len * sizeof(uint16_t));
+
+    if (! buf)
+      return false;
+    rawBuf = buf;
+  }
+  rawBufLen = len;
+
+  return true;
+}
+
+bool irbutton_t::setRaw(const uint16_t *raw, uint16_t len) {
+  if (! resize(len))
+    return false;
+  if (len)
+    memcpy(rawBuf, raw, len * sizeof(uint16_t));
+
+  return true;
+}
+
+bool irbutton_t::assign(const irbutton_t &src) {
+  if (&src == this)
+    return true;
+  if (! setRaw(src.rawBuf, src.rawBufLen))
+    return false;
+  memcpy(buttonName, src.buttonName, sizeof(buttonName));
+  repeat = src.repeat;
+  gap = src.gap;
+
+  return true;
+}
+
+void irbutton_t::swap(irbutton_t &other) {
+  char name[IRBUTTON_NAME_SIZE];
+
+  memcpy(name, buttonName, sizeof(name));
+  memcpy(buttonName, other.buttonName, sizeof(buttonName));
+  memcpy(other.buttonName, name, sizeof(name));
+  std::swap(repeat, other.repeat);
+  std::swap(gap, other.gap);
+  std::swap(rawBufLen, other.rawBufLen);
+  std::swap(rawBuf, other.rawBuf);
+}
+
+bool irbutton_t::equals(const irbutton_t &other) const {
+  return (! strncmp(buttonName, other.buttonName, sizeof(buttonName))) && (repeat == other.repeat) && (gap == other.gap) &&
+    (rawBufLen == other.rawBufLen) && ((! rawBufLen) || (! memcmp(rawBuf, other.rawBuf, rawBufLen * sizeof(uint16_t))));
+}
+
+uint16_t irbutton_t::recordSize() const {
+  return 1 + strnlen(buttonName, sizeof(buttonName) - 1) + 1 + 2 + 2 + rawBufLen * 2;
+}
+
+uint16_t irbutton_t::encode(uint8_t *data, uint16_t size) const {
+  RecordWriter record(data, size);
+
+  record.putStr(buttonName, sizeof(buttonName) - 1);
+  record.put8(repeat);
+  record.put16(gap);
+  record.put16(rawBufLen);
+  for (uint16_t i = 0; i < rawBufLen; ++i)
+    record.put16(rawBuf[i]);
+
+  return record.ok() ? record.length() : 0;
+}
+
+bool irbutton_t::decode(const uint8_t *data, uint16_t len) {
+  RecordReader record(data, len);
+  uint16_t count;
+
+  clear();
+  if ((! record.getStr(buttonName, sizeof(buttonName))) || (! record.get8(repeat)) || (! record.get16(gap)) ||
+    (! record.get16(count)) || (count > IRBUTTON_MAX_RAW) || (record.remaining() < count * 2) || (! resize(count))) {
+    clear();
+    return false;
+  }
+  repeat &= 0x0F;
+  gap &= 0x0FFF;
+  for (uint16_t i = 0; i < rawBufLen; ++i)
+    record.get16(rawBuf[i]);
+
+  return true;
+}
@@ -0,0 +1,41 @@
+#ifndef __IRBUTTON_H
+#define __IRBUTTON_H
+
+#include <Arduino.h>
+
+const uint8_t IRBUTTON_NAME_SIZE = 16;
+const uint16_t IRBUTTON_MAX_RAW = 1024; // Максимальная длина raw-кода (длинные коды кондиционеров)
+
+/*
+ * Кнопка ДУ. Raw-код хранится в куче в буфере точно по его длине, поэтому короткие коды не резервируют место под длинные.
+ * Копирование выделяет память и может не удаться, поэтому вместо конструктора копирования и присваивания используются assign() и swap().
+ */
+struct irbutton_t {
+  irbutton_t() : repeat(0), gap(0), rawBufLen(0), rawBuf(NULL) {
+    *buttonName = '\0';
+  }
+  ~irbutton_t() {
+    free(rawBuf);
+  }
+  void clear(); // Кнопка без имени и кода
+  bool resize(uint16_t len); // Изменение длины raw-кода (значения в пределах новой длины сохраняются, false при нехватке памяти)
+  bool setRaw(const uint16_t *raw, uint16_t len); // Копирование raw-кода
+  bool assign(const irbutton_t &src); // Копирование кнопки (false при нехватке памяти)
+  void swap(irbutton_t &other); // Обмен содержимым без выделения памяти
+  bool equals(const irbutton_t &other) const;
+  uint16_t recordSize() const; // Длина записи encode()
+  uint16_t encode(uint8_t *data, uint16_t size) const; // Сериализация в формате little-endian (возвращает длину записи или 0)
+  bool decode(const uint8_t *data, uint16_t len); // Десериализация (поля, добавленные в следующих версиях формата, пропускаются)
+
+  char buttonName[IRBUTTON_NAME_SIZE];
+  uint8_t repeat; // 0..15 = 1..16
+  uint16_t gap; // 0..4095 ms
+  uint16_t rawBufLen;
+  uint16_t *rawBuf; // NULL, если кода нет
+
+private:
+  irbutton_t(const irbutton_t&);
+  irbutton_t &operator=(const irbutton_t&);
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include "IRMatcher.h"
+
+IRMatcher::IRMatcher(uint16_t maxCodes) : _maxCodes(maxCodes), _count(0), _hashHits(0), _scans(0) {
+  _entries = new entry_t[maxCodes];
+}
+
+IRMatcher::~IRMatcher() {
+  delete[] _entries;
+}
+
+void IRMatcher::clear() {
+  _count = 0;
+}
+
+uint32_t IRMatcher::hash(const uint16_t *raw, uint16_t len) {
+  uint16_t sorted[IRMATCH_HASH_LEN];
+  uint16_t n = len < IRMATCH_HASH_LEN ? len : IRMATCH_HASH_LEN;
+  uint32_t result = 2166136261UL; // FNV-1a
+
+  result = (result ^ (len & 0xFF)) * 16777619UL;
+  result = (result ^ (len >> 8)) * 16777619UL;
+  if (! n)
+    return result;
+  memcpy(sorted, raw, n * sizeof(uint16_t));
+  std::nth_element(sorted, sorted + n / 2, sorted + n);
+
+  uint32_t threshold = (uint32_t)sorted[n / 2] * 3 / 2; // Граница между короткими и длинными длительностями (у большинства протоколов они отличаются в 2 и более раз)
+
+  for (uint16_t i = 0; i < n; ++i)
+    result = (result ^ (raw[i] ? (raw[i] > threshold ? 2 : 1) : 0)) * 16777619UL;
+
+  return result;
+}
+
+uint32_t IRMatcher::distance(const uint16_t *a, const uint16_t *b, uint16_t len) {
+  uint32_t result = 0;
+
+  for (uint16_t i = 0; i < len; ++i) {
+    uint16_t diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    uint32_t allowed = (uint32_t)b[i] * IRMATCH_TOLERANCE / 100;
+
+    if (allowed < IRMATCH_SLACK)
+      allowed = IRMATCH_SLACK;
+    if (diff > allowed)
+      return UINT32_MAX;
+    result += diff;
+  }
+
+  return result;
+}
+
+bool IRMatcher::add(uint16_t id, const uint16_t *raw, uint16_t len) {
+  if ((_count >= _maxCodes) || (! len))
+    return false;
+
+  uint32_t h = hash(raw, len);
+  uint16_t pos = _count;
+
+  while (pos && (_entries[pos - 1].hash > h)) {
+    _entries[pos] = _entries[pos - 1];
+    --pos;
+  }
+  _entries[pos].hash = h;
+  _entries[pos].raw = raw;
+  _entries[pos].len = len;
+  _entries[pos].id = id;
+  ++_count;
+
+  return true;
+}
+
+int32_t IRMatcher::match(const uint16_t *raw, uint16_t len) const {
+  uint32_t h = hash(raw, len);
+  uint16_t lo = 0, hi = _count;
+  int32_t result = -1;
+  uint32_t best = UINT32_MAX;
+
+  while (lo < hi) { // Первый код с хэшем не меньше искомого
+    uint16_t mid = (lo + hi) / 2;
+
+    if (_entries[mid].hash < h)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for (; (lo < _count) && (_entries[lo].hash == h); ++lo) {
+    if (_entries[lo].len == len) {
+      uint32_t d = distance(raw, _entries[lo].raw, len);
+
+      if (d < best) {
+        best = d;
+        result = _entries[lo].id;
+      }
+    }
+  }
+  if (result >= 0) {
+    ++_hashHits;
+    return result;
+  }
+
+  ++_scans;
+  for (uint16_t i = 0; i < _count; ++i) {
+    if (_entries[i].len == len) {
+      uint32_t d = distance(raw, _entries[i].raw, len);
+
+      if (d < best) {
+        best = d;
+        result = _entries[i].id;
+      }
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,52 @@
+#ifndef __IRMATCHER_H
+#define __IRMATCHER_H
+
+#include <Arduino.h>
+
+const uint8_t IRMATCH_TOLERANCE = 25; // Допустимое отклонение длительности импульса или паузы в процентах
+const uint16_t IRMATCH_SLACK = 100; // Допустимое отклонение длительности в микросекундах (для коротких импульсов)
+const uint16_t IRMATCH_HASH_LEN = 128; // Количество начальных длительностей, участвующих в хэше
+
+/*
+ * Поиск принятого raw-кода среди сохраненных с учетом погрешности длительностей. Каждый код индексируется хэшем длины и деления
+ * длительностей на короткие и длинные относительно медианы, поэтому обычно сравнивать приходится только коды с тем же хэшем.
+ * Если по хэшу ничего не найдено (длительность оказалась на границе интервала квантования), просматриваются все коды той же длины.
+ * Коды не копируются: сохраненные буферы должны оставаться неизменными до следующего clear().
+ */
+class IRMatcher {
+public:
+  IRMatcher(uint16_t maxCodes);
+  ~IRMatcher();
+  void clear();
+  bool add(uint16_t id, const uint16_t *raw, uint16_t len); // Индексирование кода (id возвращается при совпадении)
+  int32_t match(const uint16_t *raw, uint16_t len) const; // id наиболее близкого кода или -1
+  uint16_t count() const {
+    return _count;
+  }
+  uint32_t hashHits() const { // Количество кодов, найденных по хэшу
+    return _hashHits;
+  }
+  uint32_t scans() const { // Количество полных просмотров после промаха по хэшу
+    return _scans;
+  }
+
+  static uint32_t hash(const uint16_t *raw, uint16_t len);
+
+protected:
+  struct entry_t {
+    uint32_t hash;
+    const uint16_t *raw;
+    uint16_t len;
+    uint16_t id;
+  };
+
+  static uint32_t distance(const uint16_t *a, const uint16_t *b, uint16_t len); // Суммарное отклонение или UINT32_MAX, если какая-либо длительность вне допуска
+
+  entry_t *_entries; // Упорядочены по hash
+  uint16_t _maxCodes;
+  uint16_t _count;
+  mutable uint32_t _hashHits;
+  mutable uint32_t _scans;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __IRTIMEOUT_H
+#define __IRTIMEOUT_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+
+const uint8_t IRTIMEOUT_CONFIRM = 3; // Количество кадров известного протокола подряд, после которых таймаут может быть сокращен
+
+/*
+ * Подбор таймаута окончания кадра приемника ИК. Для известных протоколов (кроме кондиционеров с длинными паузами внутри посылки)
+ * таймаут сокращается до удвоенной самой длинной паузы внутри кадра, но не менее minTimeout. Неизвестный код или код кондиционера
+ * сразу возвращает длинный таймаут.
+ */
+class IRTimeout {
+public:
+  IRTimeout(uint8_t longTimeout, uint8_t minTimeout) : _longTimeout(longTimeout), _minTimeout(minTimeout), _timeout(longTimeout), _type(UNKNOWN), _frames(0), _candidate(0) {}
+  bool update(decode_type_t type, const volatile uint16_t *rawbuf, uint16_t rawlen); // Учет очередного кадра (true, если таймаут изменился)
+  uint8_t timeout() const { // Текущий таймаут в миллисекундах
+    return _timeout;
+  }
+  static bool overlaps(uint32_t lastPoll, uint32_t poll, uint8_t timeout, uint32_t duration, uint32_t from, uint32_t to); // Мог ли кадр, готовый при проверке poll, но не при lastPoll, пересекаться с интервалом from..to
+
+protected:
+  static bool longGaps(decode_type_t type); // Протоколы с длинными паузами внутри посылки
+
+  uint8_t _longTimeout;
+  uint8_t _minTimeout;
+  uint8_t _timeout;
+  decode_type_t _type; // Протокол последних кадров
+  uint8_t _frames; // Количество кадров этого протокола подряд
+  uint8_t _candidate; // Таймаут, достаточный для всех этих кадров
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "MQTTQueue.h"
+
+MQTTQueue::MQTTQueue(uint16_t size, uint16_t maxCount) : _size(size), _maxCount(maxCount), _head(0), _tail(0), _count(0), _live(0), _drops(0), _coalesced(0) {
+  _buf = (uint8_t*)malloc(size);
+  if (! _buf)
+    _size = 0;
+}
+
+MQTTQueue::~MQTTQueue() {
+  if (_buf)
+    free(_buf);
+}
+
+void MQTTQueue::clear() {
+  _head = 0;
+  _tail = 0;
+  _count = 0;
+  _live = 0;
+}
+
+void MQTTQueue::skipWrap() {
+  if ((_size - _head < 2) || (! recordSize(_head)))
+    _head = 0;
+}
+
+void MQTTQueue::drop() {
+  if (! _count)
+    return;
+  skipWrap();
+  if (! (_buf[_head + 2] & FLAG_DEAD))
+    --_live;
+  _head += recordSize(_head);
+  if (! --_count) {
+    _head = 0;
+    _tail = 0;
+  } else {
+    skipWrap();
+  }
+}
+
+bool MQTTQueue::reserve(uint16_t size, uint16_t &offset) {
+  if (! _count) {
+    _head = 0;
+    _tail = 0;
+  }
+  if ((_count && (_tail == _head)) || ((_tail < _head) && (_head - _tail < size))) // Буфер заполнен или свободного места перед головой недостаточно
+    return false;
+  if (_tail >= _head) {
+    if (_size - _tail >= size) {
+      offset = _tail;
+      return true;
+    }
+    if (_count && (_head < size))
+      return false;
+    if (_size - _tail >= 2) { // Метка перехода на начало буфера
+      _buf[_tail] = 0;
+      _buf[_tail + 1] = 0;
+    }
+    offset = 0;
+    return true;
+  }
+  offset = _tail;
+
+  return true;
+}
+
+bool MQTTQueue::push(const char *topic, const uint8_t *value, uint16_t len, bool retained) {
+  size_t topicLen = strlen(topic);
+  uint32_t size = HEADER_SIZE + topicLen + 1 + len;
+
+  if ((! _maxCount) || (topicLen > 255) || (size > _size)) {
+    ++_drops;
+    return false;
+  }
+
+  if (retained) { // Неотправленное старое значение того же топика больше не нужно
+    uint16_t offset = _head;
+
+    for (uint16_t i = 0; i < _count; ++i) {
+      if ((_size - offset < 2) || (! recordSize(offset)))
+        offset = 0;
+      if ((_buf[offset + 2] == FLAG_RETAINED) && (_buf[offset + 3] == topicLen) && (! memcmp(&_buf[offset + HEADER_SIZE], topic, topicLen))) {
+        _buf[offset + 2] |= FLAG_DEAD;
+        --_live;
+        ++_coalesced;
+      }
+      offset += recordSize(offset);
+    }
+  }
+
+  uint16_t offset;
+
+  while ((_live >= _maxCount) || (! reserve(size, offset))) { // Вытеснение самых старых записей
+    if (! (_buf[_head + 2] & FLAG_DEAD))
+      ++_drops;
+    drop();
+  }
+  _buf[offset] = size;
+  _buf[offset + 1] = size >> 8;
+  _buf[offset + 2] = retained ? FLAG_RETAINED : 0;
+  _buf[offset + 3] = topicLen;
+  memcpy(&_buf[offset + HEADER_SIZE], topic, topicLen + 1);
+  memcpy(&_buf[offset + HEADER_SIZE + topicLen + 1], value, len);
+  _tail = offset + size;
+  ++_count;
+  ++_live;
+
+  return true;
+}
+
+bool MQTTQueue::peek(const char *&topic, const uint8_t *&value, uint16_t &len, bool &retained) {
+  while (_count) {
+    skipWrap();
+    if (! (_buf[_head + 2] & FLAG_DEAD)) {
+      uint8_t topicLen = _buf[_head + 3];
+
+      topic = (const char*)&_buf[_head + HEADER_SIZE];
+      value = &_buf[_head + HEADER_SIZE + topicLen + 1];
+      len = recordSize(_head) - HEADER_SIZE - topicLen - 1;
+      retained = _buf[_head + 2] & FLAG_RETAINED;
+      return true;
+    }
+    drop(); // Замененные записи удаляются без отправки
+  }
+
+  return false;
+}
+
+void MQTTQueue::pop() {
+  drop();
+}
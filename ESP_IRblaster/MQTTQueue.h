@@ -0,0 +1,53 @@
+#ifndef __MQTTQUEUE_H
+#define __MQTTQUEUE_H
+
+#include <Arduino.h>
+
+/*
+ * Очередь публикуемых MQTT-топиков в кольцевом буфере фиксированного размера. Записи [размер LE16][флаги][длина топика][топик\0][значение]
+ * хранятся непрерывно (если запись не помещается в конец буфера, она пишется с начала). При переполнении вытесняются самые старые записи,
+ * новое значение retained-топика заменяет еще не отправленное старое.
+ */
+class MQTTQueue {
+public:
+  MQTTQueue(uint16_t size, uint16_t maxCount);
+  ~MQTTQueue();
+  bool push(const char *topic, const uint8_t *value, uint16_t len, bool retained); // Добавление в очередь
+  bool peek(const char *&topic, const uint8_t *&value, uint16_t &len, bool &retained); // Самая старая запись (указатели действительны до push() или pop())
+  void pop(); // Удаление самой старой записи
+  void clear();
+
+  uint16_t count() const { // Количество ожидающих отправки записей
+    return _live;
+  }
+  uint32_t drops() const { // Количество вытесненных при переполнении записей
+    return _drops;
+  }
+  uint32_t coalesced() const { // Количество замененных более новым значением записей
+    return _coalesced;
+  }
+
+protected:
+  static const uint8_t FLAG_RETAINED = 0x01;
+  static const uint8_t FLAG_DEAD = 0x02; // Запись заменена более новой и будет пропущена
+  static const uint8_t HEADER_SIZE = 4;
+
+  uint16_t recordSize(uint16_t offset) const {
+    return _buf[offset] | (_buf[offset + 1] << 8);
+  }
+  void skipWrap(); // Переход головы очереди на начало буфера
+  void drop(); // Удаление самой старой записи (в т.ч. замененной)
+  bool reserve(uint16_t size, uint16_t &offset); // Поиск места для записи без вытеснения
+
+  uint8_t *_buf;
+  uint16_t _size;
+  uint16_t _maxCount;
+  uint16_t _head; // Смещение самой старой записи
+  uint16_t _tail; // Смещение для следующей записи
+  uint16_t _count; // Количество записей в буфере (включая замененные)
+  uint16_t _live; // Количество незамененных записей
+  uint32_t _drops;
+  uint32_t _coalesced;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "MQTTRouter.h"
+
+MQTTRouter::MQTTRouter(uint8_t maxNodes, uint16_t poolSize, uint8_t maxHandlers) : _maxNodes(maxNodes), _poolSize(poolSize), _maxHandlers(maxHandlers), _nodeCount(0), _poolUsed(0), _handlerCount(0), _root(NONE) {
+  if (_maxNodes >= NONE)
+    _maxNodes = NONE - 1;
+  if (_maxHandlers >= NONE)
+    _maxHandlers = NONE - 1;
+  _nodes = new node_t[_maxNodes];
+  _pool = new char[_poolSize];
+  _handlers = new mqtthandler_t[_maxHandlers];
+}
+
+MQTTRouter::~MQTTRouter() {
+  delete[] _handlers;
+  delete[] _pool;
+  delete[] _nodes;
+}
+
+uint8_t MQTTRouter::findChild(uint8_t parent, const char *name, uint8_t len) const {
+  uint8_t node = (parent == NONE) ? _root : _nodes[parent].child;
+
+  while (node != NONE) {
+    if ((_nodes[node].len == len) && (! memcmp(&_pool[_nodes[node].name], name, len)))
+      break;
+    node = _nodes[node].sibling;
+  }
+
+  return node;
+}
+
+uint8_t MQTTRouter::addChild(uint8_t parent, const char *name, uint8_t len) {
+  if ((_nodeCount >= _maxNodes) || (_poolSize - _poolUsed < len))
+    return NONE;
+
+  uint8_t node = _nodeCount++;
+  uint8_t &first = (parent == NONE) ? _root : _nodes[parent].child;
+
+  _nodes[node].name = _poolUsed;
+  _nodes[node].len = len;
+  _nodes[node].parent = parent;
+  _nodes[node].child = NONE;
+  _nodes[node].sibling = first;
+  _nodes[node].handler = NONE;
+  first = node;
+  memcpy(&_pool[_poolUsed], name, len);
+  _poolUsed += len;
+
+  return node;
+}
+
+bool MQTTRouter::add(const String &filter, mqtthandler_t handler) {
+  const char *level = filter.c_str();
+  uint8_t node = NONE;
+
+  for (;;) {
+    const char *end = strchr(level, '/');
+
+    if (! end)
+      end = level + strlen(level);
+    if ((end - level > 255) ||
+      ((end - level > 1) && (memchr(level, '+', end - level) || memchr(level, '#', end - level))) || // Маска должна занимать весь уровень
+      ((*level == '#') && *end)) // "#" допустима только на последнем уровне
+      return false;
+
+    uint8_t parent = node;
+
+    node = findChild(parent, level, end - level);
+    if (node == NONE) {
+      node = addChild(parent, level, end - level);
+      if (node == NONE)
+        return false;
+    }
+    if (! *end)
+      break;
+    level = end + 1;
+  }
+
+  if (_nodes[node].handler == NONE) {
+    if (_handlerCount >= _maxHandlers)
+      return false;
+    _nodes[node].handler = _handlerCount++;
+  }
+  _handlers[_nodes[node].handler] = handler; // Повторная регистрация того же фильтра заменяет обработчик
+
+  return true;
+}
+
+uint8_t MQTTRouter::matchAll(uint8_t first, const char *topic, const uint8_t *payload, uint16_t length) const {
+  for (uint8_t node = first; node != NONE; node = _nodes[node].sibling) {
+    if (isWildcard(node, '#') && (_nodes[node].handler != NONE)) {
+      _handlers[_nodes[node].handler](topic, payload, length);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+uint8_t MQTTRouter::matchLevel(uint8_t first, const char *topic, const char *level, const uint8_t *payload, uint16_t length) const {
+  const char *end = level;
+  uint8_t result = 0;
+
+  while (*end && (*end != '/'))
+    ++end;
+  for (uint8_t node = first; node != NONE; node = _nodes[node].sibling) {
+    if (isWildcard(node, '#')) {
+      if (_nodes[node].handler != NONE) {
+        _handlers[_nodes[node].handler](topic, payload, length);
+        ++result;
+      }
+    } else if (isWildcard(node, '+') || ((_nodes[node].len == end - level) && (! memcmp(&_pool[_nodes[node].name], level, end - level)))) {
+      if (*end) {
+        result += matchLevel(_nodes[node].child, topic, end + 1, payload, length);
+      } else {
+        if (_nodes[node].handler != NONE) {
+          _handlers[_nodes[node].handler](topic, payload, length);
+          ++result;
+        }
+        result += matchAll(_nodes[node].child, topic, payload, length); // "a/#" включает и сам "a"
+      }
+    }
+  }
+
+  return result;
+}
+
+uint8_t MQTTRouter::dispatch(const char *topic, const uint8_t *payload, uint16_t length) {
+  return matchLevel(_root, topic, topic, payload, length);
+}
+
+String MQTTRouter::filter(uint8_t index) const {
+  String result;
+
+  for (uint8_t node = 0; node < _nodeCount; ++node) {
+    if (_nodes[node].handler == index) {
+      for (uint8_t n = node; n != NONE; n = _nodes[n].parent) {
+        String level;
+
+        level.reserve(_nodes[n].len + 1 + result.length());
+        for (uint8_t i = 0; i < _nodes[n].len; ++i)
+          level += _pool[_nodes[n].name + i];
+        if (n != node)
+          level += '/';
+        level += result;
+        result = level;
+      }
+      break;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,56 @@
+#ifndef __MQTTROUTER_H
+#define __MQTTROUTER_H
+
+#include <Arduino.h>
+#include <functional>
+
+typedef std::function<void(const char *topic, const uint8_t *payload, uint16_t length)> mqtthandler_t; // Обработчик топика (topic - имя без префикса клиента)
+
+/*
+ * Маршрутизатор MQTT-топиков на префиксном дереве уровней топика с поддержкой масок "+" и "#". Узлы и имена уровней хранятся в массивах,
+ * выделяемых в конструкторе, поэтому ни регистрация, ни разбор входящих сообщений не требуют выделения памяти в куче.
+ */
+class MQTTRouter {
+public:
+  MQTTRouter(uint8_t maxNodes, uint16_t poolSize, uint8_t maxHandlers);
+  ~MQTTRouter();
+  bool add(const String &filter, mqtthandler_t handler); // Регистрация обработчика для фильтра топиков
+  uint8_t dispatch(const char *topic, const uint8_t *payload, uint16_t length); // Вызов всех подходящих обработчиков (возвращает их количество)
+  uint8_t count() const { // Количество зарегистрированных фильтров
+    return _handlerCount;
+  }
+  String filter(uint8_t index) const; // Фильтр топиков обработчика с заданным индексом
+
+protected:
+  static const uint8_t NONE = 0xFF;
+
+  struct __attribute__((__packed__)) node_t {
+    uint16_t name; // Смещение имени уровня в _pool
+    uint8_t len; // Длина имени уровня
+    uint8_t parent;
+    uint8_t child; // Первый дочерний узел
+    uint8_t sibling; // Следующий узел того же уровня
+    uint8_t handler; // Индекс обработчика или NONE
+  };
+
+  bool isWildcard(uint8_t node, char c) const {
+    return (_nodes[node].len == 1) && (_pool[_nodes[node].name] == c);
+  }
+  uint8_t findChild(uint8_t parent, const char *name, uint8_t len) const;
+  uint8_t addChild(uint8_t parent, const char *name, uint8_t len);
+  uint8_t matchLevel(uint8_t first, const char *topic, const char *level, const uint8_t *payload, uint16_t length) const; // Рекурсивный поиск подходящих узлов
+  uint8_t matchAll(uint8_t first, const char *topic, const uint8_t *payload, uint16_t length) const; // Вызов обработчика дочерней маски "#"
+
+  node_t *_nodes;
+  char *_pool;
+  mqtthandler_t *_handlers;
+  uint8_t _maxNodes;
+  uint16_t _poolSize;
+  uint8_t _maxHandlers;
+  uint8_t _nodeCount;
+  uint16_t _poolUsed;
+  uint8_t _handlerCount;
+  uint8_t _root; // Первый узел верхнего уровня
+};
+
+#endif
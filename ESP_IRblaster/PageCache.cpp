@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <string.h>
+#include "PageCache.h"
+
+PageCache::PageCache(uint8_t slots, uint16_t maxSize) : _count(slots), _size(0), _maxSize(maxSize) {
+  _slots = new slot_t[slots];
+  memset(_slots, 0, sizeof(slot_t) * slots);
+}
+
+PageCache::~PageCache() {
+  clear();
+  delete[] _slots;
+}
+
+void PageCache::release(uint8_t slot) {
+  if (_slots[slot].data) {
+    free(_slots[slot].data);
+    _slots[slot].data = NULL;
+    _size -= _slots[slot].len;
+    _slots[slot].len = 0;
+  }
+}
+
+bool PageCache::get(uint8_t slot, uint32_t key, String &page) {
+  if ((slot >= _count) || (! _slots[slot].data) || (_slots[slot].key != key))
+    return false;
+
+  page += _slots[slot].data;
+
+  return true;
+}
+
+void PageCache::put(uint8_t slot, uint32_t key, const String &fragment) {
+  if (slot >= _count)
+    return;
+
+  release(slot);
+  if (_size + fragment.length() > _maxSize) // Не помещается, фрагмент будет формироваться заново
+    return;
+  _slots[slot].data = (char*)malloc(fragment.length() + 1);
+  if (_slots[slot].data) {
+    memcpy(_slots[slot].data, fragment.c_str(), fragment.length() + 1);
+    _slots[slot].len = fragment.length();
+    _slots[slot].key = key;
+    _size += _slots[slot].len;
+  }
+}
+
+void PageCache::clear() {
+  for (uint8_t i = 0; i < _count; ++i)
+    release(i);
+}
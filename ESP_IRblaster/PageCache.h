@@ -0,0 +1,31 @@
+#ifndef __PAGECACHE_H
+#define __PAGECACHE_H
+
+#include <WString.h>
+
+class PageCache { // Кэш готовых фрагментов Web-страниц ограниченного суммарного размера
+public:
+  PageCache(uint8_t slots, uint16_t maxSize);
+  ~PageCache();
+  bool get(uint8_t slot, uint32_t key, String &page); // Дописать фрагмент к странице, если он закэширован с тем же ключом
+  void put(uint8_t slot, uint32_t key, const String &fragment); // Запомнить фрагмент (если он помещается в кэш)
+  void clear(); // Очистка кэша
+  uint16_t size() const { // Суммарный размер закэшированных фрагментов
+    return _size;
+  }
+protected:
+  void release(uint8_t slot);
+
+  struct slot_t {
+    uint32_t key; // Ключ (как правило, счетчик изменений конфигурации)
+    char *data;
+    uint16_t len;
+  };
+
+  slot_t *_slots;
+  uint8_t _count;
+  uint16_t _size;
+  uint16_t _maxSize;
+};
+
+#endif
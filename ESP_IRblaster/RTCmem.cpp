@@ -1,103 +1,111 @@
 #include "RTCmem.h"
 
-static const uint16_t RTC_MEM_SIZE = 512;
+void RTCmemory::load() {
+  if (! _loaded) {
+    ESP.rtcUserMemoryRead(0, _cache, sizeof(_cache));
+    _loaded = true;
+  }
+}
 
 uint8_t RTCmemory::read(uint16_t index) {
-  if (index < RTC_MEM_SIZE) {
-    uint8_t b[4];
+  uint8_t data = 0;
 
-    ESP.rtcUserMemoryRead(index / 4, (uint32_t*)b, sizeof(b));
-    return b[index % 4];
-  } else
-    return 0;
+  read(index, &data, sizeof(data));
+  return data;
 }
 
 void RTCmemory::read(uint16_t index, uint8_t* buf, uint16_t len) {
   if (len && (index + len <= RTC_MEM_SIZE)) {
-    uint8_t b[4];
-    uint16_t l;
+    if (index < RTC_CACHE_SIZE) {
+      uint16_t l = RTC_CACHE_SIZE - index;
 
-    if (index % 4) { // partial dword at start of buf
-      l = 4 - index % 4;
       if (l > len)
         l = len;
-      ESP.rtcUserMemoryRead(index / 4, (uint32_t*)b, sizeof(b));
-      if (l > 2)
-        *buf++ = b[1];
-      if (l > 1)
-        *buf++ = b[2];
-      *buf++ = b[3];
-      index = (index + 4) / 4 * 4;
+      load();
+      memcpy(buf, (uint8_t*)_cache + index, l);
+      index += l;
+      buf += l;
       len -= l;
     }
-    if (len >= 4) { // whole dword(s) inside buf
-      l = len / 4;
-      ESP.rtcUserMemoryRead(index / 4, (uint32_t*)buf, l * 4);
-      index += (l * 4);
-      len -= (l * 4);
-      buf += (l * 4);
-    }
-    if (len) { // partial dword at end of buf
-      l = len;
-      ESP.rtcUserMemoryRead(index / 4, (uint32_t*)b, sizeof(b));
-      *buf++ = b[0];
-      if (l > 1)
-        *buf++ = b[1];
-      if (l > 2)
-        *buf++ = b[2];
-    }
+    if (len)
+      readDirect(index, buf, len);
   }
 }
 
 void RTCmemory::write(uint16_t index, uint8_t data) {
-  if (index < RTC_MEM_SIZE) {
-    uint8_t b[4];
-
-    ESP.rtcUserMemoryRead(index / 4, (uint32_t*)b, sizeof(b));
-    if (b[index % 4] != data) {
-      b[index % 4] = data;
-      ESP.rtcUserMemoryWrite(index / 4, (uint32_t*)b, sizeof(b));
-    }
-  }
+  write(index, &data, sizeof(data));
 }
 
 void RTCmemory::write(uint16_t index, const uint8_t* buf, uint16_t len) {
   if (len && (index + len <= RTC_MEM_SIZE)) {
-    uint8_t b[4];
-    uint16_t l;
+    if (index < RTC_CACHE_SIZE) {
+      uint8_t *cache = (uint8_t*)_cache;
 
-    if (index % 4) { // partial dword at start of buf
-      l = 4 - index % 4;
-      if (l > len)
-        l = len;
-      ESP.rtcUserMemoryRead(index / 4, (uint32_t*)b, sizeof(b));
-      if (l > 2)
-        b[1] = *buf++;
-      if (l > 1)
-        b[2] = *buf++;
-      b[3] = *buf++;
-      ESP.rtcUserMemoryWrite(index / 4, (uint32_t*)b, sizeof(b));
-      index = (index + 4) / 4 * 4;
-      len -= l;
-    }
-    if (len >= 4) { // whole dword(s) inside buf
-      l = len / 4;
-      ESP.rtcUserMemoryWrite(index / 4, (uint32_t*)buf, l * 4);
-      index += (l * 4);
-      len -= (l * 4);
-      buf += (l * 4);
+      load();
+      while (len && (index < RTC_CACHE_SIZE)) {
+        if (cache[index] != *buf) { // Неизмененные байты не помечают слово для записи
+          cache[index] = *buf;
+          _dirty |= (1UL << (index / 4));
+        }
+        ++index;
+        ++buf;
+        --len;
+      }
     }
-    if (len) { // partial dword at end of buf
+    if (len)
+      writeDirect(index, buf, len);
+  }
+}
+
+void RTCmemory::readDirect(uint16_t index, uint8_t* buf, uint16_t len) {
+  while (len) {
+    uint32_t dword;
+    uint16_t l = 4 - index % 4;
+
+    if (l > len)
       l = len;
-      ESP.rtcUserMemoryRead(index / 4, (uint32_t*)b, sizeof(b));
-      b[0] = *buf++;
-      if (l > 1)
-        b[1] = *buf++;
-      if (l > 2)
-        b[2] = *buf++;
-      ESP.rtcUserMemoryWrite(index / 4, (uint32_t*)b, sizeof(b));
+    ESP.rtcUserMemoryRead(index / 4, &dword, sizeof(dword));
+    memcpy(buf, (uint8_t*)&dword + index % 4, l);
+    index += l;
+    buf += l;
+    len -= l;
+  }
+}
+
+void RTCmemory::writeDirect(uint16_t index, const uint8_t* buf, uint16_t len) {
+  while (len) {
+    uint32_t dword;
+    uint16_t l = 4 - index % 4;
+
+    if (l > len)
+      l = len;
+    ESP.rtcUserMemoryRead(index / 4, &dword, sizeof(dword));
+    if (memcmp((uint8_t*)&dword + index % 4, buf, l)) {
+      memcpy((uint8_t*)&dword + index % 4, buf, l);
+      ESP.rtcUserMemoryWrite(index / 4, &dword, sizeof(dword));
     }
+    index += l;
+    buf += l;
+    len -= l;
   }
 }
 
+bool RTCmemory::flush() {
+  if (! _dirty)
+    return true;
+
+  uint8_t first = 0, last = RTC_CACHE_SIZE / 4 - 1;
+
+  while (! (_dirty & (1UL << first)))
+    ++first;
+  while (! (_dirty & (1UL << last)))
+    --last;
+  if (! ESP.rtcUserMemoryWrite(first, &_cache[first], (last - first + 1) * 4)) // Неизмененные слова между первым и последним измененным пишутся заодно
+    return false;
+  _dirty = 0;
+  ++_flushes;
+
+  return true;
+}
+
 RTCmemory RTCmem;
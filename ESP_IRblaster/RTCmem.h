@@ -2,21 +2,66 @@
 #define __RTCMEM_H
 
 #include <Arduino.h>
+#include "Crc.h"
 
+const uint16_t RTC_MEM_SIZE = 512; // Размер пользовательской RTC-памяти
+const uint16_t RTC_CACHE_SIZE = 128; // Размер начального участка RTC-памяти, кэшируемого в RAM (не более 32 слов)
+const uint8_t RTC_SLOT_CRC_INIT = 0x5A; // Начальное значение CRC-8 слотов (обнуленная память не считается корректной)
+
+/*
+ * Доступ к RTC-памяти ESP8266. Начальные RTC_CACHE_SIZE байт читаются одним вызовом при первом обращении,
+ * изменения накапливаются в RAM с пометкой измененных слов и записываются одним вызовом в flush().
+ * Участок за пределами кэша читается и пишется напрямую пословно.
+ */
 class RTCmemory {
 public:
-  static uint8_t read(uint16_t index);
-  static void read(uint16_t index, uint8_t* buf, uint16_t len);
-  static void write(uint16_t index, uint8_t data);
-  static void write(uint16_t index, const uint8_t* buf, uint16_t len);
-  template<typename T> static T& get(uint16_t index, T& t) {
+  RTCmemory() : _loaded(false), _dirty(0), _flushes(0) {}
+  uint8_t read(uint16_t index);
+  void read(uint16_t index, uint8_t* buf, uint16_t len);
+  void write(uint16_t index, uint8_t data);
+  void write(uint16_t index, const uint8_t* buf, uint16_t len);
+  template<typename T> T& get(uint16_t index, T& t) {
     read(index, (uint8_t*)&t, sizeof(T));
     return t;
   }
-  template<typename T> static const T& put(uint16_t index, const T& t) {
+  template<typename T> const T& put(uint16_t index, const T& t) {
     write(index, (const uint8_t*)&t, sizeof(T));
     return t;
   }
+  template<typename T> bool getSlot(uint16_t index, T& t) { // Чтение значения со своей CRC-8 (занимает sizeof(T) + 1 байт)
+    T value;
+    uint8_t crc;
+
+    read(index, (uint8_t*)&value, sizeof(T));
+    read(index + sizeof(T), &crc, sizeof(crc));
+    if (crc != crc8((const uint8_t*)&value, sizeof(T), RTC_SLOT_CRC_INIT))
+      return false;
+    t = value;
+    return true;
+  }
+  template<typename T> void putSlot(uint16_t index, const T& t) { // Запись значения со своей CRC-8
+    uint8_t crc = crc8((const uint8_t*)&t, sizeof(T), RTC_SLOT_CRC_INIT);
+
+    write(index, (const uint8_t*)&t, sizeof(T));
+    write(index + sizeof(T), &crc, sizeof(crc));
+  }
+  bool dirty() const { // Есть незаписанные изменения
+    return _dirty != 0;
+  }
+  bool flush(); // Запись измененных слов кэша одним вызовом
+  uint32_t flushes() const { // Количество записей кэша в RTC-память
+    return _flushes;
+  }
+
+protected:
+  void load(); // Чтение кэшируемого участка при первом обращении
+  void readDirect(uint16_t index, uint8_t* buf, uint16_t len); // Пословное чтение за пределами кэша
+  void writeDirect(uint16_t index, const uint8_t* buf, uint16_t len); // Пословная запись за пределами кэша (только измененных слов)
+
+  uint32_t _cache[RTC_CACHE_SIZE / 4];
+  bool _loaded;
+  uint32_t _dirty; // Битовая маска измененных слов кэша
+  uint32_t _flushes;
 };
 
 extern RTCmemory RTCmem;
@@ -0,0 +1,151 @@
+#include <pgmspace.h>
+#include "RawCode.h"
+
+void RawCodeParser::reset() {
+  _len = 0;
+  _lowByte = -1;
+  _quad = 0;
+  _quadLen = 0;
+  _padding = false;
+  _error = RAWCODE_OK;
+}
+
+bool RawCodeParser::writeByte(uint8_t data) {
+  if (_lowByte < 0) {
+    _lowByte = data;
+  } else {
+    if (_len >= _maxlen) {
+      _error = RAWCODE_TRUNCATED;
+      return false;
+    }
+    _buf[_len++] = (data << 8) | _lowByte;
+    _lowByte = -1;
+  }
+
+  return true;
+}
+
+bool RawCodeParser::write(const uint8_t *data, uint16_t len) {
+  if (_error != RAWCODE_OK)
+    return false;
+
+  while (len--) {
+    if (! writeByte(*data++))
+      return false;
+  }
+
+  return true;
+}
+
+bool RawCodeParser::writeBase64(const char *str, uint16_t len) {
+  if (_error != RAWCODE_OK)
+    return false;
+
+  while (len--) {
+    char c = *str++;
+    uint8_t v;
+
+    if ((c >= 'A') && (c <= 'Z'))
+      v = c - 'A';
+    else if ((c >= 'a') && (c <= 'z'))
+      v = c - 'a' + 26;
+    else if ((c >= '0') && (c <= '9'))
+      v = c - '0' + 52;
+    else if ((c == '+') || (c == ' ') || (c == '-')) // Пробел - результат URL-декодирования '+'
+      v = 62;
+    else if ((c == '/') || (c == '_'))
+      v = 63;
+    else if (c == '=') {
+      _padding = true;
+      continue;
+    } else if ((c == '\r') || (c == '\n') || (c == '\t'))
+      continue;
+    else {
+      _error = RAWCODE_ILLEGAL;
+      return false;
+    }
+    if (_padding) { // Данные после символа выравнивания
+      _error = RAWCODE_ILLEGAL;
+      return false;
+    }
+    _quad = (_quad << 6) | v;
+    if (++_quadLen == 4) {
+      if ((! writeByte(_quad >> 16)) || (! writeByte(_quad >> 8)) || (! writeByte(_quad)))
+        return false;
+      _quad = 0;
+      _quadLen = 0;
+    }
+  }
+
+  return true;
+}
+
+rawcode_error_t RawCodeParser::finish() {
+  if (_error == RAWCODE_OK) {
+    if (_quadLen == 1)
+      _error = RAWCODE_ILLEGAL;
+    else if (_quadLen == 2)
+      writeByte(_quad >> 4);
+    else if (_quadLen == 3) {
+      if (writeByte(_quad >> 10))
+        writeByte(_quad >> 2);
+    }
+    _quad = 0;
+    _quadLen = 0;
+    if ((_error == RAWCODE_OK) && (_lowByte >= 0)) // Нечетное количество байт
+      _error = RAWCODE_ILLEGAL;
+  }
+
+  return _error;
+}
+
+rawcode_error_t parseRawDecimal(const char *str, uint16_t len, uint16_t *buf, uint16_t maxlen, uint16_t &rawlen) {
+  const char *end = str + len;
+
+  rawlen = 0;
+  while ((str < end) && ((*str < '0') || (*str > '9'))) // Skip leading delimiter(s)
+    ++str;
+  while (str < end) {
+    uint32_t value = 0;
+
+    if (rawlen >= maxlen)
+      return RAWCODE_TRUNCATED;
+    while ((str < end) && (*str >= '0') && (*str <= '9')) {
+      value = value * 10 + (*str++ - '0');
+      if (value > UINT16_MAX)
+        return RAWCODE_OVERFLOW;
+    }
+    buf[rawlen++] = value;
+    while ((str < end) && ((*str < '0') || (*str > '9'))) // Skip delimiter(s)
+      ++str;
+  }
+
+  return RAWCODE_OK;
+}
+
+rawcode_error_t parseRawBase64(const char *str, uint16_t len, uint16_t *buf, uint16_t maxlen, uint16_t &rawlen) {
+  RawCodeParser parser(buf, maxlen);
+
+  parser.writeBase64(str, len);
+  parser.finish();
+  rawlen = parser.length();
+
+  return parser.error();
+}
+
+const __FlashStringHelper *rawCodeErrorStr(rawcode_error_t error) {
+  switch (error) {
+    case RAWCODE_OK:
+      return F("OK");
+    case RAWCODE_ILLEGAL:
+      return F("Illegal raw code!");
+    case RAWCODE_OVERFLOW:
+      return F("Raw code value overflow!");
+    case RAWCODE_TRUNCATED:
+      return F("Raw code too long!");
+    case RAWCODE_NOMEMORY:
+      return F("Not enough memory for raw code!");
+  }
+
+  return F("Unknown error!");
+}
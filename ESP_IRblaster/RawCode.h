@@ -0,0 +1,34 @@
+#ifndef __RAWCODE_H
+#define __RAWCODE_H
+
+#include <Arduino.h>
+
+enum rawcode_error_t : uint8_t { RAWCODE_OK, RAWCODE_ILLEGAL, RAWCODE_OVERFLOW, RAWCODE_TRUNCATED, RAWCODE_NOMEMORY }; // Результат разбора кода
+
+class RawCodeParser { // Потоковый разбор raw-кода в формате little-endian uint16 прямо в буфер назначения
+public:
+  RawCodeParser(uint16_t *buf, uint16_t maxlen) : _buf(buf), _maxlen(maxlen) { reset(); }
+  void reset(); // Начать разбор заново
+  bool write(const uint8_t *data, uint16_t len); // Очередная порция двоичных данных
+  bool writeBase64(const char *str, uint16_t len); // Очередная порция данных в кодировке Base64
+  rawcode_error_t finish(); // Завершение разбора
+  uint16_t length() const { return _len; } // Количество разобранных значений
+  rawcode_error_t error() const { return _error; }
+protected:
+  bool writeByte(uint8_t data);
+
+  uint16_t *_buf;
+  uint16_t _maxlen;
+  uint16_t _len;
+  int16_t _lowByte; // Младший байт незавершенного значения (-1, если его нет)
+  uint32_t _quad; // Накопленные 6-ти битные группы Base64
+  uint8_t _quadLen;
+  bool _padding; // Встречен символ выравнивания Base64
+  rawcode_error_t _error;
+};
+
+rawcode_error_t parseRawDecimal(const char *str, uint16_t len, uint16_t *buf, uint16_t maxlen, uint16_t &rawlen); // Разбор кода в виде списка десятичных чисел через разделители
+rawcode_error_t parseRawBase64(const char *str, uint16_t len, uint16_t *buf, uint16_t maxlen, uint16_t &rawlen); // Разбор кода в кодировке Base64
+const __FlashStringHelper *rawCodeErrorStr(rawcode_error_t error); // Текстовое описание ошибки разбора
+
+#endif
@@ -0,0 +1,77 @@
+#include "Record.h"
+
+bool RecordWriter::put(const void *data, uint16_t len) {
+  if ((! _ok) || (_len + len > _size)) {
+    _ok = false;
+    return false;
+  }
+  memcpy(&_buf[_len], data, len);
+  _len += len;
+
+  return true;
+}
+
+bool RecordWriter::put8(uint8_t value) {
+  return put(&value, sizeof(value));
+}
+
+bool RecordWriter::put16(uint16_t value) {
+  uint8_t data[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+
+  return put(data, sizeof(data));
+}
+
+bool RecordWriter::put32(uint32_t value) {
+  uint8_t data[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+
+  return put(data, sizeof(data));
+}
+
+bool RecordWriter::putStr(const char *str, uint8_t maxlen) {
+  uint8_t len = strnlen(str, maxlen);
+
+  return put8(len) && put(str, len);
+}
+
+bool RecordReader::get(void *data, uint16_t len) {
+  if (_pos + len > _len)
+    return false;
+  memcpy(data, &_buf[_pos], len);
+  _pos += len;
+
+  return true;
+}
+
+bool RecordReader::get8(uint8_t &value) {
+  return get(&value, sizeof(value));
+}
+
+bool RecordReader::get16(uint16_t &value) {
+  uint8_t data[2];
+
+  if (! get(data, sizeof(data)))
+    return false;
+  value = data[0] | (data[1] << 8);
+
+  return true;
+}
+
+bool RecordReader::get32(uint32_t &value) {
+  uint8_t data[4];
+
+  if (! get(data, sizeof(data)))
+    return false;
+  value = data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+
+  return true;
+}
+
+bool RecordReader::getStr(char *str, uint8_t size) {
+  uint8_t len;
+
+  if ((! get8(len)) || (len >= size) || (_pos + len > _len))
+    return false;
+  memset(str, 0, size);
+
+  return get(str, len);
+}
@@ -0,0 +1,46 @@
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include <Arduino.h>
+
+class RecordWriter { // Сериализация полей в буфер в формате little-endian без выравнивания
+public:
+  RecordWriter(uint8_t *buf, uint16_t size) : _buf(buf), _size(size), _len(0), _ok(true) {}
+  bool put8(uint8_t value);
+  bool put16(uint16_t value);
+  bool put32(uint32_t value);
+  bool put(const void *data, uint16_t len);
+  bool putStr(const char *str, uint8_t maxlen); // Длина (1 байт) и символы строки без завершающего нуля
+  uint16_t length() const {
+    return _len;
+  }
+  bool ok() const { // Все поля поместились в буфер
+    return _ok;
+  }
+
+protected:
+  uint8_t *_buf;
+  uint16_t _size;
+  uint16_t _len;
+  bool _ok;
+};
+
+class RecordReader { // Десериализация полей из буфера; поля за концом записи не читаются (остаются значения по умолчанию)
+public:
+  RecordReader(const uint8_t *buf, uint16_t len) : _buf(buf), _len(len), _pos(0) {}
+  bool get8(uint8_t &value);
+  bool get16(uint16_t &value);
+  bool get32(uint32_t &value);
+  bool get(void *data, uint16_t len);
+  bool getStr(char *str, uint8_t size); // Строка, записанная putStr(), в буфер размером size
+  uint16_t remaining() const {
+    return _len - _pos;
+  }
+
+protected:
+  const uint8_t *_buf;
+  uint16_t _len;
+  uint16_t _pos;
+};
+
+#endif
@@ -37,6 +37,7 @@ public:
   String toString(); // Строковое представление расписания
   operator String() { return toString(); }
   String nextTimeStr(); // Строковое представление времени следующего события
+  uint32_t nextTime() const { return _nextTime; } // Время следующего события
 protected:
   uint32_t next(uint32_t unixtime); // Вычисление времени следующего события
 
@@ -0,0 +1,50 @@
+#ifndef __ARDUINO_H
+#define __ARDUINO_H
+
+// Минимальная замена ядра ESP8266 для сборки модулей скетча на хосте
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define PROGMEM
+#define PGM_P const char*
+
+class __FlashStringHelper;
+
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper*>(p))
+#define pgm_read_byte(a) (*(const uint8_t*)(a))
+#define pgm_read_word(a) (*(const uint16_t*)(a))
+#define pgm_read_dword(a) (*(const uint32_t*)(a))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+
+class String : public std::string {
+public:
+  String(const char *s = "") : std::string(s) {}
+  String(const __FlashStringHelper *s) : std::string(reinterpret_cast<const char*>(s)) {}
+  String(const std::string &s) : std::string(s) {}
+  String &operator+=(const String &s) { append(s); return *this; }
+  String &operator+=(char c) { push_back(c); return *this; }
+  unsigned char reserve(unsigned int size) { std::string::reserve(size); return 1; }
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) {
+    size_t result = 0;
+
+    while (size--)
+      result += write(*buf++);
+    return result;
+  }
+};
+
+#endif
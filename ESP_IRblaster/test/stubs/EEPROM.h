@@ -0,0 +1,56 @@
+#ifndef __EEPROM_H
+#define __EEPROM_H
+
+// Буфер EEPROM в памяти хоста; commit() только подсчитывает записи во "flash"
+
+#include "Arduino.h"
+
+class EEPROMClass {
+public:
+  EEPROMClass() : _data(NULL), _size(0), _dirty(false), commits(0) {}
+  void begin(size_t size) {
+    _data = (uint8_t*)realloc(_data, size);
+    memset(_data, 0xFF, size);
+    _size = size;
+    _dirty = false;
+  }
+  void end() {
+    free(_data);
+    _data = NULL;
+    _size = 0;
+  }
+  uint8_t read(int address) {
+    return ((address >= 0) && ((size_t)address < _size)) ? _data[address] : 0;
+  }
+  void write(int address, uint8_t value) {
+    if ((address >= 0) && ((size_t)address < _size) && (_data[address] != value)) {
+      _data[address] = value;
+      _dirty = true;
+    }
+  }
+  bool commit() {
+    if (_dirty)
+      ++commits;
+    _dirty = false;
+    return true;
+  }
+  uint8_t *getDataPtr() {
+    _dirty = true;
+    return _data;
+  }
+  const uint8_t *getConstDataPtr() const {
+    return _data;
+  }
+
+private:
+  uint8_t *_data;
+  size_t _size;
+  bool _dirty;
+
+public:
+  uint32_t commits; // Количество записей во flash
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef __FS_H
+#define __FS_H
+
+// SPIFFS в памяти хоста: файлы хранятся в std::map, запись можно прервать через failAfter
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "Arduino.h"
+
+struct MemFS {
+  MemFS() : failAfter(-1) {}
+  std::map<std::string, std::vector<uint8_t> > files;
+  int32_t failAfter; // Сколько еще байт можно записать (-1 - без ограничения)
+};
+
+extern MemFS memfs;
+
+class File {
+public:
+  File() : _pos(0), _ok(false) {}
+  operator bool() const {
+    return _ok;
+  }
+  size_t size() const {
+    return memfs.files[_name].size();
+  }
+  size_t read(uint8_t *buf, size_t len) {
+    std::vector<uint8_t> &data = memfs.files[_name];
+    size_t result = std::min(len, data.size() - _pos);
+
+    memcpy(buf, data.data() + _pos, result);
+    _pos += result;
+    return result;
+  }
+  size_t write(const uint8_t *buf, size_t len) {
+    std::vector<uint8_t> &data = memfs.files[_name];
+
+    if (memfs.failAfter >= 0) {
+      len = std::min<size_t>(len, memfs.failAfter);
+      memfs.failAfter -= len;
+    }
+    data.insert(data.end(), buf, buf + len);
+    return len;
+  }
+  void close() {
+    _ok = false;
+  }
+
+private:
+  friend class FS;
+  std::string _name;
+  size_t _pos;
+  bool _ok;
+};
+
+class FS {
+public:
+  File open(const String &name, const char *mode) {
+    File result;
+
+    if (*mode == 'r') {
+      if (! memfs.files.count(name))
+        return result;
+    } else if (*mode == 'w')
+      memfs.files[name].clear();
+    else
+      memfs.files[name];
+    result._name = name;
+    result._ok = true;
+    return result;
+  }
+  bool exists(const String &name) {
+    return memfs.files.count(name);
+  }
+  bool remove(const String &name) {
+    return memfs.files.erase(name);
+  }
+  bool rename(const String &from, const String &to) {
+    if (! memfs.files.count(from))
+      return false;
+    memfs.files[to] = memfs.files[from];
+    memfs.files.erase(from);
+    return true;
+  }
+};
+
+extern FS SPIFFS;
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __IRREMOTEESP8266_H
+#define __IRREMOTEESP8266_H
+
+// Протоколы и шаг rawbuf библиотеки IRremoteESP8266 2.3
+
+#include "Arduino.h"
+
+enum decode_type_t {
+  UNKNOWN = -1, UNUSED = 0, RC5, RC6, NEC, SONY, PANASONIC, JVC, SAMSUNG, WHYNTER, AIWA_RC_T501, LG, SANYO, MITSUBISHI, DISH, SHARP, COOLIX,
+  DAIKIN, DENON, KELVINATOR, SHERWOOD, MITSUBISHI_AC, RCMM, SANYO_LC7461, RC5X, GREE, PRONTO, NEC_LIKE, ARGO, TROTEC
+};
+
+#define RAWTICK 2 // Микросекунд на единицу rawbuf
+
+#endif
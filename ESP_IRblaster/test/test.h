@@ -0,0 +1,50 @@
+#ifndef __TEST_H
+#define __TEST_H
+
+// Общие средства host-тестов: проверки, детерминированный ГПСЧ и замер времени
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+
+static int testFailures = 0;
+
+#define CHECK(cond) do { \
+  if (! (cond)) { \
+    fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    ++testFailures; \
+  } \
+} while (0)
+
+static uint32_t testSeed = 2463534242UL;
+
+static inline uint32_t testRandom() { // xorshift32, одинаковая последовательность при каждом запуске
+  testSeed ^= testSeed << 13;
+  testSeed ^= testSeed >> 17;
+  testSeed ^= testSeed << 5;
+  return testSeed;
+}
+
+static inline uint32_t testRandom(uint32_t range) { // 0..range-1
+  return testRandom() % range;
+}
+
+class Stopwatch {
+public:
+  Stopwatch() : _start(std::chrono::steady_clock::now()) {}
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+  }
+private:
+  std::chrono::steady_clock::time_point _start;
+};
+
+static inline int testResult(const char *name) {
+  if (testFailures)
+    printf("%s: %d check(s) FAILED\n", name, testFailures);
+  else
+    printf("%s: OK\n", name);
+  return testFailures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,199 @@
+// Round-trip тест архива конфигурации (ConfigBackup.cpp): запись writeBackup() и разбор с наследником, добавляющим свою секцию
+
+#include <vector>
+#include <FS.h>
+#include "test.h"
+#include "ConfigBackup.h"
+#include "Crc.h"
+
+MemFS memfs;
+FS SPIFFS;
+
+static const char journalFile[] = "/config.jnl";
+static const char journalTemp[] = "/config.tmp";
+static const char archiveFile[] = "/backup.bin";
+
+static const uint8_t BACKUP_BLOB = BACKUP_EXTRA; // Секция наследника (как BACKUP_BUTTONS в ESPIRBlaster)
+
+class JournalBackup : public ConfigBackup { // Только секция журнала
+public:
+  JournalBackup(ConfigJournal &journal) {
+    _config = &journal;
+  }
+};
+
+class BlobBackup : public JournalBackup { // Секция журнала и двоичные данные в отдельной секции
+public:
+  BlobBackup(ConfigJournal &journal) : JournalBackup(journal) {}
+
+  uint32_t backupSize() override {
+    return JournalBackup::backupSize() + BACKUP_SECTION_HEADER + blob.size();
+  }
+  bool writeBackup(Print &out) override {
+    return JournalBackup::writeBackup(out) && writeBackupSection(out, BACKUP_BLOB, blob.size()) &&
+      (out.write(blob.data(), blob.size()) == blob.size());
+  }
+  bool restoreSection(uint8_t section, uint32_t len, BufferedFile &in) override {
+    if (section != BACKUP_BLOB)
+      return JournalBackup::restoreSection(section, len, in);
+    blob.resize(len);
+    return in.read(blob.data(), len);
+  }
+
+  std::vector<uint8_t> blob;
+};
+
+static bool writeArchive(ConfigBackup &backup) { // Как ESPWebBase::handleBackup(), но в файл
+  File file = SPIFFS.open(archiveFile, "w");
+  BufferedFile out(file);
+
+  if ((! ConfigBackup::writeBackupHeader(out)) || (! backup.writeBackup(out)) || (out.write(BACKUP_END) != 1) || (! out.flush()))
+    return false;
+  file.close();
+
+  std::vector<uint8_t> &data = memfs.files[archiveFile];
+  uint16_t crc = crc16(data.data(), data.size());
+
+  data.push_back(crc);
+  data.push_back(crc >> 8);
+  return true;
+}
+
+static bool readArchive(ConfigBackup &backup) { // Как ESPWebBase::restoreBackup() без применения
+  File file = SPIFFS.open(archiveFile, "r");
+  uint32_t size = file.size();
+  BufferedFile in(file);
+
+  if ((size < BACKUP_HEADER + 1 + sizeof(uint16_t)) || (! in.skip(size - sizeof(uint16_t))))
+    return false;
+
+  uint16_t crc = in.crc();
+  uint8_t data[sizeof(uint16_t)];
+
+  if ((! in.read(data, sizeof(data))) || (crc != (data[0] | (data[1] << 8))))
+    return false;
+
+  File again = SPIFFS.open(archiveFile, "r");
+  BufferedFile body(again);
+
+  return ConfigBackup::readBackupHeader(body) && backup.readBackupSections(body);
+}
+
+static void fillJournal(ConfigJournal &journal) {
+  static const uint32_t interval = 3600;
+  std::vector<uint8_t> big(JOURNAL_MAX_VALUE);
+
+  for (size_t i = 0; i < big.size(); ++i)
+    big[i] = testRandom(256);
+  CHECK(journal.put("ssid", "home", 5));
+  CHECK(journal.put("ntpInterval", &interval, sizeof(interval)));
+  CHECK(journal.put("empty", "", 0));
+  CHECK(journal.put("big", big.data(), big.size()));
+}
+
+static bool sameJournal(const ConfigJournal &a, const ConfigJournal &b) {
+  const char *key;
+  const uint8_t *value;
+  uint16_t len;
+
+  if (a.count() != b.count())
+    return false;
+  for (uint16_t i = 0; a.entry(i, key, value, len); ++i) {
+    std::vector<uint8_t> other(len + 1);
+
+    if ((b.length(key) != len) || (! b.get(key, other.data(), len)) || memcmp(value, other.data(), len))
+      return false;
+  }
+  return true;
+}
+
+static void testRoundTrip() {
+  memfs.files.clear();
+
+  ConfigJournal journal(journalFile, journalTemp, 4096);
+  BlobBackup backup(journal);
+
+  fillJournal(journal);
+  backup.blob.resize(3000);
+  for (size_t i = 0; i < backup.blob.size(); ++i)
+    backup.blob[i] = testRandom(256);
+  CHECK(writeArchive(backup));
+  CHECK(memfs.files[archiveFile].size() == BACKUP_HEADER + backup.backupSize() + 1 + sizeof(uint16_t)); // Content-Length в handleBackup()
+
+  ConfigJournal restored(journalFile, journalTemp, 4096);
+  BlobBackup target(restored);
+
+  CHECK(restored.put("stale", "x", 2)); // Секция журнала заменяет прежние значения
+  CHECK(readArchive(target));
+  CHECK(sameJournal(journal, restored) && (! restored.length("stale")));
+  CHECK(target.blob == backup.blob);
+
+  ConfigJournal older(journalFile, journalTemp, 4096);
+  JournalBackup plain(older);
+
+  CHECK(readArchive(plain)); // Секция наследника пропускается базовым классом
+  CHECK(sameJournal(journal, older));
+
+  BlobBackup empty(journal); // Пустая секция наследника
+
+  CHECK(writeArchive(empty));
+  CHECK(memfs.files[archiveFile].size() == BACKUP_HEADER + empty.backupSize() + 1 + sizeof(uint16_t));
+  target.blob.assign(1, 0);
+  CHECK(readArchive(target) && target.blob.empty());
+}
+
+static void testDamaged() {
+  memfs.files.clear();
+
+  ConfigJournal journal(journalFile, journalTemp, 4096);
+  BlobBackup backup(journal);
+
+  fillJournal(journal);
+  backup.blob.assign(100, 0x5A);
+  CHECK(writeArchive(backup));
+
+  std::vector<uint8_t> good = memfs.files[archiveFile];
+  ConfigJournal restored(journalFile, journalTemp, 4096);
+  BlobBackup target(restored);
+
+  for (int iter = 0; iter < 200; ++iter) {
+    std::vector<uint8_t> &data = memfs.files[archiveFile];
+
+    data = good;
+    data[testRandom(data.size())] ^= 1 << testRandom(8);
+    CHECK(! readArchive(target)); // Любой измененный бит отвергается по CRC
+  }
+
+  std::vector<uint8_t> &data = memfs.files[archiveFile];
+  uint32_t len = BACKUP_HEADER + backup.backupSize(); // Без BACKUP_END
+
+  data.assign(good.begin(), good.begin() + len);
+
+  uint16_t crc = crc16(data.data(), data.size());
+
+  data.push_back(crc);
+  data.push_back(crc >> 8);
+  CHECK(! readArchive(target)); // Архив без завершающей секции
+
+  data = good;
+  data[BACKUP_HEADER + 1] += 1; // Длина секции журнала на байт больше фактической
+
+  crc = crc16(data.data(), data.size() - sizeof(uint16_t));
+  data[data.size() - 2] = crc;
+  data[data.size() - 1] = crc >> 8;
+  CHECK(! readArchive(target));
+
+  data = good;
+  data[0] ^= 0xFF; // Чужая сигнатура
+  crc = crc16(data.data(), data.size() - sizeof(uint16_t));
+  data[data.size() - 2] = crc;
+  data[data.size() - 1] = crc >> 8;
+  CHECK(! readArchive(target));
+}
+
+int main() {
+  testRoundTrip();
+  testDamaged();
+
+  return testResult("test_backup");
+}
@@ -0,0 +1,301 @@
+// Проверка и замер времени загрузки и сохранения конфигурации: EEPROMCache (getEEPROM/putEEPROM) и ConfigJournal
+
+#include <EEPROM.h>
+#include <FS.h>
+#include "test.h"
+#include "EEPROMCache.h"
+#include "ConfigJournal.h"
+#include "Crc.h"
+
+EEPROMClass EEPROM;
+MemFS memfs;
+FS SPIFFS;
+
+static const uint16_t EEPROM_SIZE = 4096; // Как в ESPWeb.cpp
+static const uint8_t MAX_STRING_LEN = 32; // Как в ESPWeb.h
+static const uint32_t SIGNATURE = 0xAA55A5A5;
+static const int8_t MAX_SCHEDULES = 10;
+
+static const char journalFile[] = "/config.jnl";
+static const char journalTemp[] = "/config.tmp";
+
+struct config_t { // Набор полей старой конфигурации ESPIRBlaster в EEPROM
+  bool apMode;
+  char ssid[MAX_STRING_LEN];
+  char password[MAX_STRING_LEN];
+  char domain[MAX_STRING_LEN];
+  char userName[MAX_STRING_LEN];
+  char userPassword[MAX_STRING_LEN];
+  char adminName[MAX_STRING_LEN];
+  char adminPassword[MAX_STRING_LEN];
+  char ntpServer1[MAX_STRING_LEN];
+  char ntpServer2[MAX_STRING_LEN];
+  char ntpServer3[MAX_STRING_LEN];
+  int8_t ntpTimeZone;
+  uint32_t ntpUpdateInterval;
+  char mqttServer[MAX_STRING_LEN];
+  uint16_t mqttPort;
+  char mqttUser[MAX_STRING_LEN];
+  char mqttPassword[MAX_STRING_LEN];
+  char mqttClient[MAX_STRING_LEN];
+  uint8_t periods[MAX_SCHEDULES];
+  int8_t hours[MAX_SCHEDULES];
+  int8_t minutes[MAX_SCHEDULES];
+  int16_t years[MAX_SCHEDULES];
+  int8_t buttons[MAX_SCHEDULES];
+};
+
+static void fillConfig(config_t &config, uint8_t variant) {
+  memset(&config, 0, sizeof(config));
+  config.apMode = variant & 1;
+  snprintf(config.ssid, sizeof(config.ssid), "HomeNetwork%u", variant);
+  strcpy(config.password, "0123456789abcdef0123456789abcde"); // Строка занимает все поле
+  strcpy(config.domain, "irblaster");
+  strcpy(config.adminName, "admin");
+  snprintf(config.adminPassword, sizeof(config.adminPassword), "secret%u", variant);
+  strcpy(config.ntpServer1, "pool.ntp.org");
+  strcpy(config.ntpServer2, "time.nist.gov");
+  config.ntpTimeZone = 3;
+  config.ntpUpdateInterval = 3600;
+  strcpy(config.mqttServer, "broker.local");
+  config.mqttPort = 1883;
+  strcpy(config.mqttClient, "IRblaster_1234");
+  for (int8_t i = 0; i < MAX_SCHEDULES; ++i) {
+    config.periods[i] = (i + variant) % 5;
+    config.hours[i] = i;
+    config.minutes[i] = i * 5;
+    config.years[i] = 2017 + i;
+    config.buttons[i] = i - 1;
+  }
+}
+
+static bool putConfig(EEPROMCache &eeprom, const config_t &c, uint16_t &offset) { // Как writeConfig() старых версий, но через putEEPROM
+  uint16_t start = offset;
+  uint8_t crc;
+
+  if (! eeprom.put(offset, SIGNATURE, c.apMode, c.ssid, c.password, c.domain, c.userName, c.userPassword, c.adminName, c.adminPassword,
+    c.ntpServer1, c.ntpServer2, c.ntpServer3, c.ntpTimeZone, c.ntpUpdateInterval, c.mqttServer, c.mqttPort, c.mqttUser, c.mqttPassword,
+    c.mqttClient, c.periods, c.hours, c.minutes, c.years, c.buttons))
+    return false;
+  crc = eeprom.crc8(start, offset);
+  return eeprom.write(offset, crc);
+}
+
+static bool getConfig(EEPROMCache &eeprom, config_t &c, uint16_t &offset) { // Как readEEPROMConfig() через getEEPROM
+  uint16_t start = offset;
+  uint32_t sign;
+
+  if ((! eeprom.get(offset, sign, c.apMode, c.ssid, c.password, c.domain, c.userName, c.userPassword, c.adminName, c.adminPassword,
+    c.ntpServer1, c.ntpServer2, c.ntpServer3, c.ntpTimeZone, c.ntpUpdateInterval, c.mqttServer, c.mqttPort, c.mqttUser, c.mqttPassword,
+    c.mqttClient, c.periods, c.hours, c.minutes, c.years, c.buttons)) || (sign != SIGNATURE))
+    return false;
+
+  uint8_t crc = eeprom.crc8(start, offset);
+
+  return eeprom.read(offset) == crc;
+}
+
+static void putBytes(uint16_t &offset, const void *data, uint16_t len) { // Побайтовая запись с CRC, как до перехода на блочное копирование
+  uint16_t start = offset;
+
+  for (uint16_t i = 0; i < len; ++i)
+    EEPROM.write(offset++, ((const uint8_t*)data)[i]);
+  EEPROM.write(offset, crc8(EEPROM.getConstDataPtr() + start, len));
+}
+
+static bool getBytes(uint16_t &offset, void *data, uint16_t len) {
+  uint16_t start = offset;
+
+  for (uint16_t i = 0; i < len; ++i)
+    ((uint8_t*)data)[i] = EEPROM.read(offset++);
+  return EEPROM.read(offset) == crc8(EEPROM.getConstDataPtr() + start, len);
+}
+
+static void testEEPROMCache() {
+  EEPROMCache eeprom(EEPROM_SIZE);
+  config_t saved, loaded;
+  uint16_t offset;
+
+  EEPROM.begin(EEPROM_SIZE);
+  fillConfig(saved, 1);
+  offset = 0;
+  CHECK(putConfig(eeprom, saved, offset));
+  CHECK(eeprom.dirty());
+  CHECK(eeprom.commit() && (EEPROM.commits == 1));
+
+  memset(&loaded, 0, sizeof(loaded));
+  offset = 0;
+  CHECK(getConfig(eeprom, loaded, offset));
+  CHECK(! memcmp(&saved, &loaded, sizeof(config_t)));
+
+  offset = 0; // Повторное сохранение без изменений не пишет во flash
+  CHECK(putConfig(eeprom, saved, offset));
+  CHECK(! eeprom.dirty());
+  CHECK(eeprom.commit() && (EEPROM.commits == 1));
+
+  fillConfig(saved, 2);
+  offset = 0;
+  CHECK(putConfig(eeprom, saved, offset));
+  CHECK(eeprom.commit() && (EEPROM.commits == 2));
+  offset = 0;
+  CHECK(getConfig(eeprom, loaded, offset) && (! memcmp(&saved, &loaded, sizeof(config_t))));
+
+  EEPROM.getDataPtr()[10] ^= 0x01; // Поврежденный байт обнаруживается CRC
+  offset = 0;
+  CHECK(! getConfig(eeprom, loaded, offset));
+
+  uint8_t block[16] = { 0 };
+
+  offset = EEPROM_SIZE - sizeof(block) + 1; // Выход за границу буфера
+  CHECK(! eeprom.put(offset, block));
+  CHECK(! eeprom.get(offset, block));
+  CHECK(offset == EEPROM_SIZE - sizeof(block) + 1);
+  offset = EEPROM_SIZE - sizeof(block);
+  CHECK(eeprom.put(offset, block) && (offset == EEPROM_SIZE));
+  CHECK(! eeprom.write(offset, (uint8_t)0));
+
+  String str;
+
+  offset = 100;
+  CHECK(eeprom.writeString(offset, String("full-length-string-0123456789abc"), MAX_STRING_LEN) && (offset == 100 + MAX_STRING_LEN));
+  offset = 100;
+  CHECK(eeprom.readString(offset, str, MAX_STRING_LEN) && (str.length() == MAX_STRING_LEN));
+  offset = 100;
+  CHECK(eeprom.writeString(offset, String("short"), MAX_STRING_LEN));
+  CHECK(! EEPROM.getConstDataPtr()[100 + 5] && (! EEPROM.getConstDataPtr()[100 + MAX_STRING_LEN - 1])); // Остаток поля обнулен
+  offset = 100;
+  CHECK(eeprom.readString(offset, str, MAX_STRING_LEN) && (str == "short"));
+  CHECK(eeprom.crc8(10, 10) == 0);
+  CHECK(eeprom.crc8(0, EEPROM_SIZE + 100) == eeprom.crc8(0, EEPROM_SIZE));
+
+  EEPROM.end();
+}
+
+static void testJournal() {
+  memfs.files.clear();
+
+  ConfigJournal journal(journalFile, journalTemp, 4096);
+  config_t config;
+
+  fillConfig(config, 1);
+  CHECK(journal.begin());
+  CHECK(journal.put("ssid", config.ssid, sizeof(config.ssid)));
+  CHECK(journal.put("ntpInterval", &config.ntpUpdateInterval, sizeof(config.ntpUpdateInterval)));
+  CHECK(journal.commit());
+  CHECK(journal.put("ssid", "changed", 8));
+  CHECK(journal.commit());
+
+  ConfigJournal loaded(journalFile, journalTemp, 4096);
+  char ssid[MAX_STRING_LEN] = { 0 };
+  uint32_t interval = 0;
+
+  CHECK(loaded.begin() && (loaded.count() == 2));
+  CHECK(loaded.get("ssid", ssid, sizeof(ssid)) && (! strcmp(ssid, "changed")));
+  CHECK(loaded.get("ntpInterval", &interval, sizeof(interval)) && (interval == config.ntpUpdateInterval));
+}
+
+static void putJournal(ConfigJournal &journal, const config_t &c) { // Ключи как у writeConfig()
+  journal.put("apMode", &c.apMode, sizeof(c.apMode));
+  journal.put("ssid", c.ssid, sizeof(c.ssid));
+  journal.put("password", c.password, sizeof(c.password));
+  journal.put("domain", c.domain, sizeof(c.domain));
+  journal.put("userName", c.userName, sizeof(c.userName));
+  journal.put("userPassword", c.userPassword, sizeof(c.userPassword));
+  journal.put("adminName", c.adminName, sizeof(c.adminName));
+  journal.put("adminPassword", c.adminPassword, sizeof(c.adminPassword));
+  journal.put("ntpServer1", c.ntpServer1, sizeof(c.ntpServer1));
+  journal.put("ntpServer2", c.ntpServer2, sizeof(c.ntpServer2));
+  journal.put("ntpServer3", c.ntpServer3, sizeof(c.ntpServer3));
+  journal.put("ntpTimeZone", &c.ntpTimeZone, sizeof(c.ntpTimeZone));
+  journal.put("ntpUpdateInterval", &c.ntpUpdateInterval, sizeof(c.ntpUpdateInterval));
+  journal.put("mqttServer", c.mqttServer, sizeof(c.mqttServer));
+  journal.put("mqttPort", &c.mqttPort, sizeof(c.mqttPort));
+  journal.put("mqttUser", c.mqttUser, sizeof(c.mqttUser));
+  journal.put("mqttPassword", c.mqttPassword, sizeof(c.mqttPassword));
+  journal.put("mqttClient", c.mqttClient, sizeof(c.mqttClient));
+  for (int8_t i = 0; i < MAX_SCHEDULES; ++i) {
+    char key[16];
+    int8_t schedule[3] = { (int8_t)c.periods[i], c.hours[i], c.minutes[i] };
+
+    snprintf(key, sizeof(key), "schedule%d", i);
+    journal.put(key, schedule, sizeof(schedule));
+  }
+}
+
+static void benchmark() {
+  static const int ROUNDS = 20000;
+  EEPROMCache eeprom(EEPROM_SIZE);
+  config_t configs[2], loaded;
+  uint16_t offset;
+  uint32_t sum = 0;
+
+  fillConfig(configs[0], 1);
+  fillConfig(configs[1], 2);
+  EEPROM.begin(EEPROM_SIZE);
+
+  Stopwatch saveTime;
+  for (int i = 0; i < ROUNDS; ++i) {
+    offset = 0;
+    putConfig(eeprom, configs[i & 1], offset);
+    eeprom.commit();
+  }
+  double saveSec = saveTime.seconds();
+
+  Stopwatch loadTime;
+  for (int i = 0; i < ROUNDS; ++i) {
+    offset = 0;
+    sum += getConfig(eeprom, loaded, offset) + loaded.ssid[11];
+  }
+  double loadSec = loadTime.seconds();
+
+  Stopwatch byteSaveTime;
+  for (int i = 0; i < ROUNDS; ++i) {
+    offset = 0;
+    putBytes(offset, &configs[i & 1], sizeof(config_t));
+    EEPROM.commit();
+  }
+  double byteSaveSec = byteSaveTime.seconds();
+
+  Stopwatch byteLoadTime;
+  for (int i = 0; i < ROUNDS; ++i) {
+    offset = 0;
+    sum += getBytes(offset, &loaded, sizeof(config_t)) + loaded.ssid[11];
+  }
+  double byteLoadSec = byteLoadTime.seconds();
+  EEPROM.end();
+
+  memfs.files.clear();
+
+  ConfigJournal journal(journalFile, journalTemp, 4096);
+
+  journal.begin();
+  Stopwatch journalSaveTime;
+  for (int i = 0; i < ROUNDS; ++i) {
+    putJournal(journal, configs[i & 1]);
+    journal.commit();
+  }
+  double journalSaveSec = journalSaveTime.seconds();
+
+  Stopwatch journalLoadTime;
+  for (int i = 0; i < ROUNDS; ++i) {
+    ConfigJournal reload(journalFile, journalTemp, 4096);
+
+    reload.begin();
+    sum += reload.count();
+  }
+  double journalLoadSec = journalLoadTime.seconds();
+
+  printf("  %u-byte EEPROM config, %d rounds (checksum %u)\n", (unsigned)sizeof(config_t), ROUNDS, sum);
+  printf("  putEEPROM save:      %7.3f us    per-byte baseline: %7.3f us\n", saveSec * 1e6 / ROUNDS, byteSaveSec * 1e6 / ROUNDS);
+  printf("  getEEPROM load:      %7.3f us    per-byte baseline: %7.3f us\n", loadSec * 1e6 / ROUNDS, byteLoadSec * 1e6 / ROUNDS);
+  printf("  journal save+commit: %7.3f us    journal load: %7.3f us (%u bytes, %u compactions)\n", journalSaveSec * 1e6 / ROUNDS,
+    journalLoadSec * 1e6 / ROUNDS, (unsigned)journal.size(), (unsigned)journal.compactions());
+}
+
+int main() {
+  testEEPROMCache();
+  testJournal();
+  benchmark();
+
+  return testResult("test_config");
+}
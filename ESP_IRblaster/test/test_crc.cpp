@@ -0,0 +1,111 @@
+// Сверка табличных CRC-8/CRC-16 (Crc.cpp) с прежними побитовыми реализациями и замер производительности
+
+#include <vector>
+#include "test.h"
+#include "Crc.h"
+
+static uint8_t bitwiseCrc8(const uint8_t *data, size_t len, uint8_t crc = CRC8_INIT) { // Прежний crc8EEPROM()
+  while (len--) {
+    crc ^= *data++;
+
+    for (uint8_t i = 0; i < 8; ++i)
+      crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+  }
+  return crc;
+}
+
+static uint16_t bitwiseCrc16(const uint8_t *data, size_t len, uint16_t crc = CRC16_INIT) { // Прежний memcrc16()
+  while (len--) {
+    crc ^= *data++ << 8;
+
+    for (uint8_t i = 0; i < 8; ++i)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static void testKnownValues() {
+  static const char check[] = "123456789";
+
+  CHECK(crc8((const uint8_t*)check, 9) == 0xA2); // CRC-8/NRSC-5 без отражения, init 0x00 -> 0xA2
+  CHECK(crc16((const uint8_t*)check, 9) == 0x29B1); // CRC-16/CCITT-FALSE
+  CHECK(crc8(NULL, 0) == CRC8_INIT);
+  CHECK(crc16(NULL, 0) == CRC16_INIT);
+}
+
+static void testSingleBytes() { // Каждый элемент таблиц
+  for (uint16_t crc = 0; crc < 256; ++crc) {
+    for (uint16_t b = 0; b < 256; ++b) {
+      uint8_t data = b;
+
+      CHECK(crc8(&data, 1, crc) == bitwiseCrc8(&data, 1, crc));
+      CHECK(crc16(&data, 1, crc << 8) == bitwiseCrc16(&data, 1, crc << 8));
+      CHECK(crc16(&data, 1, crc) == bitwiseCrc16(&data, 1, crc));
+    }
+  }
+}
+
+static void testRandomBuffers() {
+  std::vector<uint8_t> data(8192);
+
+  for (int iter = 0; iter < 500; ++iter) {
+    size_t len = testRandom(data.size() + 1);
+    uint8_t init8 = testRandom(2) ? CRC8_INIT : testRandom(256);
+    uint16_t init16 = testRandom(2) ? CRC16_INIT : testRandom(65536);
+
+    for (size_t i = 0; i < len; ++i)
+      data[i] = testRandom(256);
+    CHECK(crc8(data.data(), len, init8) == bitwiseCrc8(data.data(), len, init8));
+    CHECK(crc16(data.data(), len, init16) == bitwiseCrc16(data.data(), len, init16));
+
+    size_t split = len ? testRandom(len + 1) : 0; // Вычисление по частям совпадает с вычислением за один вызов
+
+    CHECK(crc8(data.data() + split, len - split, crc8(data.data(), split)) == crc8(data.data(), len));
+    CHECK(crc16(data.data() + split, len - split, crc16(data.data(), split)) == crc16(data.data(), len));
+  }
+}
+
+static void benchmark() {
+  static const size_t SIZE = 6 * 1024; // Порядка файла кнопок ДУ
+  static const int ROUNDS = 2000;
+  std::vector<uint8_t> data(SIZE);
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i < SIZE; ++i)
+    data[i] = testRandom(256);
+
+  Stopwatch table8;
+  for (int i = 0; i < ROUNDS; ++i)
+    sum += crc8(data.data(), SIZE, i);
+  double table8Sec = table8.seconds();
+
+  Stopwatch bitwise8;
+  for (int i = 0; i < ROUNDS; ++i)
+    sum += bitwiseCrc8(data.data(), SIZE, i);
+  double bitwise8Sec = bitwise8.seconds();
+
+  Stopwatch table16;
+  for (int i = 0; i < ROUNDS; ++i)
+    sum += crc16(data.data(), SIZE, i);
+  double table16Sec = table16.seconds();
+
+  Stopwatch bitwise16;
+  for (int i = 0; i < ROUNDS; ++i)
+    sum += bitwiseCrc16(data.data(), SIZE, i);
+  double bitwise16Sec = bitwise16.seconds();
+
+  printf("  %u-byte buffer, %d rounds (checksum %u)\n", (unsigned)SIZE, ROUNDS, sum);
+  printf("  crc8:  table %7.2f MB/s, bitwise %7.2f MB/s (x%.1f)\n", SIZE * ROUNDS / table8Sec / 1e6, SIZE * ROUNDS / bitwise8Sec / 1e6,
+    bitwise8Sec / table8Sec);
+  printf("  crc16: table %7.2f MB/s, bitwise %7.2f MB/s (x%.1f)\n", SIZE * ROUNDS / table16Sec / 1e6, SIZE * ROUNDS / bitwise16Sec / 1e6,
+    bitwise16Sec / table16Sec);
+}
+
+int main() {
+  testKnownValues();
+  testSingleBytes();
+  testRandomBuffers();
+  benchmark();
+
+  return testResult("test_crc");
+}
@@ -0,0 +1,180 @@
+// Проверка и замер производительности опознания raw-кодов (IRMatcher.cpp) на сотнях сохраненных кодов
+
+#include <vector>
+#include "test.h"
+#include "IRMatcher.h"
+
+typedef std::vector<uint16_t> rawcode_t;
+
+static rawcode_t necCode(uint32_t value) { // NEC: 9000/4500, 32 бита 560/560 или 560/1690
+  rawcode_t result = { 9000, 4500 };
+
+  for (uint8_t i = 0; i < 32; ++i) {
+    result.push_back(560);
+    result.push_back((value >> i) & 1 ? 1690 : 560);
+  }
+  result.push_back(560);
+  return result;
+}
+
+static rawcode_t sonyCode(uint16_t value) { // SIRC 12 бит: 2400, 1200/600 + 600
+  rawcode_t result = { 2400 };
+
+  for (uint8_t i = 0; i < 12; ++i) {
+    result.push_back(600);
+    result.push_back((value >> i) & 1 ? 1200 : 600);
+  }
+  result.back() = 600;
+  return result;
+}
+
+static rawcode_t acCode() { // Длинный кадр кондиционера: 3 блока по 64 бита
+  rawcode_t result;
+
+  for (uint8_t block = 0; block < 3; ++block) {
+    result.push_back(3500);
+    result.push_back(1750);
+    for (uint8_t i = 0; i < 64; ++i) {
+      result.push_back(430);
+      result.push_back(testRandom(2) ? 1300 : 430);
+    }
+    result.push_back(430);
+    result.push_back(block < 2 ? 10000 : 430);
+  }
+  result.pop_back();
+  return result;
+}
+
+static rawcode_t jitter(const rawcode_t &code, uint8_t percent) { // Погрешность приемника: случайное отклонение и удлинение импульсов за счет пауз
+  rawcode_t result = code;
+
+  for (size_t i = 0; i < result.size(); ++i) {
+    int32_t spread = (int32_t)result[i] * percent / 100;
+    int32_t value = result[i] + (spread ? (int32_t)testRandom(2 * spread + 1) - spread : 0) + ((i & 1) ? -50 : 50);
+
+    result[i] = value < 1 ? 1 : value;
+  }
+  return result;
+}
+
+static int32_t linearMatch(const std::vector<rawcode_t> &codes, const rawcode_t &raw) { // Полный перебор без индекса (для сравнения)
+  int32_t result = -1;
+  uint32_t best = UINT32_MAX;
+
+  for (size_t id = 0; id < codes.size(); ++id) {
+    const rawcode_t &code = codes[id];
+    uint32_t d = 0;
+
+    if (code.size() != raw.size())
+      continue;
+    for (size_t i = 0; (d != UINT32_MAX) && (i < raw.size()); ++i) {
+      uint16_t diff = raw[i] > code[i] ? raw[i] - code[i] : code[i] - raw[i];
+      uint32_t allowed = (uint32_t)code[i] * IRMATCH_TOLERANCE / 100;
+
+      if (allowed < IRMATCH_SLACK)
+        allowed = IRMATCH_SLACK;
+      d = diff > allowed ? UINT32_MAX : d + diff;
+    }
+    if (d < best) {
+      best = d;
+      result = id;
+    }
+  }
+  return result;
+}
+
+static std::vector<rawcode_t> storedCodes(uint16_t count) {
+  std::vector<rawcode_t> result;
+
+  for (uint16_t i = 0; i < count; ++i) {
+    switch (i % 10) {
+      case 0:
+        result.push_back(acCode());
+        break;
+      case 1:
+      case 2:
+        result.push_back(sonyCode(i)); // Разные значения для всех номеров
+        break;
+      default:
+        result.push_back(necCode(testRandom()));
+    }
+  }
+  return result;
+}
+
+static void testMatching() {
+  static const uint16_t CODES = 500;
+  std::vector<rawcode_t> codes = storedCodes(CODES);
+  IRMatcher matcher(CODES);
+
+  for (uint16_t i = 0; i < CODES; ++i)
+    CHECK(matcher.add(i, codes[i].data(), codes[i].size()));
+  CHECK(matcher.count() == CODES);
+  CHECK(! matcher.add(CODES, codes[0].data(), codes[0].size())); // Индекс заполнен
+  CHECK(! IRMatcher(1).add(0, codes[0].data(), 0)); // Пустой код не индексируется
+
+  for (uint16_t i = 0; i < CODES; ++i) {
+    CHECK(matcher.match(codes[i].data(), codes[i].size()) == i);
+
+    rawcode_t received = jitter(codes[i], 10);
+
+    CHECK(matcher.match(received.data(), received.size()) == i);
+    CHECK(matcher.match(received.data(), received.size()) == linearMatch(codes, received));
+  }
+
+  rawcode_t foreign = necCode(0x12345678);
+  rawcode_t shorter(codes[3].begin(), codes[3].end() - 2);
+
+  CHECK(matcher.match(foreign.data(), foreign.size()) == linearMatch(codes, foreign));
+  CHECK(matcher.match(shorter.data(), shorter.size()) == -1); // Коды другой длины не сравниваются
+  CHECK(matcher.match(NULL, 0) == -1);
+
+  matcher.clear();
+  CHECK((! matcher.count()) && (matcher.match(codes[0].data(), codes[0].size()) == -1));
+}
+
+static void benchmark() {
+  static const uint16_t CODES = 500;
+  static const int QUERIES = 20000;
+  std::vector<rawcode_t> codes = storedCodes(CODES);
+  std::vector<rawcode_t> queries;
+  std::vector<uint16_t> expected;
+  IRMatcher matcher(CODES);
+  int indexed = 0, linear = 0;
+
+  for (int i = 0; i < QUERIES; ++i) {
+    uint16_t id = testRandom(CODES);
+
+    expected.push_back(id);
+    queries.push_back(jitter(codes[id], 15));
+  }
+
+  Stopwatch addTime;
+  for (uint16_t i = 0; i < CODES; ++i)
+    matcher.add(i, codes[i].data(), codes[i].size());
+  double addSec = addTime.seconds();
+
+  Stopwatch matchTime;
+  for (int i = 0; i < QUERIES; ++i)
+    indexed += matcher.match(queries[i].data(), queries[i].size()) == expected[i];
+  double matchSec = matchTime.seconds();
+
+  Stopwatch linearTime;
+  for (int i = 0; i < QUERIES; ++i)
+    linear += linearMatch(codes, queries[i]) == expected[i];
+  double linearSec = linearTime.seconds();
+
+  CHECK(indexed == linear);
+  printf("  %u codes, %d queries with 15%% jitter\n", CODES, QUERIES);
+  printf("  index build: %8.2f us total\n", addSec * 1e6);
+  printf("  indexed:     %8.2f us/match, %d matched, %u hash hits, %u full scans\n", matchSec * 1e6 / QUERIES, indexed,
+    matcher.hashHits(), matcher.scans());
+  printf("  linear:      %8.2f us/match, %d matched\n", linearSec * 1e6 / QUERIES, linear);
+}
+
+int main() {
+  testMatching();
+  benchmark();
+
+  return testResult("test_irmatcher");
+}
@@ -0,0 +1,57 @@
+// Проверка подбора таймаута приемника и окна кадра для отсеивания эха собственной передачи (IRTimeout.cpp)
+
+#include <vector>
+#include "test.h"
+#include "IRTimeout.h"
+
+static std::vector<uint16_t> necFrame() { // rawbuf в единицах RAWTICK: [0] - пауза перед кадром
+  std::vector<uint16_t> result = { 0, 9000 / RAWTICK, 4500 / RAWTICK };
+
+  for (uint8_t i = 0; i < 32; ++i) {
+    result.push_back(560 / RAWTICK);
+    result.push_back((i & 1 ? 1690 : 560) / RAWTICK);
+  }
+  result.push_back(560 / RAWTICK);
+  return result;
+}
+
+static void testTimeout() {
+  IRTimeout timeout(90, 15);
+  std::vector<uint16_t> frame = necFrame();
+
+  CHECK(timeout.timeout() == 90);
+  CHECK(! timeout.update(NEC, frame.data(), frame.size()));
+  CHECK(! timeout.update(NEC, frame.data(), frame.size()));
+  CHECK(timeout.update(NEC, frame.data(), frame.size())); // После IRTIMEOUT_CONFIRM кадров: удвоенная пауза 4500 мкс -> 9 мс, но не менее 15
+  CHECK(timeout.timeout() == 15);
+  CHECK(timeout.update(DAIKIN, frame.data(), frame.size()) && (timeout.timeout() == 90)); // Кондиционер сразу возвращает длинный таймаут
+}
+
+static void testEchoWindow() {
+  static const uint8_t TIMEOUT = 15;
+  static const uint32_t DURATION = 68; // NEC-кадр в миллисекундах
+
+  // Передача 1000..1070, опрос каждые 5 мс: кадр, готовый на 1090, завершился в 1070..1075 - эхо
+  CHECK(IRTimeout::overlaps(1085, 1090, TIMEOUT, DURATION, 1000, 1070));
+  // Кадр пульта, готовый на 1300 при своевременном опросе, начался не раньше 1212 - не эхо
+  CHECK(! IRTimeout::overlaps(1295, 1300, TIMEOUT, DURATION, 1000, 1070));
+
+  // Поздний опрос: главный цикл был занят 1090..1400. Кадр мог завершиться в любой момент 1075..1385,
+  // в том числе сразу после передачи, поэтому считается эхом, хотя по времени разбора начался бы не раньше 1317
+  CHECK(IRTimeout::overlaps(1090, 1400, TIMEOUT, DURATION, 1000, 1070));
+  // Тот же поздний опрос, но передача закончилась до самого раннего возможного начала кадра (1075 - 68 = 1007)
+  CHECK(! IRTimeout::overlaps(1090, 1400, TIMEOUT, DURATION, 900, 1000));
+  // Передача после самого позднего возможного окончания кадра
+  CHECK(! IRTimeout::overlaps(1090, 1400, TIMEOUT, DURATION, 1390, 1460));
+
+  // Переполнение millis() внутри окна
+  CHECK(IRTimeout::overlaps(0xFFFFFFF0UL, 20, TIMEOUT, DURATION, 0xFFFFFFA0UL, 0xFFFFFFD0UL));
+  CHECK(! IRTimeout::overlaps(0xFFFFFFF0UL, 20, TIMEOUT, DURATION, 0xFFFFFF00UL, 0xFFFFFF10UL));
+}
+
+int main() {
+  testTimeout();
+  testEchoWindow();
+
+  return testResult("test_irtimeout");
+}
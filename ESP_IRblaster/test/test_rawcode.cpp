@@ -0,0 +1,245 @@
+// Fuzz-тест и замер производительности разбора raw-кодов (RawCode.cpp)
+
+#include <algorithm>
+#include <vector>
+#include "test.h"
+#include "RawCode.h"
+
+static const uint16_t MAX_RAW = 1024; // IRBUTTON_MAX_RAW
+static const uint16_t CANARY = 0xA55A; // Заполнитель буфера за пределами maxlen
+
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::vector<uint16_t> randomCode(uint16_t len) {
+  std::vector<uint16_t> result(len);
+
+  for (uint16_t i = 0; i < len; ++i)
+    result[i] = (testRandom(4) ? testRandom(3000) + 200 : testRandom(65536)); // В основном реальные длительности, иногда любые значения
+  return result;
+}
+
+static std::string toDecimal(const std::vector<uint16_t> &code) {
+  static const char *delimiters[] = { ",", ", ", " ", ";", "\r\n", "\t" };
+  std::string result;
+
+  if (testRandom(2))
+    result += delimiters[testRandom(6)];
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (i)
+      result += delimiters[testRandom(6)];
+    result += std::to_string(code[i]);
+  }
+  if (testRandom(2))
+    result += delimiters[testRandom(6)];
+  return result;
+}
+
+static std::string toBase64(const std::vector<uint16_t> &code, bool urlSafe, bool padding, bool lineBreaks) {
+  std::vector<uint8_t> bytes;
+  std::string result;
+
+  for (uint16_t v : code) {
+    bytes.push_back(v);
+    bytes.push_back(v >> 8);
+  }
+  for (size_t i = 0; i < bytes.size(); i += 3) {
+    uint32_t quad = bytes[i] << 16;
+    size_t n = bytes.size() - i;
+
+    if (n > 1)
+      quad |= bytes[i + 1] << 8;
+    if (n > 2)
+      quad |= bytes[i + 2];
+    for (size_t j = 0; j < 4; ++j) {
+      if (j <= n) {
+        char c = base64Chars[(quad >> (18 - 6 * j)) & 0x3F];
+
+        if (urlSafe && (c == '+'))
+          c = '-';
+        else if (urlSafe && (c == '/'))
+          c = '_';
+        result += c;
+      } else if (padding)
+        result += '=';
+    }
+    if (lineBreaks && (i % 57 == 54))
+      result += "\r\n";
+  }
+  return result;
+}
+
+static bool sameCode(const std::vector<uint16_t> &code, const uint16_t *buf, uint16_t len) {
+  return (len == code.size()) && ((! len) || (! memcmp(buf, code.data(), len * sizeof(uint16_t))));
+}
+
+static bool canaryIntact(const std::vector<uint16_t> &buf, uint16_t maxlen) {
+  for (size_t i = maxlen; i < buf.size(); ++i) {
+    if (buf[i] != CANARY)
+      return false;
+  }
+  return true;
+}
+
+static void testRoundTrip() {
+  std::vector<uint16_t> buf(MAX_RAW);
+
+  for (int iter = 0; iter < 2000; ++iter) {
+    std::vector<uint16_t> code = randomCode(testRandom(MAX_RAW) + 1);
+    std::string str;
+    uint16_t len;
+
+    str = toDecimal(code);
+    CHECK(parseRawDecimal(str.c_str(), str.length(), buf.data(), MAX_RAW, len) == RAWCODE_OK);
+    CHECK(sameCode(code, buf.data(), len));
+
+    str = toBase64(code, testRandom(2), testRandom(2), testRandom(2));
+    CHECK(parseRawBase64(str.c_str(), str.length(), buf.data(), MAX_RAW, len) == RAWCODE_OK);
+    CHECK(sameCode(code, buf.data(), len));
+
+    RawCodeParser parser(buf.data(), MAX_RAW);
+
+    for (size_t pos = 0; pos < str.length(); ) { // Base64 порциями произвольной длины
+      size_t part = std::min<size_t>(testRandom(64) + 1, str.length() - pos);
+
+      CHECK(parser.writeBase64(&str[pos], part));
+      pos += part;
+    }
+    CHECK(parser.finish() == RAWCODE_OK);
+    CHECK(sameCode(code, buf.data(), parser.length()));
+
+    const uint8_t *bytes = (const uint8_t*)code.data(); // Хост little-endian, как и формат загрузки
+    size_t size = code.size() * sizeof(uint16_t);
+
+    parser.reset();
+    for (size_t pos = 0; pos < size; ) { // Двоичные данные порциями, в том числе с разрывом значения
+      size_t part = std::min<size_t>(testRandom(33) + 1, size - pos);
+
+      CHECK(parser.write(&bytes[pos], part));
+      pos += part;
+    }
+    CHECK(parser.finish() == RAWCODE_OK);
+    CHECK(sameCode(code, buf.data(), parser.length()));
+  }
+}
+
+static void testLimits() {
+  std::vector<uint16_t> buf(MAX_RAW + 16, CANARY);
+  uint16_t len;
+
+  for (int iter = 0; iter < 500; ++iter) {
+    uint16_t maxlen = testRandom(64) + 1;
+    std::vector<uint16_t> code = randomCode(maxlen + testRandom(8) + 1);
+    std::string str;
+
+    std::fill(buf.begin(), buf.end(), CANARY);
+    str = toDecimal(code);
+    CHECK(parseRawDecimal(str.c_str(), str.length(), buf.data(), maxlen, len) == RAWCODE_TRUNCATED);
+    CHECK(len <= maxlen);
+    CHECK(canaryIntact(buf, maxlen));
+
+    std::fill(buf.begin(), buf.end(), CANARY);
+    str = toBase64(code, false, true, false);
+    CHECK(parseRawBase64(str.c_str(), str.length(), buf.data(), maxlen, len) == RAWCODE_TRUNCATED);
+    CHECK(len <= maxlen);
+    CHECK(canaryIntact(buf, maxlen));
+  }
+
+  static const char overflow[] = "100,65536,200";
+  static const char maxValue[] = "65535";
+  static const char oddBytes[] = "AQID"; // 3 байта - незавершенное значение
+  static const char lonely[] = "AQIDB"; // Одиночный символ в последней четверке
+  static const char afterPadding[] = "AQ==AQ==";
+  static const char illegal[] = "AQ*D";
+
+  CHECK(parseRawDecimal(overflow, strlen(overflow), buf.data(), MAX_RAW, len) == RAWCODE_OVERFLOW);
+  CHECK((parseRawDecimal(maxValue, strlen(maxValue), buf.data(), MAX_RAW, len) == RAWCODE_OK) && (len == 1) && (buf[0] == 65535));
+  CHECK((parseRawDecimal("", 0, buf.data(), MAX_RAW, len) == RAWCODE_OK) && (! len));
+  CHECK(parseRawBase64(oddBytes, strlen(oddBytes), buf.data(), MAX_RAW, len) == RAWCODE_ILLEGAL);
+  CHECK(parseRawBase64(lonely, strlen(lonely), buf.data(), MAX_RAW, len) == RAWCODE_ILLEGAL);
+  CHECK(parseRawBase64(afterPadding, strlen(afterPadding), buf.data(), MAX_RAW, len) == RAWCODE_ILLEGAL);
+  CHECK(parseRawBase64(illegal, strlen(illegal), buf.data(), MAX_RAW, len) == RAWCODE_ILLEGAL);
+}
+
+static void testGarbage() { // Произвольный ввод не должен выходить за пределы буфера
+  std::vector<uint16_t> buf(MAX_RAW + 16);
+  std::string alphabet = std::string(base64Chars) + "=-_ \r\n\t,;.*\x01\xFF";
+
+  for (int iter = 0; iter < 20000; ++iter) {
+    uint16_t maxlen = testRandom(MAX_RAW) + 1;
+    std::string str(testRandom(512), '\0');
+    uint16_t len;
+    rawcode_error_t error;
+
+    for (size_t i = 0; i < str.length(); ++i)
+      str[i] = testRandom(4) ? alphabet[testRandom(alphabet.length())] : (char)testRandom(256);
+
+    std::fill(buf.begin(), buf.end(), CANARY);
+    error = parseRawDecimal(str.c_str(), str.length(), buf.data(), maxlen, len);
+    CHECK(error <= RAWCODE_TRUNCATED);
+    CHECK(len <= maxlen);
+    CHECK(canaryIntact(buf, maxlen));
+
+    std::fill(buf.begin(), buf.end(), CANARY);
+    error = parseRawBase64(str.c_str(), str.length(), buf.data(), maxlen, len);
+    CHECK(error <= RAWCODE_TRUNCATED);
+    CHECK(len <= maxlen);
+    CHECK(canaryIntact(buf, maxlen));
+
+    RawCodeParser parser(buf.data(), maxlen);
+
+    std::fill(buf.begin(), buf.end(), CANARY);
+    parser.write((const uint8_t*)str.data(), str.length());
+    error = parser.finish();
+    CHECK((error == RAWCODE_OK) == ((str.length() % 2 == 0) && (str.length() / 2 <= maxlen)));
+    CHECK(parser.length() <= maxlen);
+    CHECK(canaryIntact(buf, maxlen));
+  }
+}
+
+static void benchmark() {
+  static const int ROUNDS = 2000;
+  std::vector<uint16_t> code = randomCode(MAX_RAW);
+  std::vector<uint16_t> buf(MAX_RAW);
+  std::string decimal = toDecimal(code);
+  std::string base64 = toBase64(code, false, true, false);
+  uint16_t len;
+  uint32_t sum = 0;
+
+  Stopwatch decimalTime;
+  for (int i = 0; i < ROUNDS; ++i) {
+    parseRawDecimal(decimal.c_str(), decimal.length(), buf.data(), MAX_RAW, len);
+    sum += buf[i % MAX_RAW];
+  }
+  double decimalSec = decimalTime.seconds();
+
+  Stopwatch base64Time;
+  for (int i = 0; i < ROUNDS; ++i) {
+    parseRawBase64(base64.c_str(), base64.length(), buf.data(), MAX_RAW, len);
+    sum += buf[i % MAX_RAW];
+  }
+  double base64Sec = base64Time.seconds();
+
+  RawCodeParser parser(buf.data(), MAX_RAW);
+  Stopwatch binaryTime;
+  for (int i = 0; i < ROUNDS; ++i) {
+    parser.reset();
+    parser.write((const uint8_t*)code.data(), code.size() * sizeof(uint16_t));
+    parser.finish();
+    sum += buf[i % MAX_RAW];
+  }
+  double binarySec = binaryTime.seconds();
+
+  printf("  %u-entry code, %d rounds (checksum %u)\n", MAX_RAW, ROUNDS, sum);
+  printf("  decimal: %8.2f MB/s, %7.2f us/code\n", decimal.length() * ROUNDS / decimalSec / 1e6, decimalSec * 1e6 / ROUNDS);
+  printf("  base64:  %8.2f MB/s, %7.2f us/code\n", base64.length() * ROUNDS / base64Sec / 1e6, base64Sec * 1e6 / ROUNDS);
+  printf("  binary:  %8.2f MB/s, %7.2f us/code\n", code.size() * sizeof(uint16_t) * ROUNDS / binarySec / 1e6, binarySec * 1e6 / ROUNDS);
+}
+
+int main() {
+  testRoundTrip();
+  testLimits();
+  testGarbage();
+  benchmark();
+
+  return testResult("test_rawcode");
+}
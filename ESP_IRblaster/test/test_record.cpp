@@ -0,0 +1,140 @@
+// Round-trip тесты сериализации записей (Record.cpp) и кнопок ДУ (IRButton.cpp)
+
+#include <vector>
+#include "test.h"
+#include "Record.h"
+#include "IRButton.h"
+
+static void testRecord() {
+  uint8_t buf[32];
+  RecordWriter writer(buf, sizeof(buf));
+
+  CHECK(writer.put8(0xA5));
+  CHECK(writer.put16(0x1234));
+  CHECK(writer.put32(0xDEADBEEF));
+  CHECK(writer.putStr("button", 15));
+  CHECK(writer.putStr("a very long name that is cut", 4)); // Сохраняется не более maxlen символов
+  CHECK(writer.ok() && (writer.length() == 1 + 2 + 4 + 1 + 6 + 1 + 4));
+  CHECK((buf[1] == 0x34) && (buf[2] == 0x12) && (buf[3] == 0xEF) && (buf[6] == 0xDE)); // little-endian независимо от платформы
+
+  RecordReader reader(buf, writer.length());
+  uint8_t v8;
+  uint16_t v16;
+  uint32_t v32;
+  char str[16];
+
+  CHECK(reader.get8(v8) && (v8 == 0xA5));
+  CHECK(reader.get16(v16) && (v16 == 0x1234));
+  CHECK(reader.get32(v32) && (v32 == 0xDEADBEEF));
+  CHECK(reader.getStr(str, sizeof(str)) && (! strcmp(str, "button")));
+  CHECK(reader.getStr(str, sizeof(str)) && (! strcmp(str, "a ve")));
+  CHECK(! reader.remaining());
+  CHECK(! reader.get8(v8)); // Поля за концом записи не читаются
+  CHECK(v8 == 0xA5);
+
+  RecordReader shortName(buf + 7, writer.length() - 7);
+
+  CHECK(! shortName.getStr(str, 6)); // Строка не помещается в буфер с завершающим нулем
+
+  RecordWriter overflow(buf, 5);
+
+  CHECK(overflow.put32(1));
+  CHECK(! overflow.put16(2));
+  CHECK(! overflow.put8(3)); // После переполнения запись не продолжается
+  CHECK((! overflow.ok()) && (overflow.length() == 4));
+}
+
+static void randomButton(irbutton_t &button, uint16_t len) {
+  uint8_t nameLen = testRandom(IRBUTTON_NAME_SIZE);
+
+  button.clear();
+  for (uint8_t i = 0; i < nameLen; ++i)
+    button.buttonName[i] = 'A' + testRandom(26);
+  button.repeat = testRandom(16);
+  button.gap = testRandom(4096);
+  CHECK(button.resize(len));
+  for (uint16_t i = 0; i < len; ++i)
+    button.rawBuf[i] = testRandom(65536);
+}
+
+static void testButtonRoundTrip() {
+  irbutton_t button, decoded;
+
+  for (int iter = 0; iter < 2000; ++iter) {
+    randomButton(button, testRandom(5) ? testRandom(200) : testRandom(IRBUTTON_MAX_RAW + 1));
+
+    std::vector<uint8_t> data(button.recordSize() + 8);
+    uint16_t len = button.encode(data.data(), data.size());
+
+    CHECK(len == button.recordSize());
+    CHECK(decoded.decode(data.data(), len));
+    CHECK(decoded.equals(button));
+    CHECK(button.encode(data.data(), len - 1) == 0); // Буфер на байт короче записи
+
+    std::vector<uint8_t> extended(data.begin(), data.begin() + len); // Поля будущих версий в конце записи пропускаются
+
+    extended.push_back(0x55);
+    extended.push_back(0xAA);
+    CHECK(decoded.decode(extended.data(), extended.size()) && decoded.equals(button));
+
+    uint16_t cut = testRandom(len);
+
+    CHECK(! decoded.decode(data.data(), cut)); // Усеченная запись отвергается, кнопка очищается
+    CHECK((! decoded.rawBufLen) && (! decoded.rawBuf) && (! *decoded.buttonName));
+  }
+}
+
+static void testButtonLimits() {
+  irbutton_t button;
+  uint8_t data[64];
+  RecordWriter writer(data, sizeof(data));
+
+  writer.putStr("big", IRBUTTON_NAME_SIZE - 1);
+  writer.put8(0xFF); // Лишние биты повторов и паузы отбрасываются
+  writer.put16(0xFFFF);
+  writer.put16(IRBUTTON_MAX_RAW + 1); // Код длиннее допустимого
+  CHECK(! button.decode(data, writer.length()));
+
+  RecordWriter masked(data, sizeof(data));
+
+  masked.putStr("mask", IRBUTTON_NAME_SIZE - 1);
+  masked.put8(0xFF);
+  masked.put16(0xFFFF);
+  masked.put16(1);
+  masked.put16(500);
+  CHECK(button.decode(data, masked.length()));
+  CHECK((button.repeat == 0x0F) && (button.gap == 0x0FFF) && (button.rawBufLen == 1) && (button.rawBuf[0] == 500));
+
+  CHECK(button.resize(0) && (! button.rawBuf) && (! button.rawBufLen));
+  CHECK(button.recordSize() == 1 + 4 + 1 + 2 + 2);
+}
+
+static void testButtonMoves() {
+  irbutton_t a, b;
+  uint16_t *rawA;
+
+  randomButton(a, 100);
+  randomButton(b, 3);
+  rawA = a.rawBuf;
+
+  irbutton_t copyA;
+
+  CHECK(copyA.assign(a) && copyA.equals(a) && (copyA.rawBuf != a.rawBuf));
+  a.swap(b); // Обмен не выделяет память и не копирует коды
+  CHECK((b.rawBuf == rawA) && (b.rawBufLen == 100) && b.equals(copyA));
+  CHECK(! a.equals(b));
+  CHECK(a.assign(a)); // Присваивание самой себе
+  CHECK(a.setRaw(b.rawBuf, 10) && (a.rawBufLen == 10) && (! memcmp(a.rawBuf, b.rawBuf, 10 * sizeof(uint16_t))));
+  CHECK(a.resize(20) && (! memcmp(a.rawBuf, b.rawBuf, 10 * sizeof(uint16_t)))); // Значения в пределах прежней длины сохраняются
+  a.clear();
+  CHECK((! a.rawBuf) && (! a.rawBufLen) && (! *a.buttonName) && (! a.repeat) && (! a.gap));
+}
+
+int main() {
+  testRecord();
+  testButtonRoundTrip();
+  testButtonLimits();
+  testButtonMoves();
+
+  return testResult("test_record");
+}
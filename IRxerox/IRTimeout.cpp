@@ -0,0 +1,55 @@
+#include "IRTimeout.h"
+
+bool IRTimeout::longGaps(decode_type_t type) {
+  switch (type) {
+    case UNKNOWN:
+    case MITSUBISHI_AC:
+    case DAIKIN:
+    case KELVINATOR:
+    case GREE:
+    case ARGO:
+    case TROTEC:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IRTimeout::update(decode_type_t type, const volatile uint16_t *rawbuf, uint16_t rawlen) {
+  uint8_t timeout = _timeout;
+
+  if (longGaps(type)) {
+    _type = type;
+    _frames = 0;
+    timeout = _longTimeout;
+  } else {
+    uint32_t longest = 0;
+
+    for (uint16_t i = 2; i < rawlen; i += 2) { // rawbuf[0] - пауза перед кадром, далее чередуются импульсы и паузы
+      if (rawbuf[i] > longest)
+        longest = rawbuf[i];
+    }
+    longest = (longest * RAWTICK * 2 + 999) / 1000; // Удвоенная самая длинная пауза в миллисекундах
+    if (longest < _minTimeout)
+      longest = _minTimeout;
+    if (longest > _longTimeout)
+      longest = _longTimeout;
+    if ((type != _type) || (! _frames)) {
+      _type = type;
+      _frames = 0;
+      _candidate = 0;
+    }
+    if (longest > _candidate)
+      _candidate = longest;
+    if (_frames < IRTIMEOUT_CONFIRM)
+      ++_frames;
+    if ((_frames >= IRTIMEOUT_CONFIRM) && (_candidate < timeout))
+      timeout = _candidate;
+  }
+
+  if (timeout == _timeout)
+    return false;
+  _timeout = timeout;
+
+  return true;
+}
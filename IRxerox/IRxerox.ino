@@ -1,21 +1,25 @@
 #include <IRremoteESP8266.h>
 #include <IRrecv.h>
 #include <IRsend.h>
+#include "IRTimeout.h"
 
 const uint8_t PIN_IR_RX = 13; // D7
 const uint8_t PIN_IR_TX = 15; // D8
 
 const uint16_t CAPTURE_BUFFER_SIZE = 256;
-const uint8_t TIMEOUT = 45; // 15
+const uint8_t TIMEOUT = 45; // Unknown and AC protocols
+const uint8_t TIMEOUT_MIN = 15; // Known protocols
 
 const uint32_t BLINK_TIMEOUT = 5000; // 5 sec.
 
-IRrecv irRX(PIN_IR_RX, CAPTURE_BUFFER_SIZE, TIMEOUT, true);
+IRTimeout irTimeout(TIMEOUT, TIMEOUT_MIN);
+IRrecv *irRX = new IRrecv(PIN_IR_RX, CAPTURE_BUFFER_SIZE, TIMEOUT, true);
 IRsend irTX(PIN_IR_TX);
 decode_results results;
 uint16_t rawBuf[CAPTURE_BUFFER_SIZE];
 uint16_t rawBufLen = 0;
 uint32_t nextBlink;
+uint32_t pollTime;
 
 void setup() {
   Serial.begin(115200, SERIAL_8N1, SERIAL_TX_ONLY);
@@ -24,8 +28,9 @@ void setup() {
   pinMode(LED_BUILTIN, OUTPUT);
   digitalWrite(LED_BUILTIN, HIGH);
 
-  irRX.enableIRIn();
+  irRX->enableIRIn();
   irTX.begin();
+  pollTime = millis();
 }
 
 bool cloneBuffer(decode_results *results) {
@@ -78,16 +83,34 @@ void ledPulse(uint32_t onDuration = 500, uint32_t offDuration = 0, uint8_t count
 }
 
 void loop() {
-  if (irRX.decode(&results)) {
+  uint32_t now = millis();
+
+  if (irRX->decode(&results)) {
+    Serial.print(F("Decode latency estimate: <= "));
+    Serial.print(irTimeout.timeout() + (now - pollTime)); // Frame was not ready at previous poll
+    Serial.println(F(" ms"));
+
+    bool retune = irTimeout.update(results.decode_type, results.rawbuf, results.rawlen);
+
     if (cloneBuffer(&results)) {
       ledPulse(250, 100, 3);
     }
-    irRX.resume();
+    irRX->resume();
+    if (retune) { // Timeout can be set only in constructor
+      irRX->disableIRIn();
+      delete irRX;
+      irRX = new IRrecv(PIN_IR_RX, CAPTURE_BUFFER_SIZE, irTimeout.timeout(), true);
+      irRX->enableIRIn();
+      Serial.print(F("IR receiver timeout set to "));
+      Serial.print(irTimeout.timeout());
+      Serial.println(F(" ms"));
+    }
   }
+  pollTime = millis();
   if (rawBufLen && ((int32_t)millis() >= (int32_t)nextBlink)) {
-    irRX.disableIRIn();
+    irRX->disableIRIn();
     irTX.sendRaw(rawBuf, rawBufLen, 38);
-    irRX.enableIRIn();
+    irRX->enableIRIn();
     ledPulse(250);
     nextBlink = millis() + BLINK_TIMEOUT;
   }